@@ -33,9 +33,11 @@ FT_NAMESPACE_BEGIN
 /** default constructor */
 fm_args::fm_args()
 	: program_name("fsmove"),
-      io_args(), exclude_list(NULL), inode_cache_path(NULL),
-      io_kind(FC_IO_AUTODETECT), ui_kind(FC_UI_NONE),
-      force_run(false), simulate_run(false)
+      io_args(), exclude_list(NULL), inode_cache_path(NULL), thread_n(1), copy_thread_n(1),
+      direct_io_min((ft_uoff)1 << 26), io_buffer_size((ft_size)1 << 20),
+      io_kind(FC_IO_AUTODETECT), ui_kind(FC_UI_NONE), order(FC_ORDER_READDIR),
+      fallocate_target(false), force_run(false), inode_cache_compress(false), io_uring(false), plan(true),
+      simulate_run(false)
 { }
 
 FT_NAMESPACE_END
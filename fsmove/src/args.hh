@@ -26,7 +26,7 @@
 #ifndef FSMOVE_ARGS_HH
 #define FSMOVE_ARGS_HH
 
-#include "types.hh"     // for ft_uint, ft_size
+#include "types.hh"     // for ft_uint, ft_size, ft_uoff
 #include "io/io.hh"     // for FC_ARGS_COUNT
 
 FT_NAMESPACE_BEGIN
@@ -41,9 +41,18 @@ public:
     const char * io_args[FT_IO_NS fm_io::FC_ARGS_COUNT];
     char const * const * exclude_list; // NULL-terminated array of files _not_ to move
     const char * inode_cache_path;
+    ft_size thread_n;        // number of threads moving files. if 0, will autodetect. default is 1
+    ft_size copy_thread_n;   // number of threads copying each large file. if 0, will autodetect. default is 1
+    ft_uoff direct_io_min;   // files at least this large are written bypassing the page cache. if 0, never. default is 64M
+    ft_size io_buffer_size;  // size of the aligned buffer used to copy such files. default is 1M
     fm_io_kind io_kind;      // if FC_IO_AUTODETECT, will autodetect
     fm_ui_kind ui_kind;      // default is FC_UI_NONE
+    fm_order_kind order;     // order to move the entries of each directory. default is FC_ORDER_READDIR
+    bool fallocate_target;   // if true, preallocate each target file before copying its contents. default is false
     bool force_run;          // if true, some sanity checks will be WARNINGS instead of ERRORS
+    bool inode_cache_compress; // if true, compress the paths stored in inode cache. default is false
+    bool io_uring;           // if true, move small files in batches with io_uring. default is false
+    bool plan;               // if true, scan source before moving to predict free space and postpone large files. default is true
     bool simulate_run;       // if true, move algorithm runs WITHOUT actually moving/preallocating any file/directory/special-device
 
     fm_args();
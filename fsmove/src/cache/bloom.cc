@@ -0,0 +1,99 @@
+/*
+ * fstransform - transform a file-system to another file-system type,
+ *               preserving its contents and without the need for a backup
+ *
+ * Copyright (C) 2011-2012 Massimiliano Ghilardi
+ *
+ *     This program is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as published by
+ *     the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     This program is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public License
+ *     along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * cache/bloom.cc
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: max
+ */
+
+#include "../first.hh"
+
+#include "bloom.hh"    // for ft_bloom
+
+FT_NAMESPACE_BEGIN
+
+/** default constructor */
+ft_bloom::ft_bloom() : layers(), last_count(0)
+{ }
+
+/** remove all keys */
+void ft_bloom::clear()
+{
+    layers.clear();
+    last_count = 0;
+}
+
+/** mix the bits of 'key' (splitmix64 finalizer) */
+ft_u64 ft_bloom::hash(ft_u64 key)
+{
+    key ^= key >> 30;
+    key *= (ft_u64)0xbf58476d1ce4e5b9ULL;
+    key ^= key >> 27;
+    key *= (ft_u64)0x94d049bb133111ebULL;
+    key ^= key >> 31;
+    return key;
+}
+
+/** return the bits set by 'hash' inside its word: 6 bits of 'hash' select each of them */
+ft_u64 ft_bloom::bits(ft_u64 hash)
+{
+    ft_u64 mask = 0;
+    for (ft_size i = 0; i < FC_BLOOM_HASH_N; i++, hash >>= 6)
+        mask |= (ft_u64)1 << (hash & 63);
+    return mask;
+}
+
+/** add 'key' to this filter */
+void ft_bloom::insert(ft_u64 key)
+{
+    if (layers.empty() || last_count * FC_BLOOM_BITS_PER_KEY >= layers.back().size() * 64) {
+        ft_size words = layers.empty() ? (ft_size)FC_BLOOM_FIRST_WORDS : layers.back().size() * FC_BLOOM_GROWTH;
+        layers.push_back(ft_layer());
+        layers.back().resize(words, 0);
+        last_count = 0;
+    }
+    ft_layer & layer = layers.back();
+    ft_u64 h = hash(key);
+    layer[index(layer, h)] |= bits(h);
+    last_count++;
+}
+
+/** return false if 'key' was certainly never inserted, true if it probably was */
+bool ft_bloom::contains(ft_u64 key) const
+{
+    ft_u64 h = hash(key), mask = bits(h);
+    for (ft_size i = 0, n = layers.size(); i < n; i++) {
+        const ft_layer & layer = layers[i];
+        if ((layer[index(layer, h)] & mask) == mask)
+            return true;
+    }
+    return false;
+}
+
+/** return number of bytes used by this filter */
+ft_size ft_bloom::memory_size() const
+{
+    ft_size words = 0;
+    for (ft_size i = 0, n = layers.size(); i < n; i++)
+        words += layers[i].size();
+    return words * sizeof(ft_u64);
+}
+
+FT_NAMESPACE_END
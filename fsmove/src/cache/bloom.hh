@@ -0,0 +1,90 @@
+/*
+ * fstransform - transform a file-system to another file-system type,
+ *               preserving its contents and without the need for a backup
+ *
+ * Copyright (C) 2011-2012 Massimiliano Ghilardi
+ *
+ *     This program is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as published by
+ *     the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     This program is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public License
+ *     along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * cache/bloom.hh
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: max
+ */
+
+#ifndef FSTRANSFORM_CACHE_BLOOM_HH
+#define FSTRANSFORM_CACHE_BLOOM_HH
+
+#include "../types.hh"   // for ft_u64, ft_size
+
+#include <vector>        // for std::vector<T>
+
+FT_NAMESPACE_BEGIN
+
+/**
+ * Bloom filter over 64-bit keys, used to skip inode cache lookups
+ * for inodes that were never added to it.
+ *
+ * each key sets FC_BLOOM_HASH_N bits inside a single 64-bit word, so a lookup
+ * reads one word per layer. since keys cannot be re-hashed, the filter grows
+ * by adding layers, each four times larger than the previous one:
+ * contains() may return false positives, never false negatives.
+ */
+class ft_bloom
+{
+private:
+    enum {
+        FC_BLOOM_HASH_N = 4,         //< bits set by each key
+        FC_BLOOM_BITS_PER_KEY = 16,  //< ~0.5% false positives per full layer
+        FC_BLOOM_FIRST_WORDS = 1024, //< first layer is 8k bytes
+        FC_BLOOM_GROWTH = 4
+    };
+
+    typedef std::vector<ft_u64> ft_layer;
+
+    std::vector<ft_layer> layers;
+    /** keys inserted in last layer */
+    ft_size last_count;
+
+    /** mix the bits of 'key' */
+    static ft_u64 hash(ft_u64 key);
+
+    /** return the bits set by 'hash' inside its word */
+    static ft_u64 bits(ft_u64 hash);
+
+    /** return the word of 'layer' used by 'hash' */
+    static FT_INLINE ft_size index(const ft_layer & layer, ft_u64 hash) {
+        return (ft_size)(hash >> 32) & (layer.size() - 1);
+    }
+
+public:
+    /** default constructor */
+    ft_bloom();
+
+    /** remove all keys */
+    void clear();
+
+    /** add 'key' to this filter */
+    void insert(ft_u64 key);
+
+    /** return false if 'key' was certainly never inserted, true if it probably was */
+    bool contains(ft_u64 key) const;
+
+    /** return number of bytes used by this filter */
+    ft_size memory_size() const;
+};
+
+FT_NAMESPACE_END
+
+#endif /* FSTRANSFORM_CACHE_BLOOM_HH */
@@ -0,0 +1,150 @@
+/*
+ * fstransform - transform a file-system to another file-system type,
+ *               preserving its contents and without the need for a backup
+ *
+ * Copyright (C) 2011-2012 Massimiliano Ghilardi
+ *
+ *     This program is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as published by
+ *     the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     This program is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public License
+ *     along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * cache/cache_bloom.hh
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: max
+ */
+
+#ifndef FSTRANSFORM_CACHE_CACHE_BLOOM_HH
+#define FSTRANSFORM_CACHE_CACHE_BLOOM_HH
+
+#include "../types.hh"   // for ft_size, ft_u64, ft_ull
+#include "bloom.hh"      // for ft_bloom
+#include "cache.hh"      // for ft_cache<K,V>
+
+FT_NAMESPACE_BEGIN
+
+/**
+ * associative array from keys (type K) to values (type V), that wraps another ft_cache<K,V>
+ * and remembers in a ft_bloom which keys were added to it:
+ * find_and_delete() skips most lookups of keys never added.
+ * Used to implement inode cache - see cache.hh for details.
+ *
+ * NOT thread-safe: wrap it in ft_cache_sharded to use it from several threads
+ */
+template<class K, class V>
+class ft_cache_bloom : public ft_cache<K, V>
+{
+private:
+    typedef ft_cache<K,V> super_type;
+
+    super_type * cache;
+    ft_bloom filter;
+    /** number of keys in wrapped cache, used to clear filter when it becomes empty */
+    ft_size count;
+    /** lookups skipped thanks to filter, performed anyway, and successful */
+    ft_ull skip_n, pass_n, hit_n;
+    /** false if wrapped cache may contain keys not in filter */
+    bool enabled;
+
+    /** cannot call copy constructor */
+    ft_cache_bloom(const ft_cache_bloom<K,V> &);
+
+    /** cannot call assignment operator */
+    const ft_cache_bloom<K,V> & operator=(const ft_cache_bloom<K,V> &);
+
+public:
+    /**
+     * constructor. takes ownership of 'wrapped_cache', which will be deleted by destructor.
+     * set 'filter_enabled' to false if 'wrapped_cache' already contains some keys
+     */
+    explicit ft_cache_bloom(super_type * wrapped_cache, bool filter_enabled = true)
+        : super_type(), cache(wrapped_cache), filter(), count(0),
+          skip_n(0), pass_n(0), hit_n(0), enabled(filter_enabled)
+    { }
+
+    /** destructor */
+    virtual ~ft_cache_bloom()
+    {
+        delete cache;
+    }
+
+    /** lookups skipped thanks to filter */
+    FT_INLINE ft_ull skipped() const { return skip_n; }
+
+    /** lookups performed because filter could not exclude the key */
+    FT_INLINE ft_ull passed() const { return pass_n; }
+
+    /** lookups performed and successful */
+    FT_INLINE ft_ull hits() const { return hit_n; }
+
+    /**
+     * if cached inode found, set payload and return 1.
+     * Otherwise add it to cache and return 0.
+     * On error, return < 0.
+     * if returns 0, find_and_delete() must be called on the same inode when done with payload!
+     */
+    virtual int find_or_add(const K key, V & inout_payload)
+    {
+        int err = cache->find_or_add(key, inout_payload);
+        if (err == 0) {
+            filter.insert((ft_u64)key);
+            count++;
+        }
+        return err;
+    }
+
+    /**
+     * if cached key found, set result_payload, remove cached key and return 1.
+     * Otherwise return 0. On error, return < 0.
+     */
+    virtual int find_and_delete(const K key, V & result_payload)
+    {
+        if (enabled) {
+            if (!filter.contains((ft_u64)key)) {
+                skip_n++;
+                return 0;
+            }
+            pass_n++;
+        }
+        int err = cache->find_and_delete(key, result_payload);
+        if (err == 1) {
+            if (enabled)
+                hit_n++;
+            // an empty cache needs no filter: start again from scratch
+            if (count != 0 && --count == 0)
+                filter.clear();
+        }
+        return err;
+    }
+
+    /**
+     * if cached inode found, change its payload and return 1.
+     * Otherwise return 0. On error, return < 0.
+     */
+    virtual int find_and_update(const K key, const V & new_payload)
+    {
+        return cache->find_and_update(key, new_payload);
+    }
+
+    /** clear wrapped cache and filter. the filter is enabled again */
+    virtual void clear()
+    {
+        cache->clear();
+        filter.clear();
+        count = 0;
+        enabled = true;
+    }
+};
+
+FT_NAMESPACE_END
+
+#endif /* FSTRANSFORM_CACHE_CACHE_BLOOM_HH */
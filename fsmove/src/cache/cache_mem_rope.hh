@@ -0,0 +1,157 @@
+/*
+ * fstransform - transform a file-system to another file-system type,
+ *               preserving its contents and without the need for a backup
+ *
+ * Copyright (C) 2011-2012 Massimiliano Ghilardi
+ *
+ *     This program is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as published by
+ *     the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     This program is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public License
+ *     along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * cache/cache_mem_rope.hh
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: max
+ */
+
+#ifndef FSTRANSFORM_CACHE_MEM_ROPE_HH
+#define FSTRANSFORM_CACHE_MEM_ROPE_HH
+
+#include "../assert.hh"          // for ff_assert()
+#include "../rope/rope_pool.hh"  // for ft_rope_pool, ft_rope
+#include "cache.hh"              // for ft_cache
+
+#ifdef FT_HAVE_FT_UNSORTED_MAP
+# include "../unsorted_map.hh"   // for ft_unsorted_map<K,V>
+#else
+# include <map>                  // for std::map<K,V>
+#endif
+
+
+FT_NAMESPACE_BEGIN
+
+/**
+ * in-memory associative array from keys (type K) to paths (ft_string).
+ * Used to implement inode cache - see cache.hh for details.
+ *
+ * paths are stored as ft_rope: the directory prefixes are created by an ft_rope_pool
+ * and shared by all the paths in the same directory, so millions of hard links
+ * cost little more than their file names.
+ * Interface is the same as ft_cache_mem<K,ft_string>
+ */
+template<class K>
+class ft_cache_mem_rope : public ft_cache<K, ft_string>
+{
+private:
+    typedef ft_cache<K,ft_string> super_type;
+
+#ifdef FT_HAVE_FT_UNSORTED_MAP
+    typedef ft_unsorted_map<K,ft_rope> map_type;
+#else
+    typedef std::map<K,ft_rope> map_type;
+#endif
+
+    ft_rope_pool pool;
+    map_type map;
+
+    /** forget all the prefixes in pool. existing ropes keep a reference to the prefixes they use */
+    void clear_pool()
+    {
+        ft_rope_pool empty_pool;
+        pool = empty_pool;
+    }
+
+public:
+    /** default constructor */
+    ft_cache_mem_rope(const ft_string & init_zero_payload = ft_string()) : super_type(init_zero_payload), pool(), map()
+    { }
+
+    /** copy constructor */
+    ft_cache_mem_rope(const ft_cache_mem_rope<K> & other) : super_type(other), pool(other.pool), map(other.map)
+    { }
+
+    /** assignment operator */
+    virtual const super_type & operator=(const ft_cache_mem_rope<K> & other)
+    {
+        if (this != &other) {
+            pool = other.pool;
+            map = other.map;
+        }
+        return super_type::operator=(other);
+    }
+
+    /** destructor */
+    virtual ~ft_cache_mem_rope()
+    { }
+
+    /**
+     * if cached inode found, set payload and return 1.
+     * Otherwise add it to cache and return 0.
+     * On error, return < 0.
+     * if returns 0, erase() must be called on the same inode when done with payload!
+     */
+    virtual int find_or_add(const K key, ft_string & inout_payload)
+    {
+        ff_assert(inout_payload != this->zero_payload);
+
+        ft_rope & value = map[key];
+        if (value.empty()) {
+            value = pool.make(inout_payload);
+            return 0;
+        }
+        inout_payload.clear();
+        value.to_string(inout_payload);
+        return 1;
+    }
+
+    /**
+     * if cached key found, set result_payload, remove cached key and return 1.
+     * Otherwise return 0. On error, return < 0.
+     */
+    virtual int find_and_delete(const K key, ft_string & result_payload)
+    {
+        typename map_type::iterator iter = map.find(key);
+        if (iter == map.end())
+            return 0;
+
+        result_payload.clear();
+        iter->second.to_string(result_payload);
+        map.erase(iter);
+        if (map.empty())
+            clear_pool();
+        return 1;
+    }
+
+    /**
+     * if cached inode found, change its payload and return 1.
+     * Otherwise return 0. On error, return < 0.
+     */
+    virtual int find_and_update(const K key, const ft_string & new_payload)
+    {
+        typename map_type::iterator iter = map.find(key);
+        if (iter == map.end())
+            return 0;
+
+        iter->second = pool.make(new_payload);
+        return 1;
+    }
+
+    virtual void clear()
+    {
+        map.clear();
+        clear_pool();
+    }
+};
+
+FT_NAMESPACE_END
+
+#endif /* FSTRANSFORM_CACHE_MEM_ROPE_HH */
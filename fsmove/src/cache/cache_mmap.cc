@@ -0,0 +1,607 @@
+/*
+ * fstransform - transform a file-system to another file-system type,
+ *               preserving its contents and without the need for a backup
+ *
+ * Copyright (C) 2011-2012 Massimiliano Ghilardi
+ *
+ *     This program is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as published by
+ *     the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     This program is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public License
+ *     along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * cache/cache_mmap.cc
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: max
+ */
+
+#include "../first.hh"
+
+#if defined(FT_HAVE_ERRNO_H)
+# include <errno.h>        // for errno
+#elif defined(FT_HAVE_CERRNO)
+# include <cerrno>         // for errno
+#endif
+#if defined(FT_HAVE_STDIO_H)
+# include <stdio.h>        // for rename()
+#elif defined(FT_HAVE_CSTDIO)
+# include <cstdio>         // for rename()
+#endif
+#if defined(FT_HAVE_STRING_H)
+# include <string.h>       // for memcmp(), memcpy(), memset()
+#elif defined(FT_HAVE_CSTRING)
+# include <cstring>        // for memcmp(), memcpy(), memset()
+#endif
+
+#ifdef FT_HAVE_DIRENT_H
+# include <dirent.h>       // for opendir(), readdir(), closedir()
+#endif
+#ifdef FT_HAVE_FCNTL_H
+# include <fcntl.h>        // for open()
+#endif
+#ifdef FT_HAVE_SYS_STAT_H
+# include <sys/stat.h>     // for fstat()
+#endif
+#ifdef FT_HAVE_SYS_MMAN_H
+# include <sys/mman.h>     // for mmap(), munmap()
+#endif
+#ifdef FT_HAVE_UNISTD_H
+# include <unistd.h>       // for close(), ftruncate(), unlink(), rmdir()
+#endif
+
+#include "../log.hh"
+#include "../assert.hh"       // for ff_assert()
+#include "../io/util_dir.hh"  // for ff_mkdir_recursive()
+#include "cache_mmap.hh"
+
+FT_NAMESPACE_BEGIN
+
+enum {
+    FC_CACHE_MMAP_SLOT_BITS_MIN = 12,       //< first table has 4096 slots, i.e. 64k bytes
+    FC_CACHE_MMAP_SLOT_BITS_MAX = 48,
+    FC_CACHE_MMAP_HEAP_MIN = (ft_size)1 << 18,
+
+    FC_CACHE_MMAP_POS_EMPTY = 0,            //< slot never used
+    FC_CACHE_MMAP_POS_DELETED = 1,          //< slot of a deleted inode
+    FC_CACHE_MMAP_POS_OFFSET = 2,           //< slot.pos = offset in heap + FC_CACHE_MMAP_POS_OFFSET
+
+    FC_CACHE_MMAP_FLAG_COMPRESSED = 1       //< header.flags: paths are compressed by ft_cache_zstring
+};
+
+static const char FC_CACHE_MMAP_MAGIC[8] = { 'f', 's', 'm', 'v', 'i', 'c', '0', '1' };
+static const char FC_CACHE_MMAP_FILE[] = "fsmove.inode_cache";
+
+/** beginning of the file */
+struct ft_cache_mmap_header {
+    char   magic[8];
+    ft_u64 slot_bits;  //< table has 2^slot_bits slots
+    ft_u64 used_n;     //< slots of cached inodes
+    ft_u64 deleted_n;  //< slots of deleted inodes
+    ft_u64 heap_len;   //< bytes used in heap
+    ft_u64 heap_dead;  //< bytes used in heap by paths of deleted inodes
+    ft_u64 flags;      //< FC_CACHE_MMAP_FLAG_* - was reserved, i.e. zero, in older files
+    ft_u64 reserved[1];
+};
+
+/** hash table entry */
+struct ft_cache_mmap_slot {
+    ft_u64 key;
+    ft_u64 pos;
+};
+
+/** heap entry: length of path, followed by its chars */
+typedef ft_u32 ft_cache_mmap_len;
+
+
+/** return length of file with 2^slot_bits slots and 'heap_len' bytes of heap */
+static ft_size ff_cache_mmap_file_len(ft_size slot_bits, ft_size heap_len)
+{
+    return sizeof(ft_cache_mmap_header) + (sizeof(ft_cache_mmap_slot) << slot_bits) + heap_len;
+}
+
+/** Fibonacci hashing: return the top 'slot_bits' bits of key * 2^64 / golden ratio */
+static FT_INLINE ft_size ff_cache_mmap_hash(ft_inode key, ft_size slot_bits)
+{
+    return (ft_size) (((ft_u64) key * (ft_u64)0x9e3779b97f4a7c15ULL) >> (64 - slot_bits));
+}
+
+
+/** default constructor */
+ft_cache_mmap::ft_cache_mmap()
+    : super_type(), path(), file_path(), map(NULL), map_len(0), fd(-1), reused(false)
+{ }
+
+/** destructor. calls close() */
+ft_cache_mmap::~ft_cache_mmap()
+{
+    close();
+}
+
+ft_cache_mmap_slot * ft_cache_mmap::slots() const
+{
+    return reinterpret_cast<ft_cache_mmap_slot *>(map + sizeof(ft_cache_mmap_header));
+}
+
+char * ft_cache_mmap::heap() const
+{
+    return map + ff_cache_mmap_file_len(header().slot_bits, 0);
+}
+
+ft_size ft_cache_mmap::heap_cap() const
+{
+    return map_len - ff_cache_mmap_file_len(header().slot_bits, 0);
+}
+
+/*
+ * initialize the cache, creating directory 'init_path' if needed.
+ * 'compressed' tells whether the caller stores paths compressed by ft_cache_zstring:
+ * a file left by a previous run with the other format is rejected.
+ * return 0 on success, else return error
+ */
+int ft_cache_mmap::init(const ft_string & init_path, bool compressed)
+{
+    close();
+    int err = FT_IO_NS ff_mkdir_recursive(init_path);
+    bool exists = err == EEXIST;
+    if (err != 0)
+    {
+        // EEXIST is a warning, everything else is an error
+        err = ff_log(exists ? FC_WARN : FC_ERROR, err, "failed to create cache directory `%s'", init_path.c_str());
+        if (!exists)
+            return err;
+    }
+    path = init_path;
+    /*
+     * comply with get_path() promise:
+     * remove trailing '/' unless it's exactly the path "/"
+     */
+    ft_size len = path.length();
+    if (len > 1 && path[len-1] == '/')
+        path.resize(len - 1);
+
+    file_path = path;
+    if (*file_path.rbegin() != '/')
+        file_path += '/';
+    file_path += FC_CACHE_MMAP_FILE;
+
+    const ft_u64 flags = compressed ? FC_CACHE_MMAP_FLAG_COMPRESSED : 0;
+    err = open_file();
+    if (err == 0) {
+        ft_cache_mmap_header & h = header();
+        reused = h.used_n != 0;
+        if (reused && h.flags != flags) {
+            err = ff_log(FC_ERROR, EINVAL, "inode cache file `%s' was created %s --inode-cache-compress:"
+                         " resume it with the same option", file_path.c_str(),
+                         (h.flags & FC_CACHE_MMAP_FLAG_COMPRESSED) ? "with" : "without");
+            close_file();
+            path.clear();
+            file_path.clear();
+            reused = false;
+            return err;
+        }
+        h.flags = flags;
+        if (reused)
+            ff_log(FC_INFO, 0, "resuming inode cache `%s' with %" FT_ULL " inodes",
+                   file_path.c_str(), (ft_ull) h.used_n);
+        return err;
+    }
+    if (err != ENOENT)
+        return err;
+
+#ifdef FT_HAVE_DIRENT_H
+    if (exists) {
+        // an existing directory without our file may contain an inode cache made of symlinks by an older fsmove
+        DIR * dir = opendir(path.c_str());
+        struct dirent * dirent;
+        while (dir != NULL && (dirent = readdir(dir)) != NULL) {
+            const char * name = dirent->d_name;
+            if (strcmp(name, ".") && strcmp(name, "..")) {
+                err = ff_log(FC_ERROR, EEXIST, "cache directory `%s' is not empty, but contains no `%s':"
+                             " it cannot be resumed by this fsmove version", path.c_str(), FC_CACHE_MMAP_FILE);
+                break;
+            }
+        }
+        if (dir != NULL)
+            (void) closedir(dir);
+        if (err != ENOENT) {
+            path.clear();
+            file_path.clear();
+            return err;
+        }
+    }
+#endif
+    if ((err = create_file(file_path, FC_CACHE_MMAP_SLOT_BITS_MIN, FC_CACHE_MMAP_HEAP_MIN, fd, map, map_len)) == 0)
+        header().flags = flags;
+    return err;
+}
+
+/** create file 'name' with 2^slot_bits empty slots and a heap of 'heap_len' bytes, and mmap() it */
+int ft_cache_mmap::create_file(const ft_string & name, ft_size slot_bits, ft_size heap_len,
+                               int & ret_fd, char * & ret_map, ft_size & ret_map_len)
+{
+    ft_size len = ff_cache_mmap_file_len(slot_bits, heap_len);
+    void * addr = MAP_FAILED;
+    int new_fd = -1, err = 0;
+    do {
+        if ((new_fd = ::open(name.c_str(), O_RDWR|O_CREAT|O_TRUNC, 0600)) < 0) {
+            err = ff_log(FC_ERROR, errno, "failed to create inode cache file `%s'", name.c_str());
+            break;
+        }
+        // ftruncate() fills the file with zeroes, i.e. all slots are empty
+        if (ftruncate(new_fd, (ft_off) len) != 0) {
+            err = ff_log(FC_ERROR, errno, "failed to resize inode cache file `%s' to %" FT_ULL " bytes",
+                         name.c_str(), (ft_ull) len);
+            break;
+        }
+        if ((addr = mmap(NULL, len, PROT_READ|PROT_WRITE, MAP_SHARED, new_fd, 0)) == MAP_FAILED) {
+            err = ff_log(FC_ERROR, errno, "failed to mmap() inode cache file `%s'", name.c_str());
+            break;
+        }
+        ft_cache_mmap_header & h = * reinterpret_cast<ft_cache_mmap_header *>(addr);
+        memcpy(h.magic, FC_CACHE_MMAP_MAGIC, sizeof(h.magic));
+        h.slot_bits = slot_bits;
+    } while (0);
+
+    if (err != 0) {
+        if (new_fd >= 0) {
+            (void) ::close(new_fd);
+            (void) ::unlink(name.c_str());
+        }
+        return err;
+    }
+    ret_fd = new_fd;
+    ret_map = reinterpret_cast<char *>(addr);
+    ret_map_len = len;
+    return err;
+}
+
+/** open and mmap() existing file_path. return 0 if success, ENOENT if not found, else error */
+int ft_cache_mmap::open_file()
+{
+    int err = 0;
+    do {
+        if ((fd = ::open(file_path.c_str(), O_RDWR)) < 0) {
+            err = errno;
+            if (err != ENOENT)
+                err = ff_log(FC_ERROR, err, "failed to open inode cache file `%s'", file_path.c_str());
+            break;
+        }
+        struct stat st;
+        if (fstat(fd, & st) != 0) {
+            err = ff_log(FC_ERROR, errno, "failed to stat inode cache file `%s'", file_path.c_str());
+            break;
+        }
+        map_len = (ft_size) st.st_size;
+        if ((ft_off) map_len != st.st_size || map_len < ff_cache_mmap_file_len(FC_CACHE_MMAP_SLOT_BITS_MIN, 0)) {
+            err = ff_log(FC_ERROR, EINVAL, "invalid inode cache file `%s': bad length %" FT_ULL,
+                         file_path.c_str(), (ft_ull) st.st_size);
+            break;
+        }
+        void * addr = mmap(NULL, map_len, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+        if (addr == MAP_FAILED) {
+            err = ff_log(FC_ERROR, errno, "failed to mmap() inode cache file `%s'", file_path.c_str());
+            break;
+        }
+        map = reinterpret_cast<char *>(addr);
+        err = validate();
+    } while (0);
+
+    if (err != 0)
+        close_file();
+    return err;
+}
+
+/** check that header of just-mmap()ed file is consistent with file length */
+int ft_cache_mmap::validate() const
+{
+    const ft_cache_mmap_header & h = header();
+    if (memcmp(h.magic, FC_CACHE_MMAP_MAGIC, sizeof(h.magic))
+        || h.slot_bits < FC_CACHE_MMAP_SLOT_BITS_MIN || h.slot_bits > FC_CACHE_MMAP_SLOT_BITS_MAX
+        || map_len < ff_cache_mmap_file_len(h.slot_bits, 0)
+        || h.used_n + h.deleted_n >= ((ft_u64)1 << h.slot_bits)
+        || h.heap_len > heap_cap() || h.heap_dead > h.heap_len)
+    {
+        return ff_log(FC_ERROR, EINVAL, "invalid inode cache file `%s': bad header", file_path.c_str());
+    }
+    return 0;
+}
+
+/** munmap() and close file. does not remove it */
+void ft_cache_mmap::close_file()
+{
+    if (map != NULL)
+        (void) munmap(map, map_len);
+    map = NULL;
+    map_len = 0;
+    if (fd >= 0)
+        (void) ::close(fd);
+    fd = -1;
+}
+
+/**
+ * close the file. if it contains no inodes, also remove it and the directory,
+ * otherwise keep it: a later run on the same directory will resume it
+ */
+void ft_cache_mmap::close()
+{
+    ft_u64 used_n = map != NULL ? header().used_n : 0;
+    close_file();
+    if (!file_path.empty()) {
+        if (used_n != 0)
+            ff_log(FC_WARN, 0, "keeping inode cache file `%s' with %" FT_ULL " inodes, needed to resume this run."
+                   " remove it before moving other files", file_path.c_str(), (ft_ull) used_n);
+        else if (::unlink(file_path.c_str()) != 0 && errno != ENOENT)
+            ff_log(FC_WARN, errno, "failed to remove inode cache file `%s'", file_path.c_str());
+        // directory may contain other files if it was specified by the user: leave it in such case
+        else
+            (void) ::rmdir(path.c_str());
+    }
+    path.clear();
+    file_path.clear();
+    reused = false;
+}
+
+/** remove all inodes from the cache */
+void ft_cache_mmap::clear()
+{
+    if (map == NULL)
+        return;
+    ft_cache_mmap_header & h = header();
+    // forget all slots and paths, but keep file length
+    memset(slots(), '\0', sizeof(ft_cache_mmap_slot) << h.slot_bits);
+    h.used_n = h.deleted_n = h.heap_len = h.heap_dead = 0;
+}
+
+/** make room for one more slot and for a path of 'len' bytes in heap. may remap file */
+int ft_cache_mmap::reserve(ft_size len)
+{
+    const ft_cache_mmap_header & h = header();
+    ft_size need = sizeof(ft_cache_mmap_len) + len;
+
+    // keep load factor <= 3/4, counting deleted slots too
+    if ((h.used_n + h.deleted_n + 1) * 4 > ((ft_u64)3 << h.slot_bits))
+        return rehash(len);
+
+    ft_size cap = heap_cap();
+    if (h.heap_len + need <= cap)
+        return 0;
+    // reclaim paths of deleted inodes if they are the majority of heap
+    if (h.heap_dead * 2 > h.heap_len)
+        return rehash(len);
+
+    return grow_heap(cap * 2 > h.heap_len + need ? cap * 2 : h.heap_len + need);
+}
+
+/** grow heap to at least 'new_heap_cap' bytes. remaps file */
+int ft_cache_mmap::grow_heap(ft_size new_heap_cap)
+{
+    ft_size new_len = ff_cache_mmap_file_len(header().slot_bits, new_heap_cap);
+
+    if (ftruncate(fd, (ft_off) new_len) != 0)
+        return ff_log(FC_ERROR, errno, "failed to resize inode cache file `%s' to %" FT_ULL " bytes",
+                      file_path.c_str(), (ft_ull) new_len);
+
+    void * addr = mmap(NULL, new_len, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED)
+        return ff_log(FC_ERROR, errno, "failed to mmap() inode cache file `%s'", file_path.c_str());
+
+    (void) munmap(map, map_len);
+    map = reinterpret_cast<char *>(addr);
+    map_len = new_len;
+    return 0;
+}
+
+/** rebuild the hash table in a new file, discarding deleted slots and paths. remaps file */
+int ft_cache_mmap::rehash(ft_size len)
+{
+    const ft_cache_mmap_header & h = header();
+    ft_size slot_bits = h.slot_bits;
+    while ((h.used_n + 1) * 2 > ((ft_u64)1 << slot_bits))
+        slot_bits++;
+    if (slot_bits > FC_CACHE_MMAP_SLOT_BITS_MAX)
+        return ff_log(FC_ERROR, ENOMEM, "inode cache file `%s' is full", file_path.c_str());
+
+    ft_size heap_live = h.heap_len - h.heap_dead, heap_len = (heap_live + sizeof(ft_cache_mmap_len) + len) * 2;
+    if (heap_len < FC_CACHE_MMAP_HEAP_MIN)
+        heap_len = FC_CACHE_MMAP_HEAP_MIN;
+
+    ft_string tmp_path = file_path + ".tmp";
+    int new_fd = -1;
+    char * new_map = NULL;
+    ft_size new_map_len = 0;
+    int err = create_file(tmp_path, slot_bits, heap_len, new_fd, new_map, new_map_len);
+    if (err != 0)
+        return err;
+
+    ft_cache_mmap old_cache;
+    old_cache.map = map;
+    old_cache.map_len = map_len;
+    old_cache.fd = fd;
+    map = new_map;
+    map_len = new_map_len;
+    fd = new_fd;
+    header().flags = old_cache.header().flags;
+
+    // copy cached inodes in the new table
+    ft_string value;
+    const ft_cache_mmap_slot * old_slot = old_cache.slots();
+    for (ft_size i = 0, n = (ft_size)1 << old_cache.header().slot_bits; i < n; i++, old_slot++) {
+        if (old_slot->pos < FC_CACHE_MMAP_POS_OFFSET)
+            continue;
+        bool found;
+        old_cache.load(old_slot, value);
+        store(find_slot((ft_inode) old_slot->key, found), (ft_inode) old_slot->key, value);
+    }
+
+    if (::rename(tmp_path.c_str(), file_path.c_str()) != 0) {
+        err = ff_log(FC_ERROR, errno, "failed to rename inode cache file `%s' to `%s'",
+                     tmp_path.c_str(), file_path.c_str());
+        // keep using the old file: it is the one that can be resumed
+        close_file();
+        map = old_cache.map;
+        map_len = old_cache.map_len;
+        fd = old_cache.fd;
+        (void) ::unlink(tmp_path.c_str());
+    } else
+        old_cache.close_file();
+
+    // prevent old_cache destructor from touching files
+    old_cache.map = NULL;
+    old_cache.fd = -1;
+    return err;
+}
+
+/**
+ * find the slot of 'key': set found = true and return it,
+ * or set found = false and return the slot where 'key' should be added
+ */
+ft_cache_mmap_slot * ft_cache_mmap::find_slot(ft_inode key, bool & found) const
+{
+    ft_size slot_bits = header().slot_bits, mask = ((ft_size)1 << slot_bits) - 1;
+    ft_size i = ff_cache_mmap_hash(key, slot_bits);
+    ft_cache_mmap_slot * table = slots(), * deleted = NULL;
+
+    // terminates because load factor is kept <= 3/4, so empty slots always exist
+    for (;; i = (i + 1) & mask) {
+        ft_cache_mmap_slot * slot = table + i;
+        if (slot->pos == FC_CACHE_MMAP_POS_EMPTY) {
+            found = false;
+            return deleted != NULL ? deleted : slot;
+        }
+        if (slot->pos == FC_CACHE_MMAP_POS_DELETED) {
+            if (deleted == NULL)
+                deleted = slot;
+        } else if (slot->key == (ft_u64) key) {
+            found = true;
+            return slot;
+        }
+    }
+}
+
+/** append 'value' to heap and store it in 'slot'. caller must call reserve() first */
+void ft_cache_mmap::store(ft_cache_mmap_slot * slot, ft_inode key, const ft_string & value)
+{
+    ft_cache_mmap_header & h = header();
+    ft_cache_mmap_len len = (ft_cache_mmap_len) value.size();
+    char * dst = heap() + h.heap_len;
+
+    ff_assert(h.heap_len + sizeof(len) + len <= heap_cap());
+    memcpy(dst, & len, sizeof(len));
+    memcpy(dst + sizeof(len), value.data(), len);
+
+    if (slot->pos == FC_CACHE_MMAP_POS_EMPTY || slot->pos == FC_CACHE_MMAP_POS_DELETED) {
+        if (slot->pos == FC_CACHE_MMAP_POS_DELETED)
+            h.deleted_n--;
+        h.used_n++;
+    } else {
+        ft_cache_mmap_len old_len;
+        memcpy(& old_len, heap() + (slot->pos - FC_CACHE_MMAP_POS_OFFSET), sizeof(old_len));
+        h.heap_dead += sizeof(old_len) + old_len;
+    }
+    slot->key = (ft_u64) key;
+    slot->pos = h.heap_len + FC_CACHE_MMAP_POS_OFFSET;
+    h.heap_len += sizeof(len) + len;
+}
+
+/** copy path stored in 'slot' into 'value' */
+void ft_cache_mmap::load(const ft_cache_mmap_slot * slot, ft_string & value) const
+{
+    const char * src = heap() + (slot->pos - FC_CACHE_MMAP_POS_OFFSET);
+    ft_cache_mmap_len len;
+    memcpy(& len, src, sizeof(len));
+    value.assign(src + sizeof(len), len);
+}
+
+/**
+ * mark 'slot' as deleted. if the table becomes empty, also forget all paths in heap.
+ * deleted slots are reclaimed by rehash(): clearing the whole table here would rewrite it
+ * each time the last cached inode is deleted
+ */
+void ft_cache_mmap::erase(ft_cache_mmap_slot * slot)
+{
+    ft_cache_mmap_header & h = header();
+    ft_cache_mmap_len len;
+    memcpy(& len, heap() + (slot->pos - FC_CACHE_MMAP_POS_OFFSET), sizeof(len));
+    slot->pos = FC_CACHE_MMAP_POS_DELETED;
+    h.heap_dead += sizeof(len) + len;
+    h.deleted_n++;
+
+    if (--h.used_n == 0)
+        h.heap_len = h.heap_dead = 0;
+}
+
+/**
+ * if cached inode found, set payload and return 1.
+ * Otherwise add it to cache and return 0.
+ * On error, return < 0.
+ * if returns 0, find_and_delete() must be called on the same inode when done with payload!
+ */
+int ft_cache_mmap::find_or_add(const ft_inode key, ft_string & inout_payload)
+{
+    ff_assert(map != NULL && inout_payload != zero_payload);
+    if (inout_payload.size() != (ft_cache_mmap_len) inout_payload.size())
+        return ff_log(FC_ERROR, ENAMETOOLONG, "path too long for inode cache: `%s'", inout_payload.c_str());
+
+    bool found;
+    ft_cache_mmap_slot * slot = find_slot(key, found);
+    if (found) {
+        load(slot, inout_payload);
+        return 1;
+    }
+    int err = reserve(inout_payload.size());
+    if (err != 0)
+        return err;
+    // reserve() may remap the file, find slot again
+    store(find_slot(key, found), key, inout_payload);
+    return 0;
+}
+
+/**
+ * if cached inode found, set result_payload, remove inode from cache and return 1.
+ * Otherwise return 0. On error, return < 0.
+ */
+int ft_cache_mmap::find_and_delete(const ft_inode key, ft_string & result_payload)
+{
+    ff_assert(map != NULL);
+    bool found;
+    ft_cache_mmap_slot * slot = find_slot(key, found);
+    if (!found)
+        return 0;
+
+    load(slot, result_payload);
+    erase(slot);
+    return 1;
+}
+
+/**
+ * if cached inode found, change its payload and return 1.
+ * Otherwise return 0. On error, return < 0.
+ */
+int ft_cache_mmap::find_and_update(const ft_inode key, const ft_string & new_payload)
+{
+    ff_assert(map != NULL);
+    if (new_payload.size() != (ft_cache_mmap_len) new_payload.size())
+        return ff_log(FC_ERROR, ENAMETOOLONG, "path too long for inode cache: `%s'", new_payload.c_str());
+
+    bool found;
+    (void) find_slot(key, found);
+    if (!found)
+        return 0;
+
+    int err = reserve(new_payload.size());
+    if (err != 0)
+        return err;
+    // reserve() may remap the file, find slot again
+    store(find_slot(key, found), key, new_payload);
+    return 1;
+}
+
+FT_NAMESPACE_END
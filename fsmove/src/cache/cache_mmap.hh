@@ -0,0 +1,165 @@
+/*
+ * fstransform - transform a file-system to another file-system type,
+ *               preserving its contents and without the need for a backup
+ *
+ * Copyright (C) 2011-2012 Massimiliano Ghilardi
+ *
+ *     This program is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as published by
+ *     the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     This program is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public License
+ *     along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * cache/cache_mmap.hh
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: max
+ */
+
+#ifndef FSTRANSFORM_CACHE_MMAP_HH
+#define FSTRANSFORM_CACHE_MMAP_HH
+
+#include "../types.hh"   // for ft_inode, ft_string, ft_size, ft_u64
+#include "cache.hh"      // for ft_cache<K,V>
+
+FT_NAMESPACE_BEGIN
+
+struct ft_cache_mmap_header;
+struct ft_cache_mmap_slot;
+
+/**
+ * on-disk associative array from inodes to paths, stored in a single mmap()ed file
+ * inside a directory. Used to implement inode cache - see cache.hh for details.
+ *
+ * the file contains a header, an open-addressing hash table of (inode, position) slots
+ * and an append-only heap of paths. paths of deleted inodes are reclaimed
+ * when the table is rebuilt. the kernel page cache holds the hot parts of the file,
+ * so RAM usage stays low even for huge numbers of hard links.
+ *
+ * the file survives an interrupted run: init() on the same directory resumes it,
+ * and close() keeps it unless it is empty.
+ */
+class ft_cache_mmap : public ft_cache<ft_inode, ft_string>
+{
+private:
+    typedef ft_cache<ft_inode, ft_string> super_type;
+
+    ft_string path, file_path;
+    char * map;
+    ft_size map_len;
+    int fd;
+    /* true if init() found a file with inodes left by a previous run */
+    bool reused;
+
+    /** cannot call copy constructor */
+    ft_cache_mmap(const ft_cache_mmap &);
+
+    /** cannot call assignment operator */
+    const ft_cache_mmap & operator=(const ft_cache_mmap &);
+
+    FT_INLINE ft_cache_mmap_header & header() const {
+        return * reinterpret_cast<ft_cache_mmap_header *>(map);
+    }
+
+    ft_cache_mmap_slot * slots() const;
+    char * heap() const;
+    ft_size heap_cap() const;
+
+    /** create file 'name' with 2^slot_bits empty slots and a heap of 'heap_len' bytes, and mmap() it */
+    static int create_file(const ft_string & name, ft_size slot_bits, ft_size heap_len,
+                           int & ret_fd, char * & ret_map, ft_size & ret_map_len);
+
+    /** open and mmap() existing file_path. return 0 if success, ENOENT if not found, else error */
+    int open_file();
+
+    /** check that header of just-mmap()ed file is consistent with file length */
+    int validate() const;
+
+    /** munmap() and close file. does not remove it */
+    void close_file();
+
+    /** make room for one more slot and for a path of 'len' bytes in heap. may remap file */
+    int reserve(ft_size len);
+
+    /** grow heap to at least 'new_heap_cap' bytes. remaps file */
+    int grow_heap(ft_size new_heap_cap);
+
+    /** rebuild the hash table in a new file, discarding deleted slots and paths. remaps file */
+    int rehash(ft_size len);
+
+    /**
+     * find the slot of 'key': set found = true and return it,
+     * or set found = false and return the slot where 'key' should be added
+     */
+    ft_cache_mmap_slot * find_slot(ft_inode key, bool & found) const;
+
+    /** append 'value' to heap and store it in 'slot'. caller must call reserve() first */
+    void store(ft_cache_mmap_slot * slot, ft_inode key, const ft_string & value);
+
+    /** copy path stored in 'slot' into 'value' */
+    void load(const ft_cache_mmap_slot * slot, ft_string & value) const;
+
+    /** mark 'slot' as deleted. if the table becomes empty, reset it */
+    void erase(ft_cache_mmap_slot * slot);
+
+public:
+    /** default constructor */
+    ft_cache_mmap();
+
+    /** destructor. calls close() */
+    virtual ~ft_cache_mmap();
+
+    /* guaranteed NOT to end with '/', unless it's exactly the path "/" */
+    const char * get_path() const { return path.c_str(); }
+
+    /* true if init() found a file with inodes left by a previous run */
+    bool is_reused() const { return reused; }
+
+    /*
+     * initialize the cache, creating directory 'init_path' if needed.
+     * 'compressed' tells whether the caller stores paths compressed by ft_cache_zstring:
+     * a file left by a previous run with the other format is rejected.
+     * return 0 on success, else return error
+     */
+    int init(const ft_string & init_path, bool compressed = false);
+
+    /**
+     * if cached inode found, set payload and return 1.
+     * Otherwise add it to cache and return 0.
+     * On error, return < 0.
+     * if returns 0, find_and_delete() must be called on the same inode when done with payload!
+     */
+    virtual int find_or_add(const ft_inode key, ft_string & inout_payload);
+
+    /**
+     * if cached inode found, set result_payload, remove inode from cache and return 1.
+     * Otherwise return 0. On error, return < 0.
+     */
+    virtual int find_and_delete(const ft_inode key, ft_string & result_payload);
+
+    /**
+     * if cached inode found, change its payload and return 1.
+     * Otherwise return 0. On error, return < 0.
+     */
+    virtual int find_and_update(const ft_inode key, const ft_string & new_payload);
+
+    /**
+     * close the file. if it contains no inodes, also remove it and the directory,
+     * otherwise keep it: a later run on the same directory will resume it
+     */
+    void close();
+
+    /** remove all inodes from the cache */
+    virtual void clear();
+};
+
+FT_NAMESPACE_END
+
+#endif /* FSTRANSFORM_CACHE_MMAP_HH */
@@ -0,0 +1 @@
+../../../fsremap/src/cache/cache_sharded.hh
\ No newline at end of file
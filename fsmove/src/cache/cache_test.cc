@@ -0,0 +1,156 @@
+/*
+ * fstransform - transform a file-system to another file-system type,
+ *               preserving its contents and without the need for a backup
+ *
+ * Copyright (C) 2011-2012 Massimiliano Ghilardi
+ *
+ *     This program is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as published by
+ *     the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     This program is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public License
+ *     along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * cache/cache_test.cc
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: max
+ */
+
+#include "../first.hh"
+
+#if defined(FT_HAVE_CERRNO)
+# include <cerrno>         // for EINVAL, EIO
+#elif defined(FT_HAVE_ERRNO_H)
+# include <errno.h>        // for EINVAL, EIO
+#endif
+
+#if defined(FT_HAVE_STDIO_H)
+# include <stdio.h>        // for snprintf()
+#elif defined(FT_HAVE_CSTDIO)
+# include <cstdio>         // for snprintf()
+#endif
+
+#include <vector>          // for std::vector<T>
+
+#include "../log.hh"       // for ff_log()
+#include "../misc.hh"      // for ff_str2un_scaled(), ff_now()
+#include "../thread.hh"    // for ff_thread_run(), ff_thread_cpu_count()
+#include "cache_bloom.hh"    // for ft_cache_bloom<K,V>
+#include "cache_mem_rope.hh" // for ft_cache_mem_rope<K>
+#include "cache_sharded.hh"  // for ft_cache_sharded<K,V>
+#include "cache_test.hh"
+
+FT_NAMESPACE_BEGIN
+
+/** shared state of the threads started by ff_cache_test_run() */
+struct ff_cache_test_job
+{
+    ft_cache<ft_inode, ft_string> * cache;
+    ft_size inode_n;
+};
+
+/** write into 'path' the name of the first link to 'inode' */
+static void ff_cache_test_path(ft_string & path, ft_inode inode)
+{
+    char buf[64];
+    (void) snprintf(buf, sizeof(buf), "/dir%04u/file%010" FT_ULL, (unsigned) (inode % 1000), (ft_ull) inode);
+    path = buf;
+}
+
+/**
+ * ft_thread_func executed by each thread started by ff_cache_test_run().
+ * behaves like fsmove on inode_n files with two links each, plus inode_n files with one link:
+ * first finds all the first links, then all the other files.
+ * the inodes of different threads are different, as when walking different directories
+ */
+static int ff_cache_test_thread(void * arg, ft_size thread_i)
+{
+    ff_cache_test_job & job = * (ff_cache_test_job *) arg;
+    ft_cache<ft_inode, ft_string> & cache = * job.cache;
+    /* inodes of files with one link are never added, so they must not collide with the others */
+    const ft_inode single_link = (ft_inode) 1 << 40, first = (ft_inode) (thread_i * job.inode_n + 1);
+    ft_string path, payload;
+    ft_size i;
+
+    for (i = 0; i < job.inode_n; i++) {
+        ft_inode inode = first + i;
+        ff_cache_test_path(payload, inode);
+        if (cache.find_or_add(inode, payload) != 0)
+            return ff_log(FC_ERROR, EIO, "inode %" FT_ULL " found in cache before it was added", (ft_ull) inode);
+    }
+    for (i = 0; i < job.inode_n; i++) {
+        ft_inode inode = first + i;
+        ff_cache_test_path(path, inode);
+
+        payload = "/other_link";
+        if (cache.find_or_add(inode, payload) != 1 || payload != path)
+            return ff_log(FC_ERROR, EIO, "inode %" FT_ULL " not found in cache after it was added", (ft_ull) inode);
+
+        if (cache.find_and_delete(inode | single_link, payload) != 0)
+            return ff_log(FC_ERROR, EIO, "inode %" FT_ULL " found in cache but never added", (ft_ull) (inode | single_link));
+
+        if (cache.find_and_delete(inode, payload) != 1 || payload != path)
+            return ff_log(FC_ERROR, EIO, "inode %" FT_ULL " not found in cache when deleting it", (ft_ull) inode);
+    }
+    return 0;
+}
+
+/** run ff_cache_test_thread() on 'thread_n' threads, using a cache with 'shard_n' shards */
+static int ff_cache_test_run(ft_size thread_n, ft_size inode_n, ft_size shard_n)
+{
+    std::vector<ft_cache<ft_inode, ft_string> *> shards(shard_n);
+    for (ft_size i = 0; i < shard_n; i++)
+        shards[i] = new ft_cache_bloom<ft_inode, ft_string>(new ft_cache_mem_rope<ft_inode>());
+
+    ft_cache_sharded<ft_inode, ft_string> cache(shards);
+    ff_cache_test_job job = { & cache, inode_n };
+    double start = 0.0, end = 0.0;
+
+    (void) ff_now(start);
+    int err = ff_thread_run(thread_n, ff_cache_test_thread, & job);
+    (void) ff_now(end);
+
+    if (err == 0) {
+        /* each inode causes 4 cache operations */
+        double elapsed = end - start, ops = 4.0 * (double) thread_n * (double) inode_n;
+        ff_log(FC_INFO, 0, "%3" FT_ULL " shard%s %8.3f seconds, %8.2f M ops/s", (ft_ull) shard_n,
+               shard_n == 1 ? " " : "s", elapsed, elapsed > 0.0 ? ops / elapsed * 1e-6 : 0.0);
+    }
+    return err;
+}
+
+/**
+ * check and benchmark ft_cache_sharded under contention,
+ * with the same stack of caches used by fsmove for its in-memory inode cache.
+ * argv[1] = optional number of threads, default number of CPUs
+ * argv[2] = optional inodes per thread, default 1M
+ * argv[3] = optional maximum number of shards, default 64
+ */
+int ff_cache_test(int argc, char ** argv)
+{
+    ft_size thread_n = ff_thread_cpu_count(), inode_n = (ft_size) 1 << 20, shard_max = 64;
+    int err = 0;
+
+    if ((argc > 1 && (err = ff_str2un_scaled(argv[1], & thread_n)) != 0)
+        || (argc > 2 && (err = ff_str2un_scaled(argv[2], & inode_n)) != 0)
+        || (argc > 3 && (err = ff_str2un_scaled(argv[3], & shard_max)) != 0)
+        || thread_n == 0 || shard_max == 0)
+        return ff_log(FC_ERROR, EINVAL, "Usage: %s [THREADS [INODES_PER_THREAD [MAX_SHARDS]]]", argv[0]);
+
+    ff_log(FC_INFO, 0, "%" FT_ULL " thread%s, %" FT_ULL " inodes per thread", (ft_ull) thread_n,
+           thread_n == 1 ? "" : "s", (ft_ull) inode_n);
+
+    /* 1 shard is equivalent to a single global lock */
+    for (ft_size shard_n = 1; err == 0 && shard_n <= shard_max; shard_n *= 2)
+        err = ff_cache_test_run(thread_n, inode_n, shard_n);
+    return err;
+}
+
+FT_NAMESPACE_END
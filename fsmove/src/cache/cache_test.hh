@@ -0,0 +1,42 @@
+/*
+ * fstransform - transform a file-system to another file-system type,
+ *               preserving its contents and without the need for a backup
+ *
+ * Copyright (C) 2011-2012 Massimiliano Ghilardi
+ *
+ *     This program is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as published by
+ *     the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     This program is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public License
+ *     along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * cache/cache_test.hh
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: max
+ */
+
+#ifndef FSTRANSFORM_CACHE_TEST_HH
+#define FSTRANSFORM_CACHE_TEST_HH
+
+FT_NAMESPACE_BEGIN
+
+/**
+ * check and benchmark ft_cache_sharded under contention,
+ * with the same stack of caches used by fsmove for its in-memory inode cache.
+ * argv[1] = optional number of threads, default number of CPUs
+ * argv[2] = optional inodes per thread, default 1M
+ * argv[3] = optional maximum number of shards, default 64
+ */
+int ff_cache_test(int argc, char ** argv);
+
+FT_NAMESPACE_END
+
+#endif /* FSTRANSFORM_CACHE_TEST_HH */
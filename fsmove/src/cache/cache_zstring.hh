@@ -0,0 +1,115 @@
+/*
+ * fstransform - transform a file-system to another file-system type,
+ *               preserving its contents and without the need for a backup
+ *
+ * Copyright (C) 2011-2012 Massimiliano Ghilardi
+ *
+ *     This program is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as published by
+ *     the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     This program is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public License
+ *     along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * cache/cache_zstring.hh
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: max
+ */
+
+#ifndef FSTRANSFORM_CACHE_ZSTRING_HH
+#define FSTRANSFORM_CACHE_ZSTRING_HH
+
+#include "../zstring.hh"  // for zinit(), z(), unz()
+#include "cache.hh"       // for ft_cache<K,V>
+
+FT_NAMESPACE_BEGIN
+
+/**
+ * associative array from keys (type K) to strings, that stores them
+ * into another ft_cache<K,ft_string> compressed with z().
+ * Used to implement inode cache - see cache.hh for details.
+ *
+ * compressed strings start with '\0', so the wrapped cache must accept
+ * arbitrary bytes: ft_cache_mem and ft_cache_mmap do, ft_cache_symlink does not.
+ */
+template<class K>
+class ft_cache_zstring : public ft_cache<K, ft_string>
+{
+private:
+    typedef ft_cache<K,ft_string> super_type;
+
+    super_type * cache;
+    ft_string zpayload;
+
+    /** cannot call copy constructor */
+    ft_cache_zstring(const ft_cache_zstring<K> &);
+
+    /** cannot call assignment operator */
+    const ft_cache_zstring<K> & operator=(const ft_cache_zstring<K> &);
+
+public:
+    /** constructor. takes ownership of 'wrapped_cache', which will be deleted by destructor */
+    explicit ft_cache_zstring(super_type * wrapped_cache) : super_type(), cache(wrapped_cache), zpayload()
+    {
+        zinit();
+    }
+
+    /** destructor */
+    virtual ~ft_cache_zstring()
+    {
+        delete cache;
+    }
+
+    /**
+     * if cached inode found, set payload and return 1.
+     * Otherwise add it to cache and return 0.
+     * On error, return < 0.
+     * if returns 0, erase() must be called on the same inode when done with payload!
+     */
+    virtual int find_or_add(const K key, ft_string & inout_payload)
+    {
+        z(zpayload, inout_payload);
+        int err = cache->find_or_add(key, zpayload);
+        if (err == 1)
+            unz(inout_payload, zpayload);
+        return err;
+    }
+
+    /**
+     * if cached key found, set result_payload, remove cached key and return 1.
+     * Otherwise return 0. On error, return < 0.
+     */
+    virtual int find_and_delete(const K key, ft_string & result_payload)
+    {
+        int err = cache->find_and_delete(key, zpayload);
+        if (err == 1)
+            unz(result_payload, zpayload);
+        return err;
+    }
+
+    /**
+     * if cached inode found, change its payload and return 1.
+     * Otherwise return 0. On error, return < 0.
+     */
+    virtual int find_and_update(const K key, const ft_string & new_payload)
+    {
+        z(zpayload, new_payload);
+        return cache->find_and_update(key, zpayload);
+    }
+
+    virtual void clear()
+    {
+        cache->clear();
+    }
+};
+
+FT_NAMESPACE_END
+
+#endif /* FSTRANSFORM_CACHE_ZSTRING_HH */
@@ -33,6 +33,9 @@ FT_NAMESPACE_BEGIN
 class fm_args;
 class fm_move;
 
+/* enums cannot be forward-declared: fm_io needs this one too */
+enum fm_order_kind { FC_ORDER_READDIR, FC_ORDER_INODE, FC_ORDER_PHYSICAL };
+
 FT_NAMESPACE_END
 
 
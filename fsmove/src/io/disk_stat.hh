@@ -100,6 +100,14 @@ public:
      */
     bool is_too_low_free_space(ft_uoff free) const;
 
+    /**
+     * return true if writing 'margin' more bytes could bring free space down to critically low levels
+     */
+    FT_INLINE bool is_close_to_full(ft_uoff margin) const
+    {
+        return is_too_low_free_space(this_free > margin ? this_free - margin : 0);
+    }
+
     /** return the used disk space */
     FT_INLINE ft_uoff get_used() const { return this_free < this_total ? this_total - this_free : 0; }
 };
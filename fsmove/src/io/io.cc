@@ -28,10 +28,13 @@
 #include "../args.hh"      // for fm_args
 #include "../assert.hh"    // for ff_assert()
 #include "../misc.hh"      // for ff_show_progress(), ff_now()
+#include "../thread.hh"    // for ff_thread_cpu_count()
 #include "io.hh"           // for fm_io
 
-#include "../cache/cache_mem.hh"     // for ft_cache_mem
-#include "../cache/cache_symlink.hh" // for ft_cache_symlink_kv
+#include "../cache/cache_mem_rope.hh" // for ft_cache_mem_rope
+#include "../cache/cache_mmap.hh"    // for ft_cache_mmap
+#include "../cache/cache_sharded.hh" // for ft_cache_sharded
+#include "../cache/cache_zstring.hh" // for ft_cache_zstring
 
 #if defined(FT_HAVE_MATH_H)
 # include <math.h>         // for sqrt()
@@ -56,15 +59,32 @@ char const * const fm_io::LABEL[] = {
         "SOURCE", "TARGET"
 };
 
+/**
+ * return the number of shards of in-memory inode cache for 'thread_n' threads:
+ * a few per thread, to make collisions rare, but only one without threads
+ */
+static ft_size fm_io_inode_cache_shard_n(ft_size thread_n)
+{
+    enum { FC_SHARD_PER_THREAD = 4, FC_SHARD_MAX = 64 };
+    ft_size shard_n = 1;
+    if (thread_n > 1)
+        while (shard_n < thread_n * FC_SHARD_PER_THREAD && shard_n < FC_SHARD_MAX)
+            shard_n *= 2;
+    return shard_n;
+}
+
 /** constructor */
 fm_io::fm_io()
-    : this_inode_cache(NULL), this_exclude_set(),
+    : this_inode_cache(NULL), this_inode_filters(), this_exclude_set(),
       this_source_stat(), this_target_stat(),
       this_source_root(), this_target_root(),
       this_eta(), this_work_total(0), this_work_report_threshold(0),
       this_work_done(0), this_work_last_reported(0),
       this_work_last_reported_time(0.0),
-      this_progress_msg(NULL), this_force_run(false), this_simulate_run(false)
+      this_progress_msg(NULL), this_thread_n(1), this_copy_thread_n(1),
+      this_direct_io_min(0), this_io_buffer_size(0),
+      this_order(FC_ORDER_READDIR), this_fallocate_target(false), this_force_run(false), this_io_uring(false), this_plan(false),
+      this_simulate_run(false)
 { }
 
 /**
@@ -99,12 +119,18 @@ int fm_io::open(const fm_args & args)
             break;
         }
     	const char * inode_cache_path = args.inode_cache_path;
+    	const ft_size thread_n = args.thread_n != 0 ? args.thread_n : ff_thread_cpu_count();
     	delete this_inode_cache;
     	this_inode_cache = NULL;
+    	this_inode_filters.clear();
+
+    	std::vector<ft_cache<ft_inode, ft_string> *> shards;
+    	bool filter_enabled = true;
     	if (inode_cache_path != NULL)
     	{
-    		ft_cache_symlink_kv<ft_inode, ft_string> * icp = new ft_cache_symlink_kv<ft_inode, ft_string>(inode_cache_path);
-    		err = icp->init(inode_cache_path);
+    		// a single file cannot be split among shards
+    		ft_cache_mmap * icp = new ft_cache_mmap();
+    		err = icp->init(inode_cache_path, args.inode_cache_compress);
     		if (err != 0)
     		{
     			delete icp;
@@ -112,12 +138,25 @@ int fm_io::open(const fm_args & args)
     		}
     		// icp->get_path() removes trailing '/' unless it's exactly the path "/"
     		inode_cache_path = icp->get_path();
-    		this_inode_cache = icp;
+    		shards.push_back(icp);
+    		// a resumed inode cache contains inodes from an interrupted run, missing from the filter
+    		filter_enabled = !icp->is_reused();
     	}
     	else
-    		this_inode_cache = new ft_cache_mem<ft_inode,ft_string>();
-
-
+    	{
+    		ft_size shard_n = fm_io_inode_cache_shard_n(thread_n);
+    		for (ft_size i = 0; i < shard_n; i++)
+    			shards.push_back(new ft_cache_mem_rope<ft_inode>());
+    	}
+    	for (ft_size i = 0, n = shards.size(); i < n; i++)
+    	{
+    		if (args.inode_cache_compress)
+    			shards[i] = new ft_cache_zstring<ft_inode>(shards[i]);
+    		ft_cache_bloom<ft_inode, ft_string> * filter = new ft_cache_bloom<ft_inode, ft_string>(shards[i], filter_enabled);
+    		this_inode_filters.push_back(filter);
+    		shards[i] = filter;
+    	}
+    	this_inode_cache = new ft_cache_sharded<ft_inode, ft_string>(shards);
 
         this_source_stat.set_name("source");
         this_target_stat.set_name("target");
@@ -125,9 +164,17 @@ int fm_io::open(const fm_args & args)
         this_target_root = arg2;
         this_eta.clear();
         this_work_total = this_work_report_threshold = this_work_done = this_work_last_reported = 0;
+        this_fallocate_target = args.fallocate_target;
         this_force_run = args.force_run;
+        this_io_uring = args.io_uring;
+        this_plan = args.plan;
         this_simulate_run = args.simulate_run;
         this_progress_msg = " still to move";
+        this_thread_n = thread_n;
+        this_copy_thread_n = args.copy_thread_n != 0 ? args.copy_thread_n : ff_thread_cpu_count();
+        this_direct_io_min = args.direct_io_min;
+        this_io_buffer_size = args.io_buffer_size;
+        this_order = args.order;
 
         char const * const * exclude_list = args.exclude_list;
         if (exclude_list != NULL) {
@@ -145,6 +192,7 @@ int fm_io::open(const fm_args & args)
 }
 
 
+/** thread-safe: look for 'inode' in inode cache, and add it if not found */
 int fm_io::inode_cache_find_or_add(ft_inode inode, ft_string & path)
 {
 	ft_size root_len = this_target_root.length();
@@ -157,6 +205,7 @@ int fm_io::inode_cache_find_or_add(ft_inode inode, ft_string & path)
     return err;
 }
 
+/** thread-safe: look for 'inode' in inode cache, and remove it if found */
 int fm_io::inode_cache_find_and_delete(ft_inode inode, ft_string & path)
 {
 	ft_size root_len = this_target_root.length();
@@ -292,7 +341,22 @@ void fm_io::close()
     this_eta.clear();
     this_work_done = this_work_last_reported = this_work_total = 0;
     this_progress_msg = NULL;
-    this_force_run = this_simulate_run = false;
+    this_thread_n = this_copy_thread_n = 1;
+    this_direct_io_min = 0;
+    this_io_buffer_size = 0;
+    this_order = FC_ORDER_READDIR;
+    this_fallocate_target = this_force_run = this_io_uring = this_plan = this_simulate_run = false;
+
+	ft_ull filter_skip = 0, filter_pass = 0, filter_hit = 0;
+	for (ft_size i = 0, n = this_inode_filters.size(); i < n; i++) {
+		filter_skip += this_inode_filters[i]->skipped();
+		filter_pass += this_inode_filters[i]->passed();
+		filter_hit += this_inode_filters[i]->hits();
+	}
+	if (filter_skip != 0 || filter_pass != 0)
+		ff_log(FC_DEBUG, 0, "inode cache filter: %" FT_ULL " lookups skipped, %" FT_ULL " performed, %" FT_ULL " found, %" FT_ULL " false positives",
+		       filter_skip, filter_pass, filter_hit, filter_pass - filter_hit);
+	this_inode_filters.clear();
 
 	delete this_inode_cache;
 	this_inode_cache = NULL;
@@ -31,12 +31,14 @@
 #include "../types.hh"       // for ft_string, ft_uoff
 #include "../eta.hh"         // for ft_eta
 #include "../log.hh"         // for ft_log_level, also for ff_log() used by io.cc
-#include "../fwd.hh"         // for fm_args
+#include "../fwd.hh"         // for fm_args, fm_order_kind
 #include "../cache/cache.hh" // for ft_cache<K,V>
+#include "../cache/cache_bloom.hh" // for ft_cache_bloom<K,V>
 
 #include "disk_stat.hh"      // for fm_disk_stat
 
 #include <set>               // for std::set
+#include <vector>            // for std::vector
 
 
 FT_IO_NAMESPACE_BEGIN
@@ -48,7 +50,10 @@ FT_IO_NAMESPACE_BEGIN
 class fm_io {
 
 private:
+    /** thread-safe: a ft_cache_sharded, each shard filtered by a ft_cache_bloom */
     ft_cache<ft_inode, ft_string> * this_inode_cache;
+    /** the filtered shards of this_inode_cache, which owns them. used only to log their statistics */
+    std::vector<ft_cache_bloom<ft_inode, ft_string> *> this_inode_filters;
     std::set<ft_string> this_exclude_set;
 
     fm_disk_stat this_source_stat, this_target_stat;
@@ -61,7 +66,12 @@ private:
 
     const char * this_progress_msg;
 
-    bool this_force_run, this_simulate_run;
+    ft_size this_thread_n, this_copy_thread_n;
+    ft_uoff this_direct_io_min;
+    ft_size this_io_buffer_size;
+    fm_order_kind this_order;
+
+    bool this_fallocate_target, this_force_run, this_io_uring, this_plan, this_simulate_run;
 
     /**
      * returns error if source or target file-system are almost full (typical threshold is 97%)
@@ -70,8 +80,13 @@ private:
 
 protected:
 
+    /** thread-safe: look for 'inode' in inode cache, and add it if not found */
     int inode_cache_find_or_add(ft_inode inode, ft_string & path);
 
+    /**
+     * thread-safe: look for 'inode' in inode cache, and remove it if found.
+     * uses a Bloom filter to skip looking for inodes never added to inode cache
+     */
     int inode_cache_find_and_delete(ft_inode inode, ft_string & path);
 
     FT_INLINE fm_disk_stat & source_stat() { return this_source_stat; }
@@ -149,15 +164,55 @@ public:
      */
     FT_INLINE const ft_string & target_root() const { return this_target_root; }
 
+    /**
+     * return the fallocate_target flag: if true, preallocate each target file before copying its contents
+     */
+    FT_INLINE bool fallocate_target() const { return this_fallocate_target; }
+
     /**
      * return the force_run flag
      */
     FT_INLINE bool force_run() const { return this_force_run; }
 
+    /**
+     * return the io_uring flag: if true, move small files in batches with io_uring
+     */
+    FT_INLINE bool io_uring() const { return this_io_uring; }
+
+    /**
+     * return the plan flag: if true, scan source before moving to predict free space and postpone large files
+     */
+    FT_INLINE bool plan() const { return this_plan; }
+
     /**
      * return the simulate_run flag
      */
     FT_INLINE bool simulate_run() const { return this_simulate_run; }
+
+    /**
+     * return the number of threads to use for moving files and directories
+     */
+    FT_INLINE ft_size thread_n() const { return this_thread_n; }
+
+    /**
+     * return the number of threads to use for copying each large file
+     */
+    FT_INLINE ft_size copy_thread_n() const { return this_copy_thread_n; }
+
+    /**
+     * return the minimum size of files to write bypassing the page cache, or 0 for none
+     */
+    FT_INLINE ft_uoff direct_io_min() const { return this_direct_io_min; }
+
+    /**
+     * return the size of the aligned buffer used to copy files at least direct_io_min() bytes large
+     */
+    FT_INLINE ft_size io_buffer_size() const { return this_io_buffer_size; }
+
+    /**
+     * return the order to move the entries of each directory
+     */
+    FT_INLINE fm_order_kind order() const { return this_order; }
 };
 
 
@@ -37,9 +37,14 @@
 # include <limits.h>       // for PATH_MAX
 #endif
 #if defined(FT_HAVE_CSTDIO)
-# include <cstdio>         // for rename()
+# include <cstdio>         // for rename(), fopen(), fgets(), fclose(), snprintf()
 #elif defined(FT_HAVE_STDIO_H)
-# include <stdio.h>        // for rename()
+# include <stdio.h>        // for rename(), fopen(), fgets(), fclose(), snprintf()
+#endif
+#if defined(FT_HAVE_CSTDLIB)
+# include <cstdlib>        // for posix_memalign(), free()
+#elif defined(FT_HAVE_STDLIB_H)
+# include <stdlib.h>       // for posix_memalign(), free()
 #endif
 #if defined(FT_HAVE_CSTRING)
 # include <cstring>        // for strcmp(), memset(), memcpy()
@@ -51,7 +56,7 @@
 # include <dirent.h>       // for opendir(), readdir(), closedir()
 #endif
 #ifdef FT_HAVE_FCNTL_H
-# include <fcntl.h>        // for open(), mknod()
+# include <fcntl.h>        // for open(), mknod(), splice(), fallocate(), fcntl(), posix_fadvise()
 #endif
 #ifdef FT_HAVE_SYS_STAT_H
 # include <sys/stat.h>     // for   "        "    , lstat(), mkdir(), mkfifo(), umask()
@@ -60,11 +65,26 @@
 # include <sys/types.h>    //  "    "        "        "        "        "         "    , lseek(), ftruncate()
 #endif
 #ifdef FT_HAVE_UNISTD_H
-# include <unistd.h>       //  "    "        "        "   ,symlink(),lchown(), close(),    "          "     , readlink(), read(), write()
+# include <unistd.h>       //  "    "        "        "   ,symlink(),lchown(), close(),    "          "     , readlink(), read(), write(), fdatasync()
+#endif
+#ifdef FT_HAVE_SYS_IOCTL_H
+# include <sys/ioctl.h>    // for ioctl()
+#endif
+#ifdef FT_HAVE_LINUX_FS_H
+# include <linux/fs.h>     // for FS_IOC_FIEMAP
+#endif
+#ifdef FT_HAVE_LINUX_FIEMAP_H
+# include <linux/fiemap.h> // for struct fiemap, struct fiemap_extent
+#endif
+#ifdef FT_HAVE_SYS_SENDFILE_H
+# include <sys/sendfile.h> // for sendfile()
 #endif
 #ifdef FT_HAVE_SYS_STATVFS_H
 # include <sys/statvfs.h>  // for statvfs(), fsblkcnt_t
 #endif
+#ifdef FT_HAVE_SYS_SYSMACROS_H
+# include <sys/sysmacros.h> // for major(), minor()
+#endif
 #ifdef FT_HAVE_SYS_TIME_H
 # include <sys/time.h>     // for utimes(), utimensat()
 #endif
@@ -76,12 +96,19 @@
 
 #include "../assert.hh"    // for ff_assert()
 #include "../log.hh"       // for ff_log()
-#include "../misc.hh"      // for ff_min2()
+#include "../misc.hh"      // for ff_min2(), ff_pretty_size()
+#include "../thread.hh"    // for ft_mutex, ft_cond, ff_thread_run()
+#include "../zero.hh"      // for ff_zero_length(), ff_mem_is_zero()
 
 #include "disk_stat.hh"    // for fm_disk_stat::THRESHOLD_MIN
 #include "io_posix.hh"     // for fm_io_posix
 #include "io_posix_dir.hh" // for ft_io_posix_dir
-#include "util_posix.hh"   // for ff_posix_exec_silent()
+#include "uring.hh"        // for fm_uring, FT_IO_URING, struct io_uring_sqe
+#include "util_posix.hh"   // for ff_posix_exec_silent(), FT_IO_POSIX_AT, *at() functions
+
+#include <algorithm>       // for std::sort(), std::stable_sort(), std::lower_bound()
+#include <deque>           // for std::deque<T>
+#include <set>             // for std::set<T>
 
 #ifndef PATH_MAX
 # define PATH_MAX 4096
@@ -89,10 +116,25 @@
 
 FT_IO_NAMESPACE_BEGIN
 
+/** read a flag such as fm_io_posix::uring_unsupported, possibly set concurrently by another thread */
+static FT_INLINE bool fm_io_posix_flag_load(const bool * ptr)
+{
+    return __atomic_load_n(ptr, __ATOMIC_RELAXED);
+}
+
+/** set a flag such as fm_io_posix::uring_unsupported, possibly read concurrently by other threads */
+static FT_INLINE void fm_io_posix_flag_store(bool * ptr)
+{
+    __atomic_store_n(ptr, true, __ATOMIC_RELAXED);
+}
+
 
 /** default constructor */
 fm_io_posix::fm_io_posix()
-: super_type(), bytes_copied_since_last_check(0)
+: super_type(), bytes_copied_since_last_check(0), bytes_copied_since_last_sync(0), bytes_in_flight(0),
+  source_root_fd(-1), target_root_fd(-1), fiemap_unsupported(false), fallocate_unsupported(false),
+  uring_unsupported(false), uring(), defer_min(0),
+  deferred_files(), deferred_dirs(), defer_mutex(), remove_queue(NULL), free_space_mutex()
 { }
 
 /** destructor. calls close() */
@@ -114,7 +156,14 @@ int fm_io_posix::open(const fm_args & args)
     do {
         if ((err = super_type::open(args)) != 0)
             break;
-        bytes_copied_since_last_check = 0;
+        bytes_copied_since_last_check = bytes_copied_since_last_sync = bytes_in_flight = 0;
+        fiemap_unsupported = fallocate_unsupported = uring_unsupported = false;
+        defer_min = 0;
+#ifdef FT_HAVE_SYNCFS
+        /* used only by sync(): if open() fails, sync() falls back on ::sync() */
+        source_root_fd = ::open(source_root().c_str(), O_RDONLY);
+        target_root_fd = ::open(target_root().c_str(), O_RDONLY);
+#endif
         err = check_free_space();
     } while (0);
     return err;
@@ -123,18 +172,29 @@ int fm_io_posix::open(const fm_args & args)
 /** close this I/O, including file descriptors */
 void fm_io_posix::close()
 {
+    if (source_root_fd >= 0)
+        (void) ::close(source_root_fd);
+    if (target_root_fd >= 0)
+        (void) ::close(target_root_fd);
+    source_root_fd = target_root_fd = -1;
+    uring.close();
+
     super_type::close();
-    bytes_copied_since_last_check = 0;
+    bytes_copied_since_last_check = bytes_copied_since_last_sync = bytes_in_flight = 0;
+    defer_min = 0;
+    deferred_files.clear();
+    deferred_dirs.clear();
 }
 
 
 /**
  * return true if estimated free space is enough to write 'bytes_to_write'
- * if first_check is true, does a more conservative estimation, requiring twice more free space than normal
+ * if first_check is true, does a more conservative estimation, requiring twice more free space than normal.
+ * caller must hold free_space_mutex
  */
 bool fm_io_posix::enough_free_space(ft_uoff bytes_to_write, bool first_time)
 {
-    ft_uoff half_free_space = ff_min2(source_stat().get_free(), target_stat().get_free()) >> 1;
+    ft_uoff half_free_space = unflushed_free_space() >> 1;
     if (first_time)
         half_free_space >>= 1;
 
@@ -142,45 +202,95 @@ bool fm_io_posix::enough_free_space(ft_uoff bytes_to_write, bool first_time)
         && half_free_space - bytes_to_write > bytes_copied_since_last_check;
 }
 
+/**
+ * return the free space of the fuller disk, minus the bytes written since last sync():
+ * with loop devices, they use space in the source file system only after they are flushed,
+ * so disk stats do not account for them yet.
+ * caller must hold free_space_mutex
+ */
+ft_uoff fm_io_posix::unflushed_free_space()
+{
+    ft_uoff free_space = ff_min2(source_stat().get_free(), target_stat().get_free());
+    return free_space > bytes_copied_since_last_sync ? free_space - bytes_copied_since_last_sync : 0;
+}
+
 /**
  * add bytes_just_written to bytes_copied_since_last_check.
  *
  * if bytes_copied_since_last_check >= PERIODIC_CHECK_FREE_SPACE or >= 50% of free space,
- * reset bytes_copied_since_last_check to zero and call check_free_space()
+ * reset bytes_copied_since_last_check to zero, call remove_pending() and check_free_space().
+ *
+ * thread-safe: all threads share the same free space budget
  */
 int fm_io_posix::periodic_check_free_space(ft_uoff bytes_just_written, ft_uoff bytes_to_write)
 {
+    ft_mutex_guard guard(free_space_mutex);
+
     add_work_done(bytes_just_written);
 
     bytes_copied_since_last_check += bytes_just_written;
+    bytes_copied_since_last_sync += bytes_just_written;
 
     int err = 0;
 
     if (!enough_free_space(bytes_to_write)) {
         bytes_copied_since_last_check = 0;
-        err = check_free_space();
+        /* source files queued for removal still use space: remove them before measuring it */
+        if ((err = remove_pending()) == 0)
+            err = check_free_space();
     }
     return err;
 }
 
 
 /**
- * sync(), then call disk_stat() twice: one time on source_root() and another on target_root().
+ * call sync() if needed, then call disk_stat() twice: one time on source_root() and another on target_root().
  * return error if statvfs() fails or if free disk space becomes critically low
  */
 int fm_io_posix::check_free_space()
 {
-    sync(); // slow, but needed to get accurate disk stats when loop devices are involved
+    sync_if_needed();
     int err = disk_stat(source_root().c_str(), source_stat());
     if (err == 0)
         err = disk_stat(target_root().c_str(), target_stat());
     return err;
 }
 
-/** call ::sync(). slow, but needed to get accurate disk stats when loop devices are involved */
+/**
+ * call sync() if data written since last sync(), and possibly not yet accounted by disk stats,
+ * reached half of free space - the same bound used by enough_free_space() -
+ * or could bring free space of source or target disk down to critically low levels.
+ * caller must hold free_space_mutex, or be the only thread
+ */
+void fm_io_posix::sync_if_needed()
+{
+    /* worst case: none of the data written since last sync() is accounted in disk stats yet */
+    ft_uoff margin = bytes_copied_since_last_sync;
+    if (margin == 0)
+        return;
+
+    ft_uoff half_free_space = ff_min2(source_stat().get_free(), target_stat().get_free()) >> 1;
+    if (margin < half_free_space && !source_stat().is_close_to_full(margin) && !target_stat().is_close_to_full(margin))
+        return;
+
+    sync();
+    bytes_copied_since_last_sync = 0;
+}
+
+/**
+ * flush target file system, then source file system, with syncfs():
+ * needed to get accurate disk stats when loop devices are involved,
+ * because data written to the loop device uses space in the source file system only after it is flushed.
+ * falls back on ::sync() if syncfs() is not available
+ */
 void fm_io_posix::sync()
 {
-	::sync();
+#ifdef FT_HAVE_SYNCFS
+    if (source_root_fd >= 0 && target_root_fd >= 0
+        && ::syncfs(target_root_fd) == 0 && ::syncfs(source_root_fd) == 0)
+        return;
+#endif
+    ::sync();
 }
 
 /**
@@ -249,6 +359,15 @@ FT_INLINE static bool fm_io_posix_is_file(const ft_stat & stat)
     return S_ISREG(stat.st_mode);
 }
 
+/**
+ * return the space released by removing the file described by 'stat':
+ * zero if other links to the same inode remain
+ */
+FT_INLINE static ft_uoff fm_io_posix_released_bytes(const ft_stat & stat)
+{
+    return stat.st_nlink > 1 ? 0 : (ft_uoff) stat.st_blocks * 512;
+}
+
 /**
  * return true if 'stat' information is about a symbolic link
  */
@@ -258,6 +377,122 @@ FT_INLINE static bool fm_io_posix_is_symlink(const ft_stat & stat)
 }
 
 
+/** a source file or directory to remove, queued by fm_io_posix::remove_later() */
+struct fm_remove_task
+{
+    ft_string path;
+    /** space released by removing it */
+    ft_uoff bytes;
+    bool is_dir;
+};
+
+/** source files and directories waiting to be removed by fm_io_posix::remove_thread() */
+struct fm_remove_queue
+{
+    enum {
+        /** if queue contains more than this number of tasks, fm_io_posix::remove_later() executes the oldest one */
+        FC_REMOVE_QUEUE_MAX = 1024,
+        /** fm_io_posix::remove_later() queues only files releasing at least this number of bytes */
+        FC_REMOVE_LATER_MIN = 1 << 20,
+    };
+
+    std::deque<fm_remove_task> tasks;
+    ft_mutex mutex;
+    ft_cond cond;
+    /** space released by queued and running tasks */
+    ft_uoff bytes;
+    /** number of tasks being executed */
+    ft_size running;
+    /** true if no more tasks will be queued */
+    bool closed;
+    /** first error returned by a task */
+    int err;
+
+    fm_remove_queue()
+        : tasks(), mutex(), cond(), bytes(0), running(0), closed(false), err(0)
+    { }
+
+    /** queue a task. set 'task_err' to the first error returned by a task. return true if queue is too long */
+    bool push(const fm_remove_task & task, int & task_err)
+    {
+        ft_mutex_guard guard(mutex);
+        tasks.push_back(task);
+        bytes += task.bytes;
+        task_err = err;
+        cond.signal();
+        return tasks.size() > FC_REMOVE_QUEUE_MAX;
+    }
+
+    /**
+     * get the oldest task and return true, or return false if queue is empty.
+     * if 'wait' is true, wait for new tasks until close() is called.
+     * before returning a directory, always wait until no task is running:
+     * files queued before it may be inside it, and still being removed by another thread
+     */
+    bool pop(fm_remove_task & task, bool wait)
+    {
+        ft_mutex_guard guard(mutex);
+        while (tasks.empty() || (tasks.front().is_dir && running != 0)) {
+            if (tasks.empty() && (!wait || closed))
+                return false;
+            cond.wait(mutex);
+        }
+        task = tasks.front();
+        tasks.pop_front();
+        running++;
+        return true;
+    }
+
+    /** called after a task returned by pop() finished */
+    void done(const fm_remove_task & task, int task_err)
+    {
+        ft_mutex_guard guard(mutex);
+        running--;
+        bytes -= task.bytes;
+        if (task_err != 0 && err == 0)
+            err = task_err;
+        cond.broadcast();
+    }
+
+    /** wait until no task is running. return the first error returned by a task */
+    int wait_idle()
+    {
+        ft_mutex_guard guard(mutex);
+        while (running != 0)
+            cond.wait(mutex);
+        return err;
+    }
+
+    /** no more tasks will be queued: wake up the waiting thread */
+    void close()
+    {
+        ft_mutex_guard guard(mutex);
+        closed = true;
+        cond.broadcast();
+    }
+
+    /** return true if no task is queued or running */
+    bool idle()
+    {
+        ft_mutex_guard guard(mutex);
+        return tasks.empty() && running == 0;
+    }
+
+    /** return the first error returned by a task */
+    int error()
+    {
+        ft_mutex_guard guard(mutex);
+        return err;
+    }
+
+    /** return the space released by queued and running tasks */
+    ft_uoff pending_bytes()
+    {
+        ft_mutex_guard guard(mutex);
+        return bytes;
+    }
+};
+
 /** core of recursive move algorithm, actually moves the whole source tree into target */
 int fm_io_posix::move()
 {
@@ -269,17 +504,418 @@ int fm_io_posix::move()
 
     int err = init_work();
     if (err == 0)
-        err = move(source_root(), target_root());
-    if (err == 0)
+        err = make_plan();
+    if (err == 0) {
+        /* source files and directories are removed by a second thread, off the critical path */
+        fm_remove_queue queue;
+        remove_queue = & queue;
+        err = ff_thread_run(2, move_thread, this);
+        remove_queue = NULL;
+    }
+    if (err == 0) {
     	ff_log(FC_NOTICE, 0, "job completed.");
+        report_loop_extents();
+    }
+    return err;
+}
+
+
+/** function executed by the two threads started by move(): thread 0 calls move_tree(), thread 1 remove_thread() */
+int fm_io_posix::move_thread(void * arg, ft_size thread_i)
+{
+    fm_io_posix & io = * (fm_io_posix *) arg;
+    return thread_i == 0 ? io.move_tree() : io.remove_thread();
+}
+
+/** move the whole source tree into target, sequentially or with move_parallel() */
+int fm_io_posix::move_tree()
+{
+    int err;
+    if (thread_n() > 1)
+        err = move_parallel();
+    else {
+        if (can_use_uring())
+            (void) open_uring(uring);
+        if ((err = move(AT_FDCWD, source_root(), AT_FDCWD, target_root())) == 0)
+            err = move_deferred(NULL);
+        uring.close();
+    }
+    /* nothing more will be queued: let remove_thread() finish */
+    remove_queue->close();
+    return err;
+}
+
+/**
+ * remove in background the source files and directories queued by remove_later(),
+ * until move_tree() finished and the queue is empty.
+ * if threads are not available, runs after move_tree() and empties the queue
+ */
+int fm_io_posix::remove_thread()
+{
+    fm_remove_task task;
+    while (remove_queue->pop(task, true))
+        remove_queue->done(task, remove_task(task));
+    return remove_queue->error();
+}
+
+/**
+ * queue source file or directory 'path' for removal by remove_thread().
+ * 'bytes' is the space its removal will release.
+ * if the queue is full, remove its oldest entry before returning.
+ * if no queue exists, remove 'path' immediately
+ */
+int fm_io_posix::remove_later(const ft_string & path, ft_uoff bytes, bool is_dir)
+{
+    fm_remove_task task = { path, bytes, is_dir };
+    if (remove_queue == NULL)
+        return remove_task(task);
+
+    /*
+     * only removing large files is slow enough to be worth queuing: the file system must free all their extents.
+     * directories are removed immediately too, unless some queued file may be inside them
+     */
+    int err;
+    if (is_dir ? remove_queue->idle() : bytes < fm_remove_queue::FC_REMOVE_LATER_MIN) {
+        if ((err = remove_task(task)) == 0)
+            err = remove_queue->error();
+        return err;
+    }
+    /* also stop moving as soon as some removal failed */
+    if (remove_queue->push(task, err) && remove_queue->pop(task, false))
+        remove_queue->done(task, remove_task(task));
+    return err;
+}
+
+/** remove a source file or directory queued by remove_later() */
+int fm_io_posix::remove_task(const fm_remove_task & task)
+{
+    return task.is_dir ? remove_dir(AT_FDCWD, task.path) : remove_file(AT_FDCWD, task.path.c_str());
+}
+
+/**
+ * remove all source files and directories queued by remove_later(),
+ * and wait until remove_thread() removed the one it is working on.
+ * called when free space is low: the space they use is not free yet
+ */
+int fm_io_posix::remove_pending()
+{
+    if (remove_queue == NULL)
+        return 0;
+    /* removing only directories and extra links would not release any significant space */
+    if (remove_queue->pending_bytes() == 0)
+        return remove_queue->error();
+
+    fm_remove_task task;
+    while (remove_queue->pop(task, false))
+        remove_queue->done(task, remove_task(task));
+    return remove_queue->wait_idle();
+}
+
+
+/**
+ * predict whether copy_stream() will copy forward a file of 'size' bytes,
+ * with the same rule as enough_free_space(), and add it to 'forward' if so.
+ * then update estimated free space: 'size' bytes are written to target,
+ * and unless 'shared' they are also released from source
+ */
+static void fm_io_posix_plan_step(ft_uoff size, ft_uoff & source_free, ft_uoff & target_free, bool shared,
+                                  ft_uoff & forward)
+{
+    if ((ff_min2(source_free, target_free) >> 1) > size)
+        forward += size;
+    target_free = target_free > size ? target_free - size : 0;
+    if (!shared)
+        source_free += size;
+}
+
+/**
+ * return the number of bytes copy_stream() is predicted to copy forward
+ * if files at least 'defer_min' large (0 means none) are postponed and moved smallest first.
+ * 'sizes' must list the files in move order, 'sorted' the same files sorted by size
+ */
+static ft_uoff fm_io_posix_plan_forward(const std::vector<ft_uoff> & sizes, const std::vector<ft_uoff> & sorted,
+                                        ft_uoff defer_min, ft_uoff source_free, ft_uoff target_free, bool shared)
+{
+    ft_uoff forward = 0;
+    std::vector<ft_uoff>::const_iterator iter = sizes.begin(), end = sizes.end();
+    for (; iter != end; ++iter)
+        if (defer_min == 0 || * iter < defer_min)
+            fm_io_posix_plan_step(* iter, source_free, target_free, shared, forward);
+
+    if (defer_min != 0) {
+        iter = std::lower_bound(sorted.begin(), sorted.end(), defer_min);
+        for (end = sorted.end(); iter != end; ++iter)
+            fm_io_posix_plan_step(* iter, source_free, target_free, shared, forward);
+    }
+    return forward;
+}
+
+/**
+ * scan source tree and predict how many bytes copy_stream() will copy forward
+ * and how many with the slower punch hole or backward copy, as free space evolves.
+ * if moving large files after all other files improves the prediction, set defer_min accordingly.
+ *
+ * the prediction is approximate: it ignores directories, special files and sparse files,
+ * and assumes source free space grows by the size of each moved file unless shares_free_space()
+ */
+int fm_io_posix::make_plan()
+{
+    defer_min = 0;
+    if (!plan())
+        return 0;
+
+    const ft_uoff source_free = source_stat().get_free(), target_free = target_stat().get_free();
+    if ((ff_min2(source_free, target_free) >> 1) > source_stat().get_used()) {
+        ff_log(FC_INFO, 0, "enough free space to copy all files forward, no need to plan");
+        return 0;
+    }
+
+    ff_log(FC_INFO, 0, "scanning %s to plan the move...", label[FC_SOURCE_ROOT]);
+
+    std::vector<ft_uoff> sizes;
+    std::set<ft_inode> links;
+    int err = plan_scan(AT_FDCWD, source_root(), sizes, links);
+    if (err != 0)
+        return err;
+
+    std::vector<ft_uoff> sorted(sizes);
+    std::sort(sorted.begin(), sorted.end());
+
+    const bool shared = shares_free_space();
+    ft_uoff total = 0;
+    for (ft_size i = 0, n = sizes.size(); i < n; i++)
+        total += sizes[i];
+
+    const ft_uoff unplanned = fm_io_posix_plan_forward(sizes, sorted, 0, source_free, target_free, shared);
+    ft_uoff best = unplanned;
+
+    /* try postponing files larger than each power of two, largest first: on ties, postpone fewer files */
+    std::vector<ft_uoff> candidates;
+    const ft_uoff max_size = sorted.empty() ? 0 : sorted.back();
+    for (ft_uoff candidate = PLAN_DEFER_MIN; candidate != 0 && candidate <= max_size; candidate <<= 1)
+        candidates.push_back(candidate);
+
+    while (!candidates.empty() && best < total) {
+        ft_uoff candidate = candidates.back(), forward;
+        candidates.pop_back();
+        if ((forward = fm_io_posix_plan_forward(sizes, sorted, candidate, source_free, target_free, shared)) > best) {
+            best = forward;
+            defer_min = candidate;
+        }
+    }
+
+    double forward_pretty = 0.0, slow_pretty = 0.0;
+    const char * forward_label = ff_pretty_size(best, & forward_pretty);
+    const char * slow_label = ff_pretty_size(total - best, & slow_pretty);
+    ff_log(FC_NOTICE, 0, "predicted: %.2f %sbytes copied forward, %.2f %sbytes copied with punch hole or backward copy%s",
+           forward_pretty, forward_label, slow_pretty, slow_label,
+           shared ? " (target is inside a loop-file inside source)" : "");
+
+    if (defer_min != 0) {
+        ft_size deferred_n = sorted.end() - std::lower_bound(sorted.begin(), sorted.end(), defer_min);
+        double defer_pretty = 0.0, gain_pretty = 0.0;
+        const char * defer_label = ff_pretty_size(defer_min, & defer_pretty);
+        const char * gain_label = ff_pretty_size(best - unplanned, & gain_pretty);
+        ff_log(FC_NOTICE, 0, "postponing %" FT_ULL " file%s at least %.2f %sbytes large, to copy forward %.2f %sbytes more",
+               (ft_ull) deferred_n, deferred_n == 1 ? "" : "s", defer_pretty, defer_label, gain_pretty, gain_label);
+    }
+    return err;
+}
+
+/**
+ * append to 'sizes' the length of each regular file inside source directory 'path', recursively,
+ * in the same order move() will find them. files with multiple links are appended only once.
+ * 'dir_fd' must be the descriptor of its parent directory, or AT_FDCWD
+ */
+int fm_io_posix::plan_scan(int dir_fd, const ft_string & path, std::vector<ft_uoff> & sizes, std::set<ft_inode> & links)
+{
+    ft_io_posix_dir dir;
+    ft_io_posix_dirent * dirent;
+    ft_stat stat;
+    int err;
+
+    if ((err = dir.open(dir_fd, at_name(dir_fd, path.c_str()), path)) != 0)
+        return err;
+
+    ft_string child = path;
+    child += '/';
+
+    while ((err = dir.next(dirent)) == 0 && dirent != NULL) {
+        /* skip "." and ".." */
+        if (!strcmp(".", dirent->d_name) || !strcmp("..", dirent->d_name))
+            continue;
+
+        child.resize(1 + path.size()); // faster than child = path + '/'
+        child += dirent->d_name;
+        if (exclude_set().count(child) != 0)
+            continue;
+#if defined(DT_REG) && defined(DT_DIR) && defined(DT_UNKNOWN)
+        /* only regular files and directories matter: skip fstatat() on anything else */
+        if (dirent->d_type != DT_REG && dirent->d_type != DT_DIR && dirent->d_type != DT_UNKNOWN)
+            continue;
+#endif
+        if ((err = this->stat(at_fd(dir), child, stat)) != 0)
+            break;
+
+        if (fm_io_posix_is_dir(stat)) {
+            if ((err = plan_scan(at_fd(dir), child, sizes, links)) != 0)
+                break;
+        } else if (fm_io_posix_is_file(stat) && (stat.st_nlink <= 1 || links.insert(stat.st_ino).second))
+            sizes.push_back((ft_uoff) stat.st_size);
+    }
+    return err;
+}
+
+/**
+ * return true if target file system is inside a loop-file inside source file system,
+ * i.e. removing source files does not increase the free space available for target.
+ * only implemented on Linux, elsewhere always returns false
+ */
+bool fm_io_posix::shares_free_space() const
+{
+    ft_string path;
+    ft_stat source_stat, backing_stat;
+    return loop_file(path) && ::stat(source_root().c_str(), & source_stat) == 0
+        && ::stat(path.c_str(), & backing_stat) == 0 && backing_stat.st_dev == source_stat.st_dev;
+}
+
+/**
+ * if target file system is inside a loop-file, store the loop-file path in 'path' and return true.
+ * only implemented on Linux, elsewhere always returns false
+ */
+bool fm_io_posix::loop_file(ft_string & path) const
+{
+#if defined(major) && defined(minor)
+    ft_stat target_stat;
+    if (::stat(target_root().c_str(), & target_stat) != 0)
+        return false;
+
+    char buf[PATH_MAX];
+    snprintf(buf, sizeof(buf), "/sys/dev/block/%u:%u/loop/backing_file",
+             (unsigned) major(target_stat.st_dev), (unsigned) minor(target_stat.st_dev));
+
+    FILE * f = fopen(buf, "r");
+    if (f == NULL)
+        return false;
+    bool found = fgets(buf, sizeof(buf), f) != NULL;
+    (void) fclose(f);
+    if (!found)
+        return false;
+
+    char * newline = strchr(buf, '\n');
+    if (newline != NULL)
+        * newline = '\0';
+    path = buf;
+    return !path.empty();
+#else
+    (void) path;
+    return false;
+#endif
+}
+
+/**
+ * if target file system is inside a loop-file, flush it and log how many extents the loop-file has:
+ * the fewer they are, the faster fsremap will be
+ */
+void fm_io_posix::report_loop_extents()
+{
+#if defined(FS_IOC_FIEMAP) && defined(FT_HAVE_LINUX_FIEMAP_H)
+    ft_string path;
+    if (simulate_run() || !loop_file(path))
+        return;
+
+    /* data written to target is not yet in the loop-file until flushed */
+    sync();
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return;
+
+    /* with fm_extent_count == 0, ioctl(FS_IOC_FIEMAP) only counts the extents */
+    struct fiemap k_map;
+    memset(& k_map, '\0', sizeof(k_map));
+    k_map.fm_length = ~(ft_u64)0;
+    k_map.fm_flags = FIEMAP_FLAG_SYNC;
+
+    int err = ::ioctl(fd, FS_IOC_FIEMAP, & k_map) != 0 ? errno : 0;
+    (void) ::close(fd);
+
+    if (err != 0)
+        ff_log(FC_DEBUG, err, "failed to count extents of loop-file `%s'", path.c_str());
+    else
+        ff_log(FC_NOTICE, 0, "loop-file `%s' has %" FT_ULL " extent%s%s", path.c_str(),
+               (ft_ull) k_map.fm_mapped_extents, k_map.fm_mapped_extents == 1 ? "" : "s",
+               fallocate_target() ? "" : ". use option '--fallocate' to reduce them");
+#endif
+}
+
+/**
+ * return the directory descriptor to pass to *at() functions for entries inside 'dir':
+ * dir.fd() if *at() functions are available, else AT_FDCWD
+ */
+int fm_io_posix::at_fd(const ft_io_posix_dir & dir)
+{
+#ifdef FT_IO_POSIX_AT
+    return dir.fd();
+#else
+    (void) dir;
+    return AT_FDCWD;
+#endif
+}
+
+/**
+ * return the name to pass to *at() functions together with 'dir_fd' to access 'path':
+ * its last component if dir_fd is the descriptor of its parent directory, else the whole path
+ */
+const char * fm_io_posix::at_name(int dir_fd, const char * path)
+{
+    if (dir_fd != AT_FDCWD) {
+        const char * slash = strrchr(path, '/');
+        if (slash != NULL)
+            return slash + 1;
+    }
+    return path;
+}
+
+/**
+ * open target directory 'path' and store its descriptor in 'fd', for use with *at() functions.
+ * 'dir_fd' must be the descriptor of its parent directory, or AT_FDCWD.
+ * if *at() functions are not available, sets 'fd' to AT_FDCWD.
+ * if simulate_run(), sets 'fd' to -1
+ */
+int fm_io_posix::open_target_dir(int dir_fd, const ft_string & path, int & fd)
+{
+    int err = 0;
+#ifdef FT_IO_POSIX_AT
+    fd = -1;
+    if (simulate_run())
+        return err;
+    /* target_root() is allowed to be a symbolic link, its subdirectories are not */
+    int flags = O_RDONLY | O_DIRECTORY | (dir_fd != AT_FDCWD ? O_NOFOLLOW : 0);
+    if ((fd = ::openat(dir_fd, at_name(dir_fd, path.c_str()), flags)) < 0)
+        err = ff_log(FC_ERROR, errno, "failed to open target directory `%s'", path.c_str());
+#else
+    (void) dir_fd;
+    (void) path;
+    fd = simulate_run() ? -1 : AT_FDCWD;
+#endif
     return err;
 }
 
+/** close a directory descriptor returned by open_target_dir() */
+void fm_io_posix::close_dir(int fd)
+{
+    if (fd >= 0)
+        (void) ::close(fd);
+}
 
 /**
- * move a single file/socket/special-device or a whole directory tree
+ * move a single file/socket/special-device or a whole directory tree.
+ * source_dir_fd and target_dir_fd must be the descriptors of their parent directories, or AT_FDCWD.
+ * if 'batch' is not NULL, a small regular file may be queued in it instead of being moved immediately
  */
-int fm_io_posix::move(const ft_string & source_path, const ft_string & target_path)
+int fm_io_posix::move(int source_dir_fd, const ft_string & source_path, int target_dir_fd, const ft_string & target_path,
+                      fm_small_batch * batch)
 {
     ft_stat stat;
     const std::set<ft_string> & exclude_set = this->exclude_set();
@@ -293,18 +929,19 @@ int fm_io_posix::move(const ft_string & source_path, const ft_string & target_pa
             break;
         }
 
-        if ((err = this->stat(source_path, stat)) != 0)
+        if ((err = this->stat(source_dir_fd, source_path, stat)) != 0)
             break;
 
         if (fm_io_posix_is_file(stat)) {
-            err = this->move_file(source_path, stat, target_path);
+            if (!defer_file(NULL, NULL, source_path, target_path, stat))
+                err = queue_small_file(batch, source_dir_fd, source_path, stat, target_dir_fd, target_path);
             break;
         } else if (!fm_io_posix_is_dir(stat)) {
-            err = this->move_special(source_path, stat, target_path);
+            err = this->move_special(source_dir_fd, source_path, stat, target_dir_fd, target_path);
             break;
         }
         ft_io_posix_dir source_dir;
-        if ((err = source_dir.open(source_path)))
+        if ((err = source_dir.open(source_dir_fd, at_name(source_dir_fd, source_path.c_str()), source_path)))
             break;
 
         /*
@@ -313,42 +950,61 @@ int fm_io_posix::move(const ft_string & source_path, const ft_string & target_pa
          *
          * Exception: we allow a 'lost+found' directory to exist inside target_root()
          */
-        if ((err = this->create_dir(target_path)) != 0)
+        if ((err = this->create_dir(target_dir_fd, target_path)) != 0)
             break;
 
 
         if ((err = this->periodic_check_free_space()) != 0)
             break;
 
-        ft_string child_source = source_path, child_target = target_path;
-        child_source += '/';
-        child_target += '/';
+        /* entries are accessed relative to source and target directories, without resolving their full paths */
+        int target_fd;
+        if ((err = this->open_target_dir(target_dir_fd, target_path, target_fd)) != 0)
+            break;
 
         ft_io_posix_dirent * dirent;
+        fm_move_name_vector names;
+        const ft_size window = order() == FC_ORDER_READDIR ? 1 : ORDER_WINDOW;
+        const ft_size deferred_n = deferred_files.size();
 
-        /* recurse on directory contents */
-        while ((err = source_dir.next(dirent)) == 0 && dirent != NULL) {
-            /* skip "." and ".." */
-            if (!strcmp(".", dirent->d_name) || !strcmp("..", dirent->d_name))
-                continue;
-
-            child_source.resize(1 + source_path.size()); // faster than child_source = source_path + '/'
-            child_source += dirent->d_name;
+        /* small files inside this directory are queued in 'files' and moved together */
+        fm_small_batch files = { & uring, at_fd(source_dir), target_fd, std::vector<fm_small_file>(), 0 };
+        fm_small_batch * small = uring.is_open() ? & files : NULL;
 
-            child_target.resize(1 + target_path.size()); // faster than child_target = target_path + '/'
-            child_target += dirent->d_name;
-
-            if ((err = this->move(child_source, child_target)) != 0)
+        /* recurse on directory contents, sorting up to 'window' entries at a time */
+        for (;;) {
+            if ((err = source_dir.next(dirent)) != 0)
+                break;
+            if (dirent != NULL) {
+                /* skip "." and ".." */
+                if (!strcmp(".", dirent->d_name) || !strcmp("..", dirent->d_name))
+                    continue;
+                names.push_back(fm_move_name(order_key(at_fd(source_dir), dirent), dirent->d_name));
+                if (names.size() < window)
+                    continue;
+            }
+            err = this->move_names(at_fd(source_dir), source_path, target_fd, target_path, names, small);
+            names.clear();
+            if (err != 0 || dirent == NULL)
                 break;
         }
+        if (err == 0 && small != NULL)
+            err = move_small_files(files);
+        close_dir(target_fd);
         if (err != 0)
             break;
-        if ((err = this->copy_stat(target_path.c_str(), stat)) != 0)
+        if (deferred_files.size() != deferred_n) {
+            /* some files inside this directory were postponed: finish it after moving them */
+            fm_move_deferred deferred = { source_path, target_path, stat, NULL };
+            deferred_dirs.push_back(deferred);
+            break;
+        }
+        if ((err = this->copy_stat(target_dir_fd, target_path.c_str(), stat)) != 0)
             break;
         /*
          * we do not delete 'lost+found' directory inside source_root()
          */
-        if ((err = this->remove_dir(source_path)) != 0)
+        if ((err = remove_later(source_path, 0, true)) != 0)
             break;
 
     } while (0);
@@ -356,68 +1012,662 @@ int fm_io_posix::move(const ft_string & source_path, const ft_string & target_pa
 }
 
 
+
 /**
- * fill 'stat' with information about the file/directory/special-device 'path'
+ * sort 'names' as specified by order(), then move them from source directory 'source_path'
+ * to target directory 'target_path'. source_dir_fd and target_dir_fd must be their descriptors.
+ * if 'batch' is not NULL, small regular files are queued in it
  */
-int fm_io_posix::stat(const ft_string & path, ft_stat & stat)
+int fm_io_posix::move_names(int source_dir_fd, const ft_string & source_path, int target_dir_fd, const ft_string & target_path,
+                            fm_move_name_vector & names, fm_small_batch * batch)
 {
-    const char * str = path.c_str();
+    ft_string child_source = source_path, child_target = target_path;
+    child_source += '/';
+    child_target += '/';
+
+    sort_names(names);
+
     int err = 0;
-    if (lstat(str, & stat) != 0)
-        err = ff_log(FC_ERROR, errno, "failed to lstat() `%s'", str);
+    for (ft_size i = 0, n = names.size(); err == 0 && i < n; i++) {
+        child_source.resize(1 + source_path.size()); // faster than child_source = source_path + '/'
+        child_source += names[i].second;
+
+        child_target.resize(1 + target_path.size()); // faster than child_target = target_path + '/'
+        child_target += names[i].second;
+
+        err = this->move(source_dir_fd, child_source, target_dir_fd, child_target, batch);
+    }
     return err;
 }
 
 /**
- * move the special-device 'source_path' to 'target_path'.
+ * sort 'names' as specified by order().
+ * hard links are recreated correctly in any order, and directories are finalized
+ * only after all their entries are moved, so sorting entries of a single directory is always safe
  */
-int fm_io_posix::move_special(const ft_string & source_path, const ft_stat & stat, const ft_string & target_path)
+void fm_io_posix::sort_names(fm_move_name_vector & names) const
 {
-    const char * source = source_path.c_str(), * target = target_path.c_str();
-    int err = 0;
-    ff_log(FC_TRACE, 0, "move_special() `%s'\t-> `%s'", source, target);
-
-    if (simulate_run())
-        return err;
+    if (order() != FC_ORDER_READDIR && names.size() > 1)
+        std::sort(names.begin(), names.end());
+}
 
-    do {
-        /* check inode_cache for hard links and recreate them */
-        err = this->hard_link(stat, target_path);
-        if (err == 0) {
-            /** hard link succeeded, no need to create the special-device */
-            err = this->periodic_check_free_space();
+/**
+ * return the key to sort directory entry 'dirent' by, as specified by order().
+ * dir_fd must be the descriptor of the source directory containing it
+ */
+ft_uoff fm_io_posix::order_key(int dir_fd, const ft_io_posix_dirent * dirent)
+{
+    ft_uoff key = 0;
+    switch (order()) {
+        case FC_ORDER_INODE:
+            key = (ft_uoff) dirent->d_ino;
+            break;
+        case FC_ORDER_PHYSICAL: {
+            /* only regular files have data to read: move everything else first, sorted by name */
+            bool check_type = true;
+#if defined(DT_REG) && defined(DT_UNKNOWN)
+            if (dirent->d_type != DT_REG && dirent->d_type != DT_UNKNOWN)
+                break;
+            check_type = dirent->d_type == DT_UNKNOWN;
+#endif
+            /* if FIEMAP is not supported, inode numbers approximate physical order on most file systems */
+            if (!physical_key(dir_fd, dirent->d_name, check_type, key) && fm_io_posix_flag_load(& fiemap_unsupported))
+                key = (ft_uoff) dirent->d_ino;
             break;
-        } else if (err == EAGAIN) {
-            /* no luck with inode_cache, proceed as usual */
-            err = 0;
-        } else {
-            /** hard link() failed */
-            return err;
         }
+        default:
+            break;
+    }
+    return key;
+}
 
-        /* found a special device */
-        if (S_ISCHR(stat.st_mode) || S_ISBLK(stat.st_mode) || S_ISSOCK(stat.st_mode)) {
-            if (mknod(target, (stat.st_mode | 0600) & ~0077, stat.st_rdev) != 0) {
-                if (!S_ISSOCK(stat.st_mode)) {
+/**
+ * set 'key' to the physical offset of the first extent of regular file 'name' inside directory 'dir_fd'.
+ * if check_type is true, first check that 'name' is actually a regular file.
+ * return false if it is not, if it has no extents or if ioctl(FS_IOC_FIEMAP) fails
+ */
+bool fm_io_posix::physical_key(int dir_fd, const char * name, bool check_type, ft_uoff & key)
+{
+#if defined(FT_IO_POSIX_AT) && defined(FS_IOC_FIEMAP) && defined(FT_HAVE_LINUX_FIEMAP_H)
+    if (fm_io_posix_flag_load(& fiemap_unsupported))
+        return false;
+
+    ft_stat stat;
+    /* do not open() special devices: it could have side effects */
+    if (check_type && (fstatat(dir_fd, name, & stat, AT_SYMLINK_NOFOLLOW) != 0 || !fm_io_posix_is_file(stat)))
+        return false;
+
+    int fd = ::openat(dir_fd, name, O_RDONLY|O_NOFOLLOW|O_NONBLOCK);
+    if (fd < 0)
+        return false;
+
+    /* room for struct fiemap followed by a single struct fiemap_extent */
+    ft_u64 buf[(sizeof(struct fiemap) + sizeof(struct fiemap_extent) + sizeof(ft_u64) - 1) / sizeof(ft_u64)];
+    struct fiemap * k_map = (struct fiemap *) buf;
+    memset(buf, '\0', sizeof(buf));
+    k_map->fm_length = ~(ft_u64)0;
+    k_map->fm_extent_count = 1;
+
+    int err = 0;
+    if (::ioctl(fd, FS_IOC_FIEMAP, k_map) != 0)
+        err = errno;
+    (void) ::close(fd);
+
+    if ((err == EOPNOTSUPP || err == ENOTTY) && !fm_io_posix_flag_load(& fiemap_unsupported)) {
+        fm_io_posix_flag_store(& fiemap_unsupported);
+        ff_log(FC_INFO, 0, "source file system does not support ioctl(FS_IOC_FIEMAP), sorting files by inode number instead");
+    }
+    if (err != 0 || k_map->fm_mapped_extents == 0)
+        return false;
+
+    key = (ft_uoff) k_map->fm_extents[0].fe_physical;
+    return true;
+#else
+    (void) dir_fd;
+    (void) name;
+    (void) check_type;
+    (void) key;
+    fm_io_posix_flag_store(& fiemap_unsupported);
+    return false;
+#endif
+}
+
+
+/** a source directory being moved by move_parallel() */
+struct fm_move_dir
+{
+    ft_string source_path, target_path;
+    ft_stat stat;
+    fm_move_dir * parent;
+    /** number of queued or running tasks on this directory, plus number of its subdirectories not yet finished */
+    ft_size pending;
+};
+
+/** a task executed by move_parallel() threads: scan a directory if 'names' is empty, else move the listed entries */
+struct fm_move_task
+{
+    fm_move_dir * dir;
+    fm_move_name_vector names;
+};
+
+/** state shared by all threads started by move_parallel() */
+struct fm_move_job
+{
+    enum {
+        /** move at most this number of directory entries per task */
+        FC_MOVE_BATCH = 256,
+        /** if a thread has at least this number of queued tasks, it moves entries directly instead of queuing them */
+        FC_MOVE_QUEUE_MAX = 64,
+    };
+
+    fm_io_posix * io;
+    ft_mutex mutex;
+    ft_cond cond;
+    /** one queue per thread: owner thread pops from the back, other threads steal from the front */
+    std::vector<std::deque<fm_move_task *> > queues;
+    /** all directories not yet finished, to delete them in case of errors */
+    std::set<fm_move_dir *> dirs;
+    /** one io_uring per thread to move small files, or empty if io_uring is not used */
+    std::vector<fm_uring *> rings;
+    ft_size running;
+    int err;
+
+    fm_move_job(fm_io_posix * my_io, ft_size thread_n)
+        : io(my_io), mutex(), cond(), queues(thread_n), dirs(), rings(), running(0), err(0)
+    { }
+
+    /** delete any remaining task, directory and io_uring */
+    ~fm_move_job()
+    {
+        for (ft_size i = 0; i < rings.size(); i++)
+            delete rings[i];
+        for (ft_size i = 0; i < queues.size(); i++) {
+            while (!queues[i].empty()) {
+                delete queues[i].back();
+                queues[i].pop_back();
+            }
+        }
+        std::set<fm_move_dir *>::iterator iter = dirs.begin(), end = dirs.end();
+        for (; iter != end; ++iter)
+            delete * iter;
+    }
+
+    /** create a new fm_move_dir. also increases parent->pending */
+    fm_move_dir * new_dir(fm_move_dir * parent, const ft_string & source_path, const ft_string & target_path,
+                          const ft_stat & stat)
+    {
+        fm_move_dir * dir = new fm_move_dir;
+        dir->source_path = source_path;
+        dir->target_path = target_path;
+        dir->stat = stat;
+        dir->parent = parent;
+        dir->pending = 0;
+
+        ft_mutex_guard guard(mutex);
+        if (parent != NULL)
+            parent->pending++;
+        dirs.insert(dir);
+        return dir;
+    }
+
+    /** return the io_uring of thread_i, or NULL if io_uring is not used */
+    fm_uring * ring(ft_size thread_i) const
+    {
+        return thread_i < rings.size() ? rings[thread_i] : NULL;
+    }
+
+    /** increase dir->pending: 'dir' will not be finished until a matching call to fm_io_posix::move_parallel_release() */
+    void hold(fm_move_dir * dir)
+    {
+        ft_mutex_guard guard(mutex);
+        dir->pending++;
+    }
+
+    /** queue a task for thread_i, and wake up a waiting thread to steal it */
+    void push(ft_size thread_i, fm_move_task * task)
+    {
+        ft_mutex_guard guard(mutex);
+        task->dir->pending++;
+        queues[thread_i].push_back(task);
+        cond.signal();
+    }
+
+    /** return the number of tasks queued for thread_i */
+    ft_size queue_size(ft_size thread_i)
+    {
+        ft_mutex_guard guard(mutex);
+        return queues[thread_i].size();
+    }
+
+    /**
+     * return next task for thread_i: the newest one from its own queue,
+     * else the oldest one from another thread's queue.
+     * if all queues are empty, wait until some running task queues more work.
+     * return NULL when all work is done or some thread failed
+     */
+    fm_move_task * pop(ft_size thread_i)
+    {
+        const ft_size n = queues.size();
+        fm_move_task * task = NULL;
+
+        ft_mutex_guard guard(mutex);
+        while (err == 0) {
+            if (!queues[thread_i].empty()) {
+                task = queues[thread_i].back();
+                queues[thread_i].pop_back();
+            } else {
+                for (ft_size i = 1; i < n; i++) {
+                    std::deque<fm_move_task *> & victim = queues[(thread_i + i) % n];
+                    if (!victim.empty()) {
+                        task = victim.front();
+                        victim.pop_front();
+                        break;
+                    }
+                }
+            }
+            if (task != NULL) {
+                running++;
+                break;
+            }
+            if (running == 0) {
+                /* no queued tasks, and no running tasks can queue new ones: we are done */
+                cond.broadcast();
+                break;
+            }
+            cond.wait(mutex);
+        }
+        return task;
+    }
+
+    /** called after a task returned by pop() finished. if it failed, tell all threads to stop */
+    void done(int task_err)
+    {
+        ft_mutex_guard guard(mutex);
+        running--;
+        if (task_err != 0 && err == 0)
+            err = task_err;
+        if (task_err != 0 || running == 0)
+            cond.broadcast();
+    }
+};
+
+
+/**
+ * move the whole source tree into target using thread_n() threads.
+ * each thread has its own queue of tasks (scan a directory or move some of its entries)
+ * and steals tasks from other threads' queues when its own queue is empty
+ */
+int fm_io_posix::move_parallel()
+{
+    const ft_size thread_n = this->thread_n();
+    fm_move_job job(this, thread_n);
+
+    ff_log(FC_INFO, 0, "moving files and directories using %" FT_ULL " threads", (ft_ull) thread_n);
+
+    /* each thread moves small files with its own io_uring: use it only if all threads can have one */
+    for (ft_size i = 0; can_use_uring() && i < thread_n; i++) {
+        fm_uring * ring = new fm_uring;
+        job.rings.push_back(ring);
+        if (!open_uring(* ring)) {
+            while (!job.rings.empty()) {
+                delete job.rings.back();
+                job.rings.pop_back();
+            }
+            break;
+        }
+    }
+
+    int err = move_parallel_entry(job, 0, NULL, AT_FDCWD, source_root(), AT_FDCWD, target_root());
+    if (err == 0)
+        err = ff_thread_run(thread_n, move_parallel_thread, & job);
+    if (err == 0)
+        err = job.err;
+    /* postponed files are moved by a single thread, smallest first, as planned by make_plan() */
+    if (err == 0)
+        err = move_deferred(& job);
+    return err;
+}
+
+/** function executed by each thread started by move_parallel() */
+int fm_io_posix::move_parallel_thread(void * arg, ft_size thread_i)
+{
+    fm_move_job & job = * (fm_move_job *) arg;
+    fm_io_posix & io = * job.io;
+    fm_move_task * task;
+    int err = 0;
+
+    while (err == 0 && (task = job.pop(thread_i)) != NULL) {
+        fm_move_dir * dir = task->dir;
+        if (task->names.empty())
+            err = io.move_parallel_scan(job, thread_i, * dir);
+        else
+            err = io.move_parallel_names(job, thread_i, * dir, task->names);
+        delete task;
+
+        if (err == 0)
+            err = io.move_parallel_release(job, dir);
+        job.done(err);
+    }
+    return err;
+}
+
+/**
+ * move a single file/socket/device, or queue a task to move a whole directory tree.
+ * called by move_parallel() and its threads. if 'batch' is not NULL, a small regular file may be queued in it
+ */
+int fm_io_posix::move_parallel_entry(fm_move_job & job, ft_size thread_i, fm_move_dir * parent,
+                                     int source_dir_fd, const ft_string & source_path,
+                                     int target_dir_fd, const ft_string & target_path, fm_small_batch * batch)
+{
+    ft_stat stat;
+    int err = 0;
+
+    ff_log(FC_DEBUG, 0, "`%s'\t-> `%s'", source_path.c_str(), target_path.c_str());
+
+    do {
+        if (exclude_set().count(source_path) != 0) {
+            ff_log(FC_INFO, 0, "skipped `%s', matches exclude list", source_path.c_str());
+            break;
+        }
+
+        if ((err = this->stat(source_dir_fd, source_path, stat)) != 0)
+            break;
+
+        if (fm_io_posix_is_file(stat)) {
+            if (!defer_file(& job, parent, source_path, target_path, stat))
+                err = queue_small_file(batch, source_dir_fd, source_path, stat, target_dir_fd, target_path);
+            break;
+        } else if (!fm_io_posix_is_dir(stat)) {
+            err = this->move_special(source_dir_fd, source_path, stat, target_dir_fd, target_path);
+            break;
+        }
+        fm_move_task * task = new fm_move_task;
+        task->dir = job.new_dir(parent, source_path, target_path, stat);
+        job.push(thread_i, task);
+
+    } while (0);
+    return err;
+}
+
+/**
+ * create target directory, then read source directory entries and queue tasks to move them.
+ * if our queue is already long, move the entries directly instead of queuing them
+ */
+int fm_io_posix::move_parallel_scan(fm_move_job & job, ft_size thread_i, fm_move_dir & dir)
+{
+    ft_io_posix_dir source_dir;
+    ft_io_posix_dirent * dirent;
+    fm_move_name_vector names;
+    int target_fd = -1;
+    int err;
+
+    do {
+        if ((err = source_dir.open(dir.source_path)))
+            break;
+
+        /*
+         * we allow target_root() to exist already, but other target directories must NOT exist.
+         * option '-f' drops this check, i.e. any target directory can exist already
+         *
+         * Exception: we allow a 'lost+found' directory to exist inside target_root()
+         */
+        if ((err = this->create_dir(AT_FDCWD, dir.target_path)) != 0)
+            break;
+
+        if ((err = this->periodic_check_free_space()) != 0)
+            break;
+
+        if ((err = this->open_target_dir(AT_FDCWD, dir.target_path, target_fd)) != 0)
+            break;
+
+        for (;;) {
+            if ((err = source_dir.next(dirent)) != 0)
+                break;
+            if (dirent != NULL) {
+                /* skip "." and ".." */
+                if (!strcmp(".", dirent->d_name) || !strcmp("..", dirent->d_name))
+                    continue;
+                names.push_back(fm_move_name(order_key(at_fd(source_dir), dirent), dirent->d_name));
+                if (names.size() < fm_move_job::FC_MOVE_BATCH)
+                    continue;
+            } else if (names.empty())
+                break;
+
+            if (job.queue_size(thread_i) >= fm_move_job::FC_MOVE_QUEUE_MAX) {
+                err = move_parallel_names(job, thread_i, dir, names, at_fd(source_dir), target_fd);
+                names.clear();
+            } else {
+                fm_move_task * task = new fm_move_task;
+                task->dir = & dir;
+                task->names.swap(names);
+                job.push(thread_i, task);
+            }
+            if (err != 0 || dirent == NULL)
+                break;
+        }
+    } while (0);
+    close_dir(target_fd);
+    return err;
+}
+
+/** open source and target directories of 'dir', then move some of its entries */
+int fm_io_posix::move_parallel_names(fm_move_job & job, ft_size thread_i, fm_move_dir & dir,
+                                     fm_move_name_vector & names)
+{
+    /* resolve the full paths of source and target directories once per batch, not once per entry */
+    ft_io_posix_dir source_dir;
+    int target_fd = -1;
+    int err;
+    if ((err = source_dir.open(dir.source_path)) == 0
+        && (err = open_target_dir(AT_FDCWD, dir.target_path, target_fd)) == 0)
+    {
+        err = move_parallel_names(job, thread_i, dir, names, at_fd(source_dir), target_fd);
+    }
+    close_dir(target_fd);
+    return err;
+}
+
+/**
+ * sort some entries of source directory 'dir' as specified by order(), then move them.
+ * source_dir_fd and target_dir_fd must be the descriptors of its source and target directories
+ */
+int fm_io_posix::move_parallel_names(fm_move_job & job, ft_size thread_i, fm_move_dir & dir,
+                                     fm_move_name_vector & names, int source_dir_fd, int target_dir_fd)
+{
+    ft_string child_source = dir.source_path, child_target = dir.target_path;
+    child_source += '/';
+    child_target += '/';
+
+    sort_names(names);
+
+    /* small files are queued in 'batch' and moved together */
+    fm_small_batch batch = { job.ring(thread_i), source_dir_fd, target_dir_fd, std::vector<fm_small_file>(), 0 };
+    fm_small_batch * small = batch.ring != NULL ? & batch : NULL;
+
+    int err = 0;
+    for (ft_size i = 0, n = names.size(); err == 0 && i < n; i++) {
+        child_source.resize(1 + dir.source_path.size()); // faster than child_source = source_path + '/'
+        child_source += names[i].second;
+
+        child_target.resize(1 + dir.target_path.size()); // faster than child_target = target_path + '/'
+        child_target += names[i].second;
+
+        err = move_parallel_entry(job, thread_i, & dir, source_dir_fd, child_source, target_dir_fd, child_target, small);
+    }
+    if (err == 0 && small != NULL)
+        err = move_small_files(batch);
+    return err;
+}
+
+/**
+ * called when a task on 'dir' finished: if it was the last pending work on 'dir',
+ * copy its stat to target directory, remove source directory and repeat on its parent
+ */
+int fm_io_posix::move_parallel_release(fm_move_job & job, fm_move_dir * dir)
+{
+    int err = 0;
+    while (err == 0 && dir != NULL) {
+        {
+            ft_mutex_guard guard(job.mutex);
+            if (--dir->pending != 0)
+                break;
+            job.dirs.erase(dir);
+        }
+        /* all entries inside 'dir' were moved: finish it */
+        if ((err = this->copy_stat(AT_FDCWD, dir->target_path.c_str(), dir->stat)) == 0)
+            /* we do not delete 'lost+found' directory inside source_root() */
+            err = remove_later(dir->source_path, 0, true);
+
+        fm_move_dir * parent = dir->parent;
+        delete dir;
+        dir = parent;
+    }
+    return err;
+}
+
+/**
+ * if make_plan() chose to postpone regular file 'source_path', add it to deferred_files and return true.
+ * 'dir' is the directory being moved by move_parallel() that contains it, or NULL
+ */
+bool fm_io_posix::defer_file(fm_move_job * job, fm_move_dir * dir, const ft_string & source_path,
+                             const ft_string & target_path, const ft_stat & stat)
+{
+    if (defer_min == 0 || (ft_uoff) stat.st_size < defer_min)
+        return false;
+
+    if (job != NULL && dir != NULL)
+        job->hold(dir);
+
+    fm_move_deferred deferred = { source_path, target_path, stat, dir };
+    ft_mutex_guard guard(defer_mutex);
+    deferred_files.push_back(deferred);
+    return true;
+}
+
+/** return true if 'a' is smaller than 'b' */
+static bool fm_io_posix_deferred_less(const fm_move_deferred & a, const fm_move_deferred & b)
+{
+    return a.stat.st_size < b.stat.st_size;
+}
+
+/**
+ * move the regular files postponed by defer_file(), smallest first,
+ * then finish the directories containing them
+ */
+int fm_io_posix::move_deferred(fm_move_job * job)
+{
+    const ft_size n = deferred_files.size();
+    int err = 0;
+
+    if (n != 0) {
+        ff_log(FC_INFO, 0, "moving %" FT_ULL " postponed large file%s", (ft_ull) n, n == 1 ? "" : "s");
+        std::stable_sort(deferred_files.begin(), deferred_files.end(), fm_io_posix_deferred_less);
+    }
+    for (ft_size i = 0; err == 0 && i < n; i++) {
+        fm_move_deferred & file = deferred_files[i];
+
+        ff_log(FC_DEBUG, 0, "`%s'\t-> `%s'", file.source_path.c_str(), file.target_path.c_str());
+
+        /* stat again: moving other links to the same inode changed st_nlink */
+        if ((err = this->stat(AT_FDCWD, file.source_path, file.stat)) != 0
+            || (err = this->move_file(AT_FDCWD, file.source_path, file.stat, AT_FDCWD, file.target_path)) != 0)
+            break;
+        if (job != NULL && file.dir != NULL)
+            err = move_parallel_release(* job, file.dir);
+    }
+    /* directories were added after their contents: finish them in the same order */
+    for (ft_size i = 0, dir_n = deferred_dirs.size(); err == 0 && i < dir_n; i++) {
+        const fm_move_deferred & dir = deferred_dirs[i];
+        if ((err = this->copy_stat(AT_FDCWD, dir.target_path.c_str(), dir.stat)) == 0)
+            /* we do not delete 'lost+found' directory inside source_root() */
+            err = remove_later(dir.source_path, 0, true);
+    }
+    deferred_files.clear();
+    deferred_dirs.clear();
+    return err;
+}
+
+
+/**
+ * fill 'stat' with information about the file/directory/special-device 'path'.
+ * 'dir_fd' must be the descriptor of its parent directory, or AT_FDCWD
+ */
+int fm_io_posix::stat(int dir_fd, const ft_string & path, ft_stat & stat)
+{
+    const char * str = path.c_str();
+    int err = 0;
+    if (fstatat(dir_fd, at_name(dir_fd, str), & stat, AT_SYMLINK_NOFOLLOW) != 0)
+        err = ff_log(FC_ERROR, errno, "failed to lstat() `%s'", str);
+    return err;
+}
+
+/**
+ * return the hard_link_mutex of 'inode'. all links to the same inode get the same one,
+ * while files with different inodes are usually moved concurrently
+ */
+ft_mutex & fm_io_posix::hard_link_mutex_of(ft_inode inode)
+{
+    ft_u64 h = (ft_u64)inode * (ft_u64)0x9E3779B97F4A7C15ULL;
+    return hard_link_mutex[(ft_size)(h >> 32) % HARD_LINK_MUTEX_N];
+}
+
+/**
+ * move the special-device 'source_path' to 'target_path'.
+ */
+int fm_io_posix::move_special(int source_dir_fd, const ft_string & source_path, const ft_stat & stat,
+                              int target_dir_fd, const ft_string & target_path)
+{
+    const char * source = source_path.c_str(), * target = target_path.c_str();
+    const char * source_name = at_name(source_dir_fd, source), * target_name = at_name(target_dir_fd, target);
+    int err = 0;
+    ff_log(FC_TRACE, 0, "move_special() `%s'\t-> `%s'", source, target);
+
+    if (simulate_run())
+        return err;
+
+    /* with multiple threads, another link to the same inode could be moved concurrently */
+    const bool multi_link = stat.st_nlink > 1;
+    if (multi_link)
+        hard_link_mutex_of(stat.st_ino).lock();
+
+    do {
+        /* check inode_cache for hard links and recreate them */
+        err = this->hard_link(stat, target_dir_fd, target_path);
+        if (err == 0) {
+            /** hard link succeeded, no need to create the special-device */
+            err = this->periodic_check_free_space();
+            break;
+        } else if (err == EAGAIN) {
+            /* no luck with inode_cache, proceed as usual */
+            err = 0;
+        } else {
+            /** hard link() failed */
+            break;
+        }
+
+        /* found a special device */
+        if (S_ISCHR(stat.st_mode) || S_ISBLK(stat.st_mode) || S_ISSOCK(stat.st_mode)) {
+            if (mknodat(target_dir_fd, target_name, (stat.st_mode | 0600) & ~0077, stat.st_rdev) != 0) {
+                if (!S_ISSOCK(stat.st_mode)) {
                     err = ff_log(FC_ERROR, errno, "failed to create target special device `%s'", target);
                     break;
                 }
                 ff_log(FC_WARN, errno, "failed to create target UNIX socket `%s'", target);
             }
         } else if (S_ISFIFO(stat.st_mode)) {
-            if (mkfifo(target, 0600) != 0) {
+            if (mkfifoat(target_dir_fd, target_name, 0600) != 0) {
                 err = ff_log(FC_ERROR, errno, "failed to create target named pipe `%s'", target);
                 break;
             }
         } else if (fm_io_posix_is_symlink(stat)) {
             char link_to[PATH_MAX+1];
-            ssize_t link_len = readlink(source, link_to, PATH_MAX);
+            ssize_t link_len = readlinkat(source_dir_fd, source_name, link_to, PATH_MAX);
             if (link_len == -1) {
                 err = ff_log(FC_ERROR, errno, "failed to read source symbolic link `%s'", source);
                 break;
             }
             link_to[link_len] = '\0';
-            if (symlink(link_to, target) != 0) {
+            if (symlinkat(link_to, target_dir_fd, target_name) != 0) {
                 err = ff_log(FC_ERROR, errno, "failed to create target symbolic link `%s'\t-> `%s'", target, link_to);
                 break;
             }
@@ -429,7 +1679,7 @@ int fm_io_posix::move_special(const ft_string & source_path, const ft_stat & sta
             break;
         }
 
-        if ((err = this->copy_stat(target, stat)) != 0)
+        if ((err = this->copy_stat(target_dir_fd, target, stat)) != 0)
             break;
 
         if ((err = this->periodic_check_free_space()) != 0)
@@ -437,8 +1687,11 @@ int fm_io_posix::move_special(const ft_string & source_path, const ft_stat & sta
 
     } while (0);
 
+    if (multi_link)
+        hard_link_mutex_of(stat.st_ino).unlock();
+
     if (err == 0)
-        err = remove_special(source);
+        err = remove_special(source_dir_fd, source);
 
     return err;
 }
@@ -446,10 +1699,10 @@ int fm_io_posix::move_special(const ft_string & source_path, const ft_stat & sta
 /**
  * remove the special file 'source_path'
  */
-int fm_io_posix::remove_special(const char * source_path)
+int fm_io_posix::remove_special(int dir_fd, const char * source_path)
 {
     int err = 0;
-    if (::remove(source_path) != 0)
+    if (::unlinkat(dir_fd, at_name(dir_fd, source_path), 0) != 0)
         err = ff_log(FC_ERROR, errno, "failed to remove source special device `%s'", source_path);
     return err;
 }
@@ -457,10 +1710,10 @@ int fm_io_posix::remove_special(const char * source_path)
 /**
  * remove the regular file 'source_path'
  */
-int fm_io_posix::remove_file(const char * source_path)
+int fm_io_posix::remove_file(int dir_fd, const char * source_path)
 {
     int err = 0;
-    if (::remove(source_path) != 0)
+    if (::unlinkat(dir_fd, at_name(dir_fd, source_path), 0) != 0)
         err = ff_log(FC_ERROR, errno, "failed to remove source file `%s'", source_path);
     return err;
 }
@@ -468,7 +1721,8 @@ int fm_io_posix::remove_file(const char * source_path)
 /**
  * move the regular file 'source_path' to 'target_path'.
  */
-int fm_io_posix::move_file(const ft_string & source_path, const ft_stat & stat, const ft_string & target_path)
+int fm_io_posix::move_file(int source_dir_fd, const ft_string & source_path, const ft_stat & stat,
+                           int target_dir_fd, const ft_string & target_path)
 {
     const char * source = source_path.c_str(), * target = target_path.c_str();
     int err = 0;
@@ -477,23 +1731,317 @@ int fm_io_posix::move_file(const ft_string & source_path, const ft_stat & stat,
     if (simulate_run())
         return err;
 
+    /*
+     * with multiple threads, another link to the same inode could be moved concurrently:
+     * it must not find this inode in inode_cache before target file is fully created
+     */
+    const bool multi_link = stat.st_nlink > 1;
+    if (multi_link)
+        hard_link_mutex_of(stat.st_ino).lock();
+
     /* check inode_cache for hard links and recreate them */
-    err = this->hard_link(stat, target_path);
+    err = this->hard_link(stat, target_dir_fd, target_path);
     if (err == 0) {
         /** hard link succeeded, no need to copy the file contents */
         err = this->periodic_check_free_space();
-        goto move_file_remove_source;
-    } else if (err != EAGAIN) {
-        /** hard link failed */
+    } else if (err == EAGAIN) {
+        /* no luck with inode_cache, proceed as usual */
+        err = copy_file_contents(source_dir_fd, source_path, stat, target_dir_fd, target_path);
+    }
+    /* else hard link failed */
+
+    if (multi_link)
+        hard_link_mutex_of(stat.st_ino).unlock();
+
+    if (err == 0)
+        err = remove_later(source_path, fm_io_posix_released_bytes(stat), false);
+    return err;
+}
+
+
+/** return true if small files can be moved in batches by move_small_files(), i.e. if io_uring() is set */
+bool fm_io_posix::can_use_uring() const
+{
+    return io_uring() && !simulate_run() && !fm_io_posix_flag_load(& uring_unsupported);
+}
+
+/**
+ * open 'ring' to move small files with io_uring.
+ * if io_uring is not available, log it only the first time and return false
+ */
+bool fm_io_posix::open_uring(fm_uring & ring)
+{
+    if (fm_io_posix_flag_load(& uring_unsupported))
+        return false;
+
+    /* each file needs up to 4 requests and 2 direct descriptors, and at most SMALL_FILE_MAX bytes of buffer */
+    int err = ring.open(4 * SMALL_BATCH_MAX, 2 * SMALL_BATCH_MAX, (ft_size) SMALL_FILE_MAX * SMALL_BATCH_MAX);
+    if (err != 0) {
+        ff_log(FC_INFO, err, "io_uring not available, moving small files with normal system calls");
+        fm_io_posix_flag_store(& uring_unsupported);
+    }
+    return err == 0;
+}
+
+/**
+ * if 'batch' is not NULL and regular file 'source_path' is small, queue it in 'batch'
+ * and call move_small_files() when batch is full. else move it immediately with move_file()
+ */
+int fm_io_posix::queue_small_file(fm_small_batch * batch, int source_dir_fd, const ft_string & source_path,
+                                  const ft_stat & stat, int target_dir_fd, const ft_string & target_path)
+{
+    /* files with multiple links need hard_link_mutex, and sparse files need copy_stream() to keep their holes */
+    if (batch == NULL || stat.st_nlink != 1 || (ft_uoff) stat.st_size > SMALL_FILE_MAX
+        || (ft_uoff) stat.st_blocks * 512 < (ft_uoff) stat.st_size)
+    {
+        return this->move_file(source_dir_fd, source_path, stat, target_dir_fd, target_path);
+    }
+    ff_log(FC_TRACE, 0, "move_file()    `%s'\t-> `%s'", source_path.c_str(), target_path.c_str());
+
+    /* a single link can still be the last link of an inode already moved: check inode_cache as move_file() does */
+    int err = this->hard_link(stat, target_dir_fd, target_path);
+    if (err != EAGAIN) {
+        if (err == 0 && (err = this->periodic_check_free_space()) == 0)
+            err = remove_later(source_path, fm_io_posix_released_bytes(stat), false);
         return err;
     }
+    fm_small_file file = { source_path, target_path, stat, 0, false };
+    batch->files.push_back(file);
+    batch->bytes += (ft_uoff) stat.st_size;
 
-    /* no luck with inode_cache, proceed as usual */
-    err = copy_file_contents(source_path, stat, target_path);
+    return batch->files.size() < SMALL_BATCH_MAX ? 0 : move_small_files(* batch);
+}
 
-move_file_remove_source:
+/**
+ * move all the small files queued in 'batch': copy their contents with copy_small_files(),
+ * copy their stat, then remove them with remove_small_files().
+ * files that cannot be copied this way are moved with move_file()
+ */
+int fm_io_posix::move_small_files(fm_small_batch & batch)
+{
+    std::vector<fm_small_file> & files = batch.files;
+    const ft_size n = files.size();
+    if (n == 0)
+        return 0;
+
+    /* also removes the source files queued by remove_later() if free space is low */
+    int err = periodic_check_free_space(0, batch.bytes);
+    if (err != 0)
+        return err;
+
+    bool fast = batch.ring->is_open();
+    if (fast) {
+        /* same rule as copy_stream(): if free space is low, move each file with the slower but safer methods */
+        ft_mutex_guard guard(free_space_mutex);
+        if ((fast = enough_free_space(batch.bytes + bytes_in_flight)))
+            bytes_in_flight += batch.bytes;
+    }
+    if (fast) {
+        copy_small_files(batch);
+
+        ft_mutex_guard guard(free_space_mutex);
+        bytes_in_flight -= batch.bytes;
+    }
+
+    std::vector<ft_size> index;
+    ft_uoff bytes = 0;
+    for (ft_size i = 0; err == 0 && i < n; i++) {
+        fm_small_file & file = files[i];
+        const char * target = file.target_path.c_str();
+
+        if (fast && file.err == 0) {
+            if ((err = this->copy_stat(batch.target_dir_fd, target, file.stat)) == 0) {
+                index.push_back(i);
+                bytes += (ft_uoff) file.stat.st_size;
+            }
+            continue;
+        }
+        if (fast) {
+            ff_log(FC_DEBUG, file.err, "io_uring failed to copy file `%s', retrying with normal system calls", target);
+            if (file.created && ::unlinkat(batch.target_dir_fd, at_name(batch.target_dir_fd, target), 0) != 0) {
+                err = ff_log(FC_ERROR, errno, "failed to remove target file `%s'", target);
+                break;
+            }
+        }
+        err = this->move_file(batch.source_dir_fd, file.source_path, file.stat, batch.target_dir_fd, file.target_path);
+    }
+    if (err == 0 && !index.empty()
+        && (err = periodic_check_free_space(bytes + (ft_uoff) index.size() * APPROX_INODE_COST)) == 0)
+    {
+        err = remove_small_files(batch, index);
+    }
+    files.clear();
+    batch.bytes = 0;
+    return err;
+}
+
+enum {
+    /* low bits of io_uring user_data set by copy_small_files(): which request of the chain completed */
+    FC_SMALL_OPEN_SOURCE = 0, FC_SMALL_OPEN_TARGET = 1, FC_SMALL_READ = 2, FC_SMALL_WRITE = 3,
+    FC_SMALL_SHIFT = 2,
+};
+
+/**
+ * copy the contents of all files in 'batch' with a single io_uring submission:
+ * for each file, a linked chain of open source, create target, read and write.
+ * sets the 'err' and 'created' fields of each file
+ */
+void fm_io_posix::copy_small_files(fm_small_batch & batch)
+{
+    std::vector<fm_small_file> & files = batch.files;
+    const ft_size n = files.size();
+    fm_uring & ring = * batch.ring;
+#ifdef FT_IO_URING
+    char * buf = ring.buf();
+    unsigned sqe_n = 0;
+
+    for (ft_size i = 0; i < n; i++) {
+        fm_small_file & file = files[i];
+        const ft_u64 id = (ft_u64) i << FC_SMALL_SHIFT;
+        const unsigned len = (unsigned) file.stat.st_size;
+        struct io_uring_sqe * sqe;
+        file.err = 0;
+        file.created = false;
+
+        /*
+         * file i uses direct descriptors 2*i and 2*i+1, created by IORING_OP_OPENAT
+         * into slot file_index - 1. each request runs only if the previous one in the chain succeeded
+         */
+        sqe = ring.get_sqe();
+        sqe->opcode = IORING_OP_OPENAT;
+        sqe->flags = IOSQE_IO_LINK;
+        sqe->fd = batch.source_dir_fd;
+        sqe->addr = (ft_u64) (unsigned long) at_name(batch.source_dir_fd, file.source_path.c_str());
+        sqe->open_flags = O_RDONLY|O_NOFOLLOW;
+        sqe->file_index = 2 * i + 1;
+        sqe->user_data = id | FC_SMALL_OPEN_SOURCE;
+
+        sqe = ring.get_sqe();
+        sqe->opcode = IORING_OP_OPENAT;
+        sqe->flags = len != 0 ? IOSQE_IO_LINK : 0;
+        sqe->fd = batch.target_dir_fd;
+        sqe->addr = (ft_u64) (unsigned long) at_name(batch.target_dir_fd, file.target_path.c_str());
+        sqe->open_flags = O_CREAT|O_WRONLY|O_TRUNC|O_EXCL|O_NOFOLLOW;
+        sqe->len = 0600;
+        sqe->file_index = 2 * i + 2;
+        sqe->user_data = id | FC_SMALL_OPEN_TARGET;
+        sqe_n += 2;
+
+        if (len == 0)
+            continue;
+
+        /* a short read or write also breaks the chain */
+        sqe = ring.get_sqe();
+        sqe->opcode = IORING_OP_READ;
+        sqe->flags = IOSQE_FIXED_FILE|IOSQE_IO_LINK;
+        sqe->fd = 2 * i;
+        sqe->addr = (ft_u64) (unsigned long) buf;
+        sqe->len = len;
+        sqe->user_data = id | FC_SMALL_READ;
+
+        sqe = ring.get_sqe();
+        sqe->opcode = IORING_OP_WRITE;
+        sqe->flags = IOSQE_FIXED_FILE;
+        sqe->fd = 2 * i + 1;
+        sqe->addr = (ft_u64) (unsigned long) buf;
+        sqe->len = len;
+        sqe->user_data = id | FC_SMALL_WRITE;
+        sqe_n += 2;
+
+        buf += len;
+    }
+
+    int err = ring.submit(sqe_n);
+
+    /*
+     * a file was copied only if the last request of its chain completed:
+     * requests after a failed one still complete, with ECANCELED
+     */
+    std::vector<bool> done(n, false);
+    ft_u64 user_data;
+    int res;
+    unsigned cqe_n = 0;
+    for (; cqe_n < sqe_n && ring.next_cqe(user_data, res); cqe_n++) {
+        const ft_size i = (ft_size) (user_data >> FC_SMALL_SHIFT);
+        fm_small_file & file = files[i];
+        const unsigned step = (unsigned) user_data & ((1 << FC_SMALL_SHIFT) - 1);
+
+        if (step == FC_SMALL_WRITE || (step == FC_SMALL_OPEN_TARGET && file.stat.st_size == 0))
+            done[i] = true;
+
+        if (step == FC_SMALL_OPEN_TARGET && res >= 0)
+            file.created = true;
+        else if (res < 0 || (step >= FC_SMALL_READ && res != (int) file.stat.st_size)) {
+            /* keep the original error, not the ECANCELED of the following requests */
+            if (file.err == 0 || file.err == ECANCELED)
+                file.err = res < 0 ? -res : EIO;
+        }
+    }
+    for (ft_size i = 0; i < n; i++) {
+        /* never treat as copied (and later remove the source of) a file whose chain did not complete */
+        if (!done[i] && files[i].err == 0)
+            files[i].err = EIO;
+    }
+    if (err == 0 && cqe_n < sqe_n)
+        err = EIO;
     if (err == 0)
-        err = remove_file(source);
+        err = ring.close_files();
+    if (err != 0) {
+        /* some requests may be still pending: stop using this io_uring */
+        ff_log(FC_DEBUG, err, "io_uring failed, moving small files with normal system calls");
+        ring.close();
+        for (ft_size i = 0; i < n; i++)
+            if (files[i].err == 0)
+                files[i].err = err;
+    }
+#else
+    for (ft_size i = 0; i < n; i++) {
+        files[i].err = ENOSYS;
+        files[i].created = false;
+    }
+    (void) ring;
+#endif /* FT_IO_URING */
+}
+
+/** remove the source files listed in 'index' with a single io_uring submission */
+int fm_io_posix::remove_small_files(fm_small_batch & batch, const std::vector<ft_size> & index)
+{
+    const ft_size n = index.size();
+    fm_uring & ring = * batch.ring;
+    int err = 0;
+#ifdef FT_IO_URING
+    if (ring.is_open()) {
+        for (ft_size i = 0; i < n; i++) {
+            struct io_uring_sqe * sqe = ring.get_sqe();
+            sqe->opcode = IORING_OP_UNLINKAT;
+            sqe->fd = batch.source_dir_fd;
+            sqe->addr = (ft_u64) (unsigned long) at_name(batch.source_dir_fd, batch.files[index[i]].source_path.c_str());
+            sqe->user_data = index[i];
+        }
+        if ((err = ring.submit((unsigned) n)) != 0) {
+            ring.close();
+            return ff_log(FC_ERROR, err, "failed to remove source files with io_uring");
+        }
+        /* reap exactly n completions, otherwise the missing ones would be read by the next batch */
+        ft_u64 user_data;
+        int res;
+        ft_size i = 0;
+        for (; i < n && ring.next_cqe(user_data, res); i++) {
+            if (res < 0 && err == 0)
+                err = ff_log(FC_ERROR, -res, "failed to remove source file `%s'",
+                             batch.files[user_data].source_path.c_str());
+        }
+        if (i < n) {
+            ring.close();
+            if (err == 0)
+                err = ff_log(FC_ERROR, EIO, "io_uring returned only %" FT_ULL " of %" FT_ULL " completions while removing source files",
+                             (ft_ull) i, (ft_ull) n);
+        }
+        return err;
+    }
+#endif /* FT_IO_URING */
+    for (ft_size i = 0; err == 0 && i < n; i++)
+        err = remove_file(batch.source_dir_fd, batch.files[index[i]].source_path.c_str());
     return err;
 }
 
@@ -501,19 +2049,20 @@ move_file_remove_source:
 /**
  * copy the contents of regular file 'source_path' to 'target_path'.
  */
-int fm_io_posix::copy_file_contents(const ft_string & source_path, const ft_stat & stat, const ft_string & target_path)
+int fm_io_posix::copy_file_contents(int source_dir_fd, const ft_string & source_path, const ft_stat & stat,
+                                    int target_dir_fd, const ft_string & target_path)
 {
     const char * source = source_path.c_str(), * target = target_path.c_str();
     int err = 0;
 
-    int in_fd = ::open(source, O_RDWR);
+    int in_fd = ::openat(source_dir_fd, at_name(source_dir_fd, source), O_RDWR);
     if (in_fd < 0)
         err = ff_log(FC_ERROR, errno, "failed to open source file `%s'", source);
 
 #ifndef O_EXCL
 # define O_EXCL 0
 #endif
-    int out_fd = ::open(target, O_CREAT|O_WRONLY|O_TRUNC|O_EXCL, 0600);
+    int out_fd = ::openat(target_dir_fd, at_name(target_dir_fd, target), O_CREAT|O_WRONLY|O_TRUNC|O_EXCL, 0600);
     if (out_fd < 0)
         err = ff_log(FC_ERROR, errno, "failed to create target file `%s'", target);
 
@@ -528,7 +2077,7 @@ int fm_io_posix::copy_file_contents(const ft_string & source_path, const ft_stat
         (void) ::close(out_fd);
 
     if (err == 0)
-        err = this->copy_stat(target, stat);
+        err = this->copy_stat(target_dir_fd, target, stat);
 
     return err;
 }
@@ -560,7 +2109,7 @@ int fm_io_posix::move_rename(const char * source, const char * target)
  *
  * returns EAGAIN if inode *was* not in inode_cache
  */
-int fm_io_posix::hard_link(const ft_stat & stat, const ft_string & target_path)
+int fm_io_posix::hard_link(const ft_stat & stat, int target_dir_fd, const ft_string & target_path)
 {
     ft_string cached_link = target_path;
     int err;
@@ -592,7 +2141,7 @@ int fm_io_posix::hard_link(const ft_stat & stat, const ft_string & target_path)
     else if (err == 1) {
     	// inode found in cache
         const char * link_to = cached_link.c_str(), * link_from = target_path.c_str();
-        if (::link(link_to, link_from) != 0)
+        if (::linkat(AT_FDCWD, link_to, target_dir_fd, at_name(target_dir_fd, link_from), 0) != 0)
             err = ff_log(FC_ERROR, errno, "failed to create target hard link `%s'\t-> `%s'", link_from, link_to);
         else
         	err = 0;
@@ -609,13 +2158,32 @@ enum {
 
     FT_BUFSIZE_m1 = FT_BUFSIZE - 1,
 
-    FT_BUFSIZE_SANITY_CHECK = sizeof(char[FT_BUFSIZE * 3 / 2 >= fm_disk_stat::THRESHOLD_MIN ? 1 : -1])
+    FT_BUFSIZE_SANITY_CHECK = sizeof(char[FT_BUFSIZE * 3 / 2 >= fm_disk_stat::THRESHOLD_MIN ? 1 : -1]),
+
+    // copy_stream_kernel() copies at most this number of bytes per system call
+    FT_KERNEL_COPY_CHUNK = (ft_size)1 << 22,
+
+    // copy_stream_punch() copies and releases at most this number of bytes at once
+    FT_PUNCH_CHUNK_MAX = (ft_size)1 << 24,
+
+    // copy_stream_forward() starts write-back after copying this number of bytes
+    FT_WRITEBACK_CHUNK = (ft_size)1 << 23,
+
+    // alignment of buffers returned by alloc_direct_buffer(), large enough for O_DIRECT on most devices
+    FT_DIRECT_ALIGN = (ft_size)1 << 12,
+
+    // with copy_thread_n() > 1, copy_stream_forward() copies files at least this large with copy_stream_parallel()
+    FT_PARALLEL_COPY_MIN = (ft_size)1 << 25,
+
+    // copy_stream_parallel() splits files into ranges of this length
+    FT_PARALLEL_CHUNK = (ft_size)1 << 24,
 };
 
 /**
  * forward or backward copy file/stream contents from in_fd to out_fd.
  *
- * if disk space is low, we copy backward and progressively truncate in_fd to conserve space:
+ * if disk space is low, we copy forward and progressively punch holes in in_fd to conserve space.
+ * if punching holes is not supported, we copy backward and progressively truncate in_fd:
  * results in heavy fragmentation on target file, but at least we can continue
  */
 int fm_io_posix::copy_stream(int in_fd, int out_fd, const ft_stat & stat, const char * source, const char * target)
@@ -626,16 +2194,128 @@ int fm_io_posix::copy_stream(int in_fd, int out_fd, const ft_stat & stat, const
     if ((err = periodic_check_free_space(0, file_size)) != 0)
         return err;
 
-    if (enough_free_space(file_size)) {
+    bool forward;
+    {
+        /* also account for files that other threads are copying forward right now */
+        ft_mutex_guard guard(free_space_mutex);
+        if ((forward = enough_free_space((ft_uoff) file_size + bytes_in_flight)))
+            bytes_in_flight += (ft_uoff) file_size;
+    }
+    if (forward) {
         /* enough free space, use normal forward copy */
-        return copy_stream_forward(in_fd, out_fd, source, target);
+        err = copy_stream_forward(in_fd, out_fd, stat, source, target);
+
+        ft_mutex_guard guard(free_space_mutex);
+        bytes_in_flight -= (ft_uoff) file_size;
+        return err;
     }
 
-    /* not enough free space, use backward copy + progressively truncate source file */
+    /* holes in source file need no copying: skip them */
+    ft_segment_vector segments;
+    bool exact;
+    if ((err = data_segments(in_fd, file_size, segments, exact, source)) != 0)
+        return err;
+
     double pretty_size = 0.0;
     const char * pretty_label = ff_pretty_size((ft_uoff) file_size, & pretty_size);
+
+    if (fd_can_punch_hole(in_fd, file_size)) {
+        /* not enough free space, use forward copy + progressively punch holes in source file */
+        ff_log(FC_INFO, 0, "using forward copy and punch hole for file `%s': less than %.2f %sbytes free space left",
+               target, pretty_size, pretty_label);
+        return copy_stream_punch(in_fd, out_fd, segments, file_size, source, target);
+    }
+
+    /* not enough free space, and cannot punch holes: use backward copy + progressively truncate source file */
     ff_log(FC_INFO, 0, "using backward copy and truncate for file `%s': less than %.2f %sbytes free space left",
            target, pretty_size, pretty_label);
+    return copy_stream_backward(in_fd, out_fd, segments, file_size, source, target);
+}
+
+
+/**
+ * forward copy file contents from in_fd to out_fd in large chunks, skipping holes.
+ * after each chunk is safely written to out_fd, punch a hole in in_fd to release the space it used.
+ * used when free space is low: reads and writes are sequential, unlike copy_stream_backward()
+ */
+int fm_io_posix::copy_stream_punch(int in_fd, int out_fd, const ft_segment_vector & segments, ft_off file_size,
+                                   const char * source, const char * target)
+{
+    /* everything before offset_done is in out_fd, and was released from in_fd */
+    ft_off offset_done = 0;
+    int err;
+
+    if ((err = fd_truncate(out_fd, file_size, target)) != 0)
+        return err;
+
+    for (ft_size i = 0, n = segments.size(); err == 0 && i < n; i++) {
+        const ft_segment & segment = segments[i];
+        ft_off offset = segment.first;
+
+        while (offset < segment.second) {
+            ft_off chunk_len = ff_min2<ft_off>(punch_chunk_length(), segment.second - offset);
+            ft_uoff length = (ft_uoff) chunk_len;
+
+            if ((err = fd_seek2(in_fd, out_fd, offset, source, target)) != 0
+                || (err = copy_stream_user(in_fd, out_fd, length, source, target)) != 0)
+                break;
+            if (length != 0) {
+                err = ff_log(FC_ERROR, EIO, "error reading from `%s': unexpected end-of-file at %" FT_ULL " bytes",
+                             source, (ft_ull)(offset + chunk_len - (ft_off) length));
+                break;
+            }
+            /* data must be on disk before we release it from source file */
+            if ((err = fd_sync(out_fd, target)) != 0
+                || (err = fd_punch_hole(in_fd, offset, chunk_len, source)) != 0)
+                break;
+
+            offset_done = offset += chunk_len;
+        }
+    }
+    if (err != 0 && offset_done != 0) {
+        ff_log(FC_ERROR, 0, "DANGER! due to previous error, copying `%s' -> `%s' was aborted", source, target);
+        ff_log(FC_ERROR, 0, "        and BOTH copies of this file are now incomplete.");
+        ff_log(FC_ERROR, 0, "        To recover this file, execute the following command");
+        ff_log(FC_ERROR, 0, "        AFTER freeing enough space in the target device:");
+
+        /* data segments may start at offsets not aligned to FT_BUFSIZE */
+        ft_size block_size = FT_BUFSIZE;
+        while (offset_done % block_size != 0)
+            block_size >>= 1;
+        offset_done /= block_size;
+        ff_log(FC_ERROR, 0, "          /bin/dd bs=%" FT_ULL " skip=%" FT_ULL " seek=%" FT_ULL " conv=notrunc if=\"%s\" of=\"%s\"",
+                (ft_ull)block_size, (ft_ull)offset_done, (ft_ull)offset_done, source, target);
+        ff_log(FC_ERROR, 0, "        then use `%s' as the recovered file.", target);
+    }
+    return err;
+}
+
+/**
+ * return the length of next chunk to copy in copy_stream_punch():
+ * one quarter of the current free space, rounded down to FT_BUFSIZE,
+ * but at least FT_BUFSIZE and at most FT_PUNCH_CHUNK_MAX
+ */
+ft_off fm_io_posix::punch_chunk_length()
+{
+    ft_uoff free_space;
+    {
+        ft_mutex_guard guard(free_space_mutex);
+        free_space = ff_min2(source_stat().get_free(), target_stat().get_free());
+    }
+    ft_uoff chunk_len = ff_min2<ft_uoff>(free_space >> 2, FT_PUNCH_CHUNK_MAX) & ~(ft_uoff)FT_BUFSIZE_m1;
+    return (ft_off) ff_max2<ft_uoff>(chunk_len, FT_BUFSIZE);
+}
+
+/**
+ * backward copy file contents from in_fd to out_fd in small chunks, skipping holes,
+ * and progressively truncate in_fd to release the space used by data already copied.
+ * used when free space is low and copy_stream_punch() is not supported.
+ * results in heavy fragmentation on target file, but at least we can continue
+ */
+int fm_io_posix::copy_stream_backward(int in_fd, int out_fd, ft_segment_vector & segments, ft_off file_size,
+                                      const char * source, const char * target)
+{
+    int err;
 
     if (::lseek(in_fd, 0, SEEK_END) != file_size)
         return ff_log(FC_ERROR, errno, "error seeking to end of file `%s'", source);
@@ -645,21 +2325,36 @@ int fm_io_posix::copy_stream(int in_fd, int out_fd, const ft_stat & stat, const
     if ((err = fd_truncate(out_fd, offset_high, target)) != 0)
         return err;
 
-    // slow, but on Linux not doing it is worse:
+    // on Linux, not flushing when close to full is worse:
     // you can get inaccurate disk usage statistics
     // and (if loop device becomes full) silent I/O errors!
-    sync();
+    {
+        ft_mutex_guard guard(free_space_mutex);
+        sync_if_needed();
+    }
 
     char buf[FT_BUFSIZE];
 
     ft_size expected, got;
     ft_size hole_len, nonhole_len, tosend_offset, tosend_left;
     while (offset_high > 0) {
+        if (segments.empty()) {
+            /* only a hole is left at the beginning of source file */
+            offset_high = 0;
+            break;
+        }
+        const ft_segment & segment = segments.back();
+        /* skip the hole between this data segment and the previous one */
+        if (offset_high > segment.second)
+            offset_high = segment.second;
+
         /** truncate in_fd, discarding any data that we already copied */
         if ((err = fd_truncate(in_fd, offset_high, source)) != 0)
             break;
 
-        offset_low = (offset_high - 1) & ~(ft_off)FT_BUFSIZE_m1;
+        offset_low = ff_max2(segment.first, (offset_high - 1) & ~(ft_off)FT_BUFSIZE_m1);
+        if (offset_low == segment.first)
+            segments.pop_back();
         ff_assert(offset_high - offset_low <= FT_BUFSIZE);
         got = expected = (ft_size)(offset_high - offset_low);
 
@@ -692,42 +2387,202 @@ int fm_io_posix::copy_stream(int in_fd, int out_fd, const ft_stat & stat, const
                 // copy the non-hole data
                 if ((err = this->full_write(out_fd, buf + tosend_offset, nonhole_len, target)) != 0)
                     break;
-                tosend_offset += nonhole_len;
-                tosend_left -= nonhole_len;
+                tosend_offset += nonhole_len;
+                tosend_left -= nonhole_len;
+            }
+        }
+        if (err != 0)
+            break;
+        offset_high = offset_low;
+    }
+    if (err != 0 && offset_high != 0 && offset_high != file_size) {
+        ff_log(FC_ERROR, 0, "DANGER! due to previous error, copying `%s' -> `%s' was aborted", source, target);
+        ff_log(FC_ERROR, 0, "        and BOTH copies of this file are now incomplete.");
+        ff_log(FC_ERROR, 0, "        To recover this file, execute the following command");
+        ff_log(FC_ERROR, 0, "        AFTER freeing enough space in the source device:");
+
+        /* data segments may start at offsets not aligned to FT_BUFSIZE */
+        ft_size block_size = FT_BUFSIZE;
+        while (offset_high % block_size != 0)
+            block_size >>= 1;
+        offset_high /= block_size;
+        ff_log(FC_ERROR, 0, "          /bin/dd bs=%" FT_ULL " skip=%" FT_ULL " seek=%" FT_ULL " conv=notrunc if=\"%s\" of=\"%s\"",
+                (ft_ull)block_size, (ft_ull)offset_high, (ft_ull)offset_high, target, source);
+    }
+    return err;
+}
+
+
+/**
+ * forward copy file/stream contents from in_fd to out_fd.
+ * only the data segments reported by data_segments() are read, holes between them are re-created in target.
+ * segments known to contain no holes are copied with copy_stream_kernel(), the rest with copy_stream_user()
+ */
+int fm_io_posix::copy_stream_forward(int in_fd, int out_fd, const ft_stat & stat, const char * source, const char * target)
+{
+    ft_segment_vector segments;
+    ft_off file_size = stat.st_size;
+    bool exact;
+    int err;
+
+    if ((err = data_segments(in_fd, file_size, segments, exact, source)) != 0)
+        return err;
+
+    /*
+     * segments reported by SEEK_DATA contain no holes to preserve,
+     * and neither does a source file with as many allocated blocks as its length:
+     * copy them inside the kernel. otherwise use the user-space loop,
+     * which detects zeroed blocks and re-creates them as holes
+     */
+    bool kernel_copy = exact;
+#ifdef FT_HAVE_STRUCT_STAT_ST_BLOCKS
+    if (!kernel_copy)
+        kernel_copy = (ft_uoff) stat.st_blocks * 512 >= (ft_uoff) file_size;
+#endif
+
+    /* same reasoning: preallocating blocks that should be re-created as holes would waste them */
+    if (kernel_copy && fallocate_target() && !fm_io_posix_flag_load(& fallocate_unsupported))
+        fd_preallocate(out_fd, segments, target);
+
+#if defined(FT_HAVE_PREAD) && defined(FT_HAVE_PWRITE)
+    /* a single thread cannot keep enough requests in flight to reach the full bandwidth of fast disks */
+    if (copy_thread_n() > 1 && (ft_uoff) file_size >= FT_PARALLEL_COPY_MIN) {
+        if ((err = copy_stream_parallel(in_fd, out_fd, segments, kernel_copy, file_size, source, target)) == 0)
+            err = fd_truncate(out_fd, file_size, target);
+        return err;
+    }
+#endif
+
+    /*
+     * large files are copied through a large aligned buffer, writing with O_DIRECT:
+     * they would only evict more useful data from the page cache, and so would the source file pages
+     * we already copied - drop them too. if the file system does not support O_DIRECT, just use the buffer
+     */
+    char * direct_buf = NULL;
+    ft_off chunk_max = FT_WRITEBACK_CHUNK;
+    if (direct_io_min() != 0 && (ft_uoff) file_size >= direct_io_min()
+        && (direct_buf = alloc_direct_buffer()) != NULL)
+    {
+        if (!fd_set_direct(out_fd, true))
+            ff_log(FC_DEBUG, 0, "cannot bypass page cache for file `%s', using normal writes", target);
+        chunk_max = ff_max2<ft_off>(chunk_max, io_buffer_size());
+    }
+
+    bool eof = false;
+    for (ft_size i = 0, n = segments.size(); err == 0 && !eof && i < n; i++) {
+        const ft_segment & segment = segments[i];
+
+        /* seeking out_fd past its end creates the hole before this segment */
+        if ((err = fd_seek2(in_fd, out_fd, segment.first, source, target)) != 0)
+            break;
+
+        /* copy the segment in pieces, and start writing back each piece as soon as it is copied */
+        ft_off offset = segment.first, chunk_len;
+        for (; offset < segment.second; offset += chunk_len) {
+            chunk_len = ff_min2<ft_off>(chunk_max, segment.second - offset);
+            ft_uoff length = (ft_uoff) chunk_len;
+
+            if (direct_buf != NULL) {
+                if ((err = copy_stream_user(in_fd, out_fd, length, direct_buf, io_buffer_size(), source, target)) != 0)
+                    break;
+            } else {
+                if (kernel_copy && (err = copy_stream_kernel(in_fd, out_fd, length, source, target)) != 0)
+                    break;
+                if (length != 0 && (err = copy_stream_user(in_fd, out_fd, length, source, target)) != 0)
+                    break;
+            }
+            if (length != 0) {
+                /* source file is shorter than expected */
+                file_size = offset + chunk_len - (ft_off) length;
+                eof = true;
+                break;
             }
+            fd_writeback(out_fd, offset, chunk_len);
+            if (direct_buf != NULL)
+                fd_drop_cache(in_fd, offset, chunk_len);
         }
-        if (err != 0)
-            break;
-        offset_high = offset_low;
     }
-    if (err != 0 && offset_high != 0 && offset_high != file_size) {
-        ff_log(FC_ERROR, 0, "DANGER! due to previous error, copying `%s' -> `%s' was aborted", source, target);
-        ff_log(FC_ERROR, 0, "        and BOTH copies of this file are now incomplete.");
-        ff_log(FC_ERROR, 0, "        To recover this file, execute the following command");
-        ff_log(FC_ERROR, 0, "        AFTER freeing enough space in the source device:");
+    free(direct_buf);
+
+    // file may end with a hole... handle this case correctly!
+    if (err == 0)
+        err = fd_truncate(out_fd, file_size, target);
 
-        offset_high >>= FT_LOG_BUFSIZE;
-        ff_log(FC_ERROR, 0, "          /bin/dd bs=%" FT_ULL " skip=%" FT_ULL " seek=%" FT_ULL " conv=notrunc if=\"%s\" of=\"%s\"",
-                (ft_ull)FT_BUFSIZE, (ft_ull)offset_high, (ft_ull)offset_high, target, source);
-    }
     return err;
 }
 
+/**
+ * fill 'segments' with the [start, end) ranges of file 'fd' that contain data, using lseek(SEEK_DATA/SEEK_HOLE).
+ * anything before, between and after segments up to 'length' is a hole.
+ * sets 'exact' to true if segments were found this way and thus contain no holes.
+ * if SEEK_DATA/SEEK_HOLE are not supported, sets 'exact' to false and fills 'segments'
+ * with the single range [0, length)
+ */
+int fm_io_posix::data_segments(int fd, ft_off length, ft_segment_vector & segments, bool & exact, const char * path)
+{
+    segments.clear();
+    exact = false;
+    int err = 0;
+#if defined(SEEK_DATA) && defined(SEEK_HOLE)
+    ft_off data, hole = 0;
+    while (hole < length) {
+        if ((data = ::lseek(fd, hole, SEEK_DATA)) == (ft_off)-1) {
+            /* ENXIO means no more data until end-of-file */
+            if ((err = errno) == ENXIO)
+                err = 0;
+            break;
+        }
+        if (data >= length)
+            break;
+        if ((hole = ::lseek(fd, data, SEEK_HOLE)) == (ft_off)-1) {
+            err = errno;
+            break;
+        }
+        segments.push_back(ft_segment(data, ff_min2(hole, length)));
+    }
+    if (err == 0) {
+        exact = true;
+        return err;
+    }
+    if (err != EINVAL || !segments.empty())
+        return ff_log(FC_ERROR, err, "error seeking to next data or hole in file `%s'", path);
+
+    /* SEEK_DATA/SEEK_HOLE not supported by kernel or file system: treat the whole file as data */
+    segments.clear();
+    err = 0;
+#endif
+    if (length != 0)
+        segments.push_back(ft_segment(0, length));
+    return err;
+}
 
 /**
- * forward copy file/stream contents from in_fd to out_fd.
+ * forward copy up to 'length' bytes from in_fd to out_fd through a user-space buffer,
+ * re-creating any zeroed block as a hole in target.
+ * returns 0 for success, else error.
+ * on return, 'length' will contain the number of bytes NOT copied because end-of-file was reached
  */
-int fm_io_posix::copy_stream_forward(int in_fd, int out_fd, const char * source, const char * target)
+int fm_io_posix::copy_stream_user(int in_fd, int out_fd, ft_uoff & length, const char * source, const char * target)
 {
     char buf[FT_BUFSIZE];
+    return copy_stream_user(in_fd, out_fd, length, buf, FT_BUFSIZE, source, target);
+}
 
+/**
+ * same as copy_stream_user() above, using caller-provided 'buf' of 'buf_size' bytes.
+ * buf_size must be a multiple of APPROX_BLOCK_SIZE
+ */
+int fm_io_posix::copy_stream_user(int in_fd, int out_fd, ft_uoff & length, char * buf, ft_size buf_size,
+                                  const char * source, const char * target)
+{
     ft_size present = 0, present_aligned, got;
     ft_size hole_len, nonhole_len, tosend_offset, tosend_left;
     int err = 0;
-    for (;;) {
-        got = FT_BUFSIZE - present;
+    while (length != 0) {
+        got = (ft_size) ff_min2<ft_uoff>(buf_size - present, length);
         if ((err = this->full_read(in_fd, buf + present, got, source)) != 0 || got == 0)
             break;
+        length -= got;
 
         tosend_left = present_aligned = (present += got) / APPROX_BLOCK_SIZE * APPROX_BLOCK_SIZE;
 
@@ -758,30 +2613,449 @@ int fm_io_posix::copy_stream_forward(int in_fd, int out_fd, const char * source,
             // move any remaining unaligned fragment to buffer beginning
             ::memmove(buf, buf + present_aligned, present - present_aligned);
         present -= present_aligned;
-        present_aligned = 0;
     }
 
-    if (err == 0) do {
-        if (present > present_aligned) {
-            // write any remaining unaligned fragment
-            err = this->full_write(out_fd, buf + present_aligned, present - present_aligned, target);
+    if (err == 0 && present != 0)
+        // write any remaining unaligned fragment
+        err = this->full_write(out_fd, buf, present, target);
+
+    return err;
+}
+
+
+
+/**
+ * allocate a buffer of io_buffer_size() bytes, aligned as required to write bypassing the page cache.
+ * return NULL if not supported or out of memory. release it with free()
+ */
+char * fm_io_posix::alloc_direct_buffer() const
+{
+    void * buf = NULL;
+#ifdef FT_HAVE_POSIX_MEMALIGN
+    int err = posix_memalign(& buf, FT_DIRECT_ALIGN, io_buffer_size());
+    if (err != 0) {
+        ff_log(FC_DEBUG, err, "failed to allocate %" FT_ULL " bytes for copy buffer", (ft_ull) io_buffer_size());
+        buf = NULL;
+    }
+#endif
+    return (char *) buf;
+}
+
+/** kernel copy methods tried by copy_stream_kernel(), in order */
+enum ft_kernel_copy {
+    FC_COPY_FILE_RANGE, FC_SENDFILE, FC_SPLICE, FC_KERNEL_COPY_NONE,
+};
+
+/**
+ * return true if errno value 'err' means that a kernel copy method is not supported
+ * by the kernel or by these file systems, i.e. the next method should be tried
+ */
+static bool ff_kernel_copy_unsupported(int err)
+{
+    return err == ENOSYS || err == EINVAL || err == EXDEV || err == EOPNOTSUPP
+#if defined(ENOTSUP) && ENOTSUP != EOPNOTSUPP
+        || err == ENOTSUP
+#endif
+        ;
+}
+
+/**
+ * forward copy up to 'length' bytes from in_fd to out_fd inside the kernel, without user-space buffers:
+ * try copy_file_range(), then sendfile(), then splice() through a pipe.
+ * all methods read and write at the current file offsets, so they can be switched at any time.
+ * returns 0 for success, else error.
+ * on return, 'length' will contain the number of bytes NOT copied, because no kernel method is available
+ * or because end-of-file was reached: caller must try to copy them in user space
+ */
+int fm_io_posix::copy_stream_kernel(int in_fd, int out_fd, ft_uoff & length, const char * source, const char * target)
+{
+    ft_kernel_copy method = FC_COPY_FILE_RANGE;
+    ft_size chunk, got;
+    int pipe_fd[2] = { -1, -1 };
+    int err = 0;
+
+    while (length != 0 && method != FC_KERNEL_COPY_NONE) {
+        chunk = (ft_size) ff_min2<ft_uoff>(length, FT_KERNEL_COPY_CHUNK);
+        got = (ft_size)-1;
+        errno = ENOSYS;
+
+        switch (method) {
+        case FC_COPY_FILE_RANGE:
+#ifdef FT_HAVE_COPY_FILE_RANGE
+            got = ::copy_file_range(in_fd, NULL, out_fd, NULL, chunk, 0);
+#endif
+            break;
+        case FC_SENDFILE:
+#ifdef FT_HAVE_SENDFILE
+            got = ::sendfile(out_fd, in_fd, NULL, chunk);
+#endif
+            break;
+        case FC_SPLICE:
+#if defined(FT_HAVE_SPLICE) && defined(FT_HAVE_PIPE)
+            if (pipe_fd[0] < 0 && ::pipe(pipe_fd) != 0) {
+                /* cannot create pipe: fall back on user-space copy */
+                pipe_fd[0] = pipe_fd[1] = -1;
+                errno = ENOSYS;
+                break;
+            }
+            got = ::splice(in_fd, NULL, pipe_fd[1], NULL, chunk, SPLICE_F_MOVE);
+            if (got != 0 && got != (ft_size)-1) {
+                /* data is now in the pipe: failing to move it to out_fd is a real error, not a reason to fall back */
+                for (ft_size left = got, sent; left != 0; left -= sent) {
+                    while ((sent = ::splice(pipe_fd[0], NULL, out_fd, NULL, left, SPLICE_F_MOVE)) == (ft_size)-1 && errno == EINTR)
+                        ;
+                    if (sent == 0 || sent == (ft_size)-1) {
+                        err = ff_log(FC_ERROR, sent == 0 ? EIO : errno, "error writing to `%s'", target);
+                        break;
+                    }
+                }
+            }
+#endif
+            break;
+        default:
             break;
         }
+        if (err != 0)
+            break;
 
-        // file may end with a hole... handle this case correctly!
-        ft_off filelen = ::lseek(out_fd, (ft_off)0, SEEK_CUR);
-        if (filelen == (ft_off)-1) {
-            err = ff_log(FC_ERROR, errno, "error seeking in file `%s'", target);
+        if (got == (ft_size)-1) {
+            if ((err = errno) == EINTR) {
+                err = 0;
+                continue;
+            }
+            if (ff_kernel_copy_unsupported(err)) {
+                ff_log(FC_TRACE, err, "kernel copy method %d not available for `%s'\t-> `%s', trying next one",
+                       (int) method, source, target);
+                method = (ft_kernel_copy)(method + 1);
+                err = 0;
+                continue;
+            }
+            err = ff_log(FC_ERROR, err, "error copying from `%s' to `%s'", source, target);
             break;
         }
-        if ((err = fd_truncate(out_fd, filelen, target)) != 0)
+        if (got == 0)
+            /* end-of-file: source file is shorter than expected */
             break;
+        length -= got;
 
-    } while (0);
+        if ((err = this->periodic_check_free_space(got)) != 0)
+            break;
+    }
+    if (pipe_fd[0] >= 0) {
+        (void) ::close(pipe_fd[0]);
+        (void) ::close(pipe_fd[1]);
+    }
+    return err;
+}
+
+
+/** state shared by all threads started by copy_stream_parallel() */
+struct fm_copy_job
+{
+    fm_io_posix * io;
+    int in_fd, out_fd;
+    const char * source, * target;
+    /** [start, end) ranges to copy, in file order */
+    ft_segment_vector ranges;
+    bool kernel_copy, drop_cache;
+    ft_mutex mutex;
+    /** index of next range to copy */
+    ft_size next;
+    /** total length of 'ranges', bytes copied until now, and when to report progress next */
+    ft_uoff total, copied, report_at;
+    /** where source file turned out to end, if shorter than expected */
+    ft_off eof;
+    int err;
+
+    fm_copy_job(fm_io_posix * my_io, int my_in_fd, int my_out_fd, const char * my_source, const char * my_target,
+                bool my_kernel_copy, bool my_drop_cache, ft_off file_size)
+        : io(my_io), in_fd(my_in_fd), out_fd(my_out_fd), source(my_source), target(my_target),
+          ranges(), kernel_copy(my_kernel_copy), drop_cache(my_drop_cache), mutex(), next(0),
+          total(0), copied(0), report_at(0), eof(file_size), err(0)
+    { }
+
+    /** get next range to copy and return true, or return false if all ranges are copied or some thread failed */
+    bool pop(ft_segment & range)
+    {
+        ft_mutex_guard guard(mutex);
+        if (err != 0 || next == ranges.size() || ranges[next].first >= eof)
+            return false;
+        range = ranges[next++];
+        return true;
+    }
+
+    /** called after copying a range returned by pop(): 'left' is the number of bytes NOT copied */
+    void done(const ft_segment & range, ft_uoff left, int range_err)
+    {
+        ft_mutex_guard guard(mutex);
+        if (range_err != 0 && err == 0)
+            err = range_err;
+        if (left != 0 && eof > range.second - (ft_off) left)
+            eof = range.second - (ft_off) left;
+
+        copied += (ft_uoff) (range.second - range.first) - left;
+        if (copied >= report_at && err == 0) {
+            /* report progress of this file every 10%: at INFO level only for files large enough to take a while */
+            ff_log(total >= ((ft_uoff)1 << 30) ? FC_INFO : FC_DEBUG, 0, "copied %.0f%% of file `%s'",
+                   copied * 100.0 / (double) total, target);
+            report_at = copied + total / 10;
+        }
+    }
+};
+
+/**
+ * forward copy 'segments' of file in_fd to out_fd using copy_thread_n() threads,
+ * which copy ranges of each segment concurrently at explicit offsets with copy_range().
+ * if 'kernel_copy', segments contain no holes to re-create.
+ * on return, 'file_size' is reduced if source file turned out to be shorter than expected
+ */
+int fm_io_posix::copy_stream_parallel(int in_fd, int out_fd, const ft_segment_vector & segments, bool kernel_copy,
+                                      ft_off & file_size, const char * source, const char * target)
+{
+    const bool drop_cache = direct_io_min() != 0 && (ft_uoff) file_size >= direct_io_min();
+    fm_copy_job job(this, in_fd, out_fd, source, target, kernel_copy, drop_cache, file_size);
+
+    for (ft_size i = 0, n = segments.size(); i < n; i++) {
+        for (ft_off offset = segments[i].first, end; offset < segments[i].second; offset = end) {
+            end = ff_min2<ft_off>(offset + FT_PARALLEL_CHUNK, segments[i].second);
+            job.ranges.push_back(ft_segment(offset, end));
+            job.total += (ft_uoff) (end - offset);
+        }
+    }
+    job.report_at = job.total / 10;
+
+    const ft_size thread_n = ff_min2<ft_size>(copy_thread_n(), job.ranges.size());
+    ff_log(FC_DEBUG, 0, "copying file `%s' using %" FT_ULL " threads", target, (ft_ull) thread_n);
+
+    int err = ff_thread_run(thread_n, copy_parallel_thread, & job);
+    if (err == 0)
+        err = job.err;
+    if (file_size > job.eof)
+        /* source file is shorter than expected */
+        file_size = job.eof;
+    return err;
+}
+
+/** function executed by each thread started by copy_stream_parallel() */
+int fm_io_posix::copy_parallel_thread(void * arg, ft_size FT_ARG_UNUSED(thread_i))
+{
+    fm_copy_job & job = * (fm_copy_job *) arg;
+    fm_io_posix & io = * job.io;
+    const ft_size buf_size = io.io_buffer_size();
+    char * buf = (char *) malloc(buf_size);
+    ft_segment range;
+    int err = 0;
+
+    if (buf == NULL)
+        err = ff_log(FC_ERROR, ENOMEM, "failed to allocate %" FT_ULL " bytes to copy file `%s'", (ft_ull) buf_size, job.source);
+
+    while (err == 0 && job.pop(range)) {
+        ft_uoff left = (ft_uoff) (range.second - range.first);
+        err = io.copy_range(job.in_fd, job.out_fd, range.first, left, job.kernel_copy, buf, buf_size, job.source, job.target);
+        job.done(range, left, err);
+
+        fd_writeback(job.out_fd, range.first, range.second - range.first);
+        if (job.drop_cache)
+            fd_drop_cache(job.in_fd, range.first, range.second - range.first);
+    }
+    free(buf);
+    return err;
+}
+
+/**
+ * copy up to 'length' bytes from in_fd at 'offset' to out_fd at the same offset, without using file offsets.
+ * if 'kernel_copy', try copy_file_range() first. else, or if not available, use pread() and pwrite()
+ * through 'buf' of 'buf_size' bytes, skipping zeroed blocks so that they remain holes in target.
+ * returns 0 for success, else error.
+ * on return, 'length' will contain the number of bytes NOT copied because end-of-file was reached
+ */
+int fm_io_posix::copy_range(int in_fd, int out_fd, ft_off offset, ft_uoff & length, bool kernel_copy,
+                            char * buf, ft_size buf_size, const char * source, const char * target)
+{
+    ft_size got;
+    int err = 0;
+#ifdef FT_HAVE_COPY_FILE_RANGE
+    while (kernel_copy && length != 0) {
+        /* explicit offsets: copy_file_range() neither uses nor changes the file offsets shared by all threads */
+        loff_t in_offset = offset, out_offset = offset;
+        got = ::copy_file_range(in_fd, & in_offset, out_fd, & out_offset,
+                                (ft_size) ff_min2<ft_uoff>(length, FT_KERNEL_COPY_CHUNK), 0);
+        if (got == (ft_size)-1) {
+            if ((err = errno) == EINTR) {
+                err = 0;
+                continue;
+            }
+            if (ff_kernel_copy_unsupported(err)) {
+                err = 0;
+                break;
+            }
+            return ff_log(FC_ERROR, err, "error copying from `%s' to `%s'", source, target);
+        }
+        if (got == 0)
+            /* end-of-file: source file is shorter than expected */
+            return err;
+        offset += (ft_off) got;
+        length -= got;
+        if ((err = this->periodic_check_free_space(got)) != 0)
+            return err;
+    }
+#endif
+    while (length != 0) {
+        got = (ft_size) ff_min2<ft_uoff>(buf_size, length);
+        if ((err = this->full_pread(in_fd, buf, got, offset, source)) != 0 || got == 0)
+            break;
+
+        /* target file is truncated to its final length at the end: zeroed blocks we skip remain holes */
+        for (ft_size pos = 0, hole_len, nonhole_len; err == 0 && pos < got; pos += hole_len + nonhole_len) {
+            if (kernel_copy) {
+                hole_len = 0;
+                nonhole_len = got - pos;
+            } else {
+                hole_len = hole_length(buf + pos, got - pos);
+                nonhole_len = nonhole_length(buf + pos + hole_len, got - pos - hole_len);
+            }
+            if (nonhole_len != 0)
+                err = this->full_pwrite(out_fd, buf + pos + hole_len, nonhole_len, offset + (ft_off) (pos + hole_len), target);
+        }
+        offset += (ft_off) got;
+        length -= got;
+    }
+    return err;
+}
+
+/**
+ * allocate the space for 'segments' of file pointed by descriptor without changing its length,
+ * so that the file system can place them in a few large extents before we write them.
+ * failures are not errors: they only mean the file may be more fragmented
+ */
+void fm_io_posix::fd_preallocate(int fd, const ft_segment_vector & segments, const char * path)
+{
+#if defined(FT_HAVE_FALLOCATE) && defined(FALLOC_FL_KEEP_SIZE)
+    for (ft_size i = 0, n = segments.size(); i < n; i++) {
+        const ft_segment & segment = segments[i];
+        if (segment.second <= segment.first
+            || ::fallocate(fd, FALLOC_FL_KEEP_SIZE, segment.first, segment.second - segment.first) == 0)
+            continue;
+
+        int err = errno;
+        if (err == EOPNOTSUPP || err == ENOSYS) {
+            if (!fm_io_posix_flag_load(& fallocate_unsupported)) {
+                fm_io_posix_flag_store(& fallocate_unsupported);
+                ff_log(FC_INFO, 0, "target file system does not support fallocate(), ignoring option '--fallocate'");
+            }
+        } else
+            ff_log(FC_DEBUG, err, "failed to preallocate target file `%s', continuing without", path);
+        break;
+    }
+#else
+    (void) fd;
+    (void) segments;
+    (void) path;
+    fm_io_posix_flag_store(& fallocate_unsupported);
+#endif
+}
+
+/**
+ * return true if fd_punch_hole() is supported on fd.
+ * probes by punching a hole past the end of file, which does not change the file
+ */
+bool fm_io_posix::fd_can_punch_hole(int fd, ft_off file_size)
+{
+#if defined(FT_HAVE_FALLOCATE) && defined(FALLOC_FL_PUNCH_HOLE) && defined(FALLOC_FL_KEEP_SIZE)
+    return ::fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, file_size, FT_BUFSIZE) == 0;
+#else
+    (void) fd;
+    (void) file_size;
+    return false;
+#endif
+}
+
+/**
+ * punch a hole in file pointed by descriptor, releasing the space used by the specified range.
+ * file length is not changed
+ */
+int fm_io_posix::fd_punch_hole(int fd, ft_off offset, ft_off length, const char * path)
+{
+    int err = 0;
+#if defined(FT_HAVE_FALLOCATE) && defined(FALLOC_FL_PUNCH_HOLE) && defined(FALLOC_FL_KEEP_SIZE)
+    if (::fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, offset, length) != 0)
+        err = errno;
+#else
+    (void) fd;
+    err = ENOSYS;
+#endif
+    if (err != 0)
+        err = ff_log(FC_ERROR, err, "error punching hole in file `%s' at %" FT_ULL " bytes, length %" FT_ULL " bytes",
+                     path, (ft_ull)offset, (ft_ull)length);
+    return err;
+}
 
+/**
+ * flush to disk the data written to file pointed by descriptor
+ */
+int fm_io_posix::fd_sync(int fd, const char * path)
+{
+    int err = 0;
+#if defined(FT_HAVE_FDATASYNC)
+    if (::fdatasync(fd) != 0)
+#elif defined(FT_HAVE_FSYNC)
+    if (::fsync(fd) != 0)
+#else
+    sync();
+    if (false)
+#endif
+        err = ff_log(FC_ERROR, errno, "error flushing file `%s' to disk", path);
     return err;
 }
 
+/**
+ * start writing back to disk the specified range of file pointed by descriptor, without waiting for it.
+ * keeps dirty data from piling up, so that later calls to sync() are faster
+ */
+void fm_io_posix::fd_writeback(int fd, ft_off offset, ft_off length)
+{
+#if defined(FT_HAVE_SYNC_FILE_RANGE) && defined(SYNC_FILE_RANGE_WRITE)
+    (void) ::sync_file_range(fd, offset, length, SYNC_FILE_RANGE_WRITE);
+#else
+    (void) fd;
+    (void) offset;
+    (void) length;
+#endif
+}
+
+/**
+ * set or clear O_DIRECT on file pointed by descriptor, i.e. write bypassing the page cache.
+ * return true if the flag is now as requested and was not before
+ */
+bool fm_io_posix::fd_set_direct(int fd, bool direct)
+{
+#if defined(FT_HAVE_FCNTL_H) && defined(O_DIRECT)
+    int flags = ::fcntl(fd, F_GETFL);
+    if (flags == -1 || ((flags & O_DIRECT) != 0) == direct)
+        return false;
+    /* fails with EINVAL if the file system does not support O_DIRECT */
+    return ::fcntl(fd, F_SETFL, direct ? flags | O_DIRECT : flags & ~O_DIRECT) == 0;
+#else
+    (void) fd;
+    (void) direct;
+    return false;
+#endif
+}
+
+/**
+ * tell the kernel the specified range of file pointed by descriptor will not be accessed again,
+ * so that the page cache can drop it
+ */
+void fm_io_posix::fd_drop_cache(int fd, ft_off offset, ft_off length)
+{
+#if defined(FT_HAVE_POSIX_FADVISE) && defined(POSIX_FADV_DONTNEED)
+    (void) ::posix_fadvise(fd, offset, length, POSIX_FADV_DONTNEED);
+#else
+    (void) fd;
+    (void) offset;
+    (void) length;
+#endif
+}
 
 /**
  * truncate file pointed by descriptor to specified length
@@ -823,12 +3097,9 @@ int fm_io_posix::fd_seek(int fd, ft_off offset, const char * path)
  */
 size_t fm_io_posix::hole_length(const char * mem, ft_size mem_len)
 {
-    size_t len = 0;
     /* blocks smaller than APPROX_BLOCK_SIZE are always considered non-hole */
     mem_len = (mem_len / APPROX_BLOCK_SIZE) * APPROX_BLOCK_SIZE;
-    for (; len < mem_len; len++)
-        if (mem[len] != '\0')
-            break;
+    size_t len = ff_zero_length(mem, mem_len);
     return (len / APPROX_BLOCK_SIZE) * APPROX_BLOCK_SIZE;
 }
 
@@ -839,9 +3110,9 @@ size_t fm_io_posix::hole_length(const char * mem, ft_size mem_len)
  */
 size_t fm_io_posix::nonhole_length(const char * mem, ft_size mem_len)
 {
-    size_t hole_len, offset = 0;
+    size_t offset = 0;
 
-    while (mem_len >= APPROX_BLOCK_SIZE && (hole_len = hole_length(mem + offset, APPROX_BLOCK_SIZE)) == 0) {
+    while (mem_len >= APPROX_BLOCK_SIZE && !ff_mem_is_zero(mem + offset, APPROX_BLOCK_SIZE)) {
         offset += APPROX_BLOCK_SIZE;
         mem_len -= APPROX_BLOCK_SIZE;
     }
@@ -865,7 +3136,7 @@ int fm_io_posix::full_read(int in_fd, char * data, ft_size & len, const char * s
     ft_size got, left = len;
     int err = 0;
     while (left) {
-        while ((got = ::read(in_fd, data, len)) == (ft_size)-1 && errno == EINTR)
+        while ((got = ::read(in_fd, data, left)) == (ft_size)-1 && errno == EINTR)
             ;
         if (got == 0 || got == (ft_size)-1) {
             if (got != 0)
@@ -893,28 +3164,98 @@ int fm_io_posix::full_write(int out_fd, const char * data, ft_size len, const ch
     while (len) {
         while ((chunk = ::write(out_fd, data, len)) == (ft_size)-1 && errno == EINTR)
             ;
+        /*
+         * O_DIRECT fails with EINVAL on unaligned offsets or lengths, as the last fragment of a file usually is:
+         * write the rest normally
+         */
+        if (chunk == (ft_size)-1 && errno == EINVAL && fd_set_direct(out_fd, false))
+            continue;
+        if (chunk == 0 || chunk == (ft_size)-1) {
+            err = ff_log(FC_ERROR, errno, "error writing to `%s'", target_path);
+            break;
+        }
+        data += chunk;
+        len -= chunk;
+
+        if ((err = this->periodic_check_free_space(chunk)) != 0)
+            break;
+    }
+    return err;
+}
+
+/**
+ * same as full_read(), reading at 'offset' without using or changing the file offset
+ */
+int fm_io_posix::full_pread(int in_fd, char * data, ft_size & len, ft_off offset, const char * source_path)
+{
+    ft_size got, left = len;
+    int err = 0;
+#ifdef FT_HAVE_PREAD
+    while (left) {
+        while ((got = ::pread(in_fd, data, left, offset)) == (ft_size)-1 && errno == EINTR)
+            ;
+        if (got == 0 || got == (ft_size)-1) {
+            if (got != 0)
+                err = ff_log(FC_ERROR, errno, "error reading from `%s'", source_path);
+            // else got == 0: end-of-file
+            break;
+        }
+        left -= got;
+        data += got;
+        offset += (ft_off) got;
+    }
+#else
+    (void) in_fd;
+    (void) data;
+    (void) offset;
+    err = ff_log(FC_ERROR, ENOSYS, "error reading from `%s'", source_path);
+#endif
+    len -= left;
+    return err;
+}
+
+/**
+ * same as full_write(), writing at 'offset' without using or changing the file offset
+ */
+int fm_io_posix::full_pwrite(int out_fd, const char * data, ft_size len, ft_off offset, const char * target_path)
+{
+    ft_size chunk;
+    int err = 0;
+#ifdef FT_HAVE_PWRITE
+    while (len) {
+        while ((chunk = ::pwrite(out_fd, data, len, offset)) == (ft_size)-1 && errno == EINTR)
+            ;
         if (chunk == 0 || chunk == (ft_size)-1) {
             err = ff_log(FC_ERROR, errno, "error writing to `%s'", target_path);
             break;
         }
         data += chunk;
         len -= chunk;
+        offset += (ft_off) chunk;
 
         if ((err = this->periodic_check_free_space(chunk)) != 0)
             break;
     }
+#else
+    (void) out_fd;
+    (void) data;
+    (void) len;
+    (void) offset;
+    err = ff_log(FC_ERROR, ENOSYS, "error writing to `%s'", target_path);
+#endif
     return err;
 }
 
 /**
  * copy the permission bits, owner/group and timestamps from 'stat' to 'target'
  */
-int fm_io_posix::copy_stat(const char * target, const ft_stat & stat)
+int fm_io_posix::copy_stat(int dir_fd, const char * target, const ft_stat & stat)
 {
     int err = 0;
     if (simulate_run())
         return err;
 
+    const char * name = at_name(dir_fd, target);
     const char * label = fm_io_posix_is_dir(stat) ? "directory" : fm_io_posix_is_file(stat) ? "file" : "special device";
 
     /* copy timestamps */
@@ -934,7 +3275,7 @@ int fm_io_posix::copy_stat(const char * target, const ft_stat & stat)
 # elif defined(FT_HAVE_STRUCT_STAT_ST_MTIMENSEC)
         time_buf[1].tv_nsec = stat.st_mtimensec;
 # endif
-        if (utimensat(AT_FDCWD, target, time_buf, AT_SYMLINK_NOFOLLOW) != 0)
+        if (utimensat(dir_fd, name, time_buf, AT_SYMLINK_NOFOLLOW) != 0)
             ff_log(FC_WARN, errno, "cannot change timestamps on %s `%s'", label, target);
 
     } while (0);
@@ -946,7 +3287,7 @@ int fm_io_posix::copy_stat(const char * target, const ft_stat & stat)
         time_buf[1].tv_sec = stat.st_mtime;
         time_buf[0].tv_usec = time_buf[1].tv_usec = 0;
 
-        if (utimes(target, time_buf) != 0)
+        if (utimes(name, time_buf) != 0)
             ff_log(FC_WARN, errno, "cannot change timestamps on %s `%s'", label, target);
     }
 #else
@@ -960,12 +3301,7 @@ int fm_io_posix::copy_stat(const char * target, const ft_stat & stat)
 
         /* copy owner and group. this resets any SUID bits */
 
-#if defined(FT_HAVE_LCHOWN)
-        if (lchown(target, stat.st_uid, stat.st_gid) != 0)
-#else
-        if (!is_symlink && chown(target, stat.st_uid, stat.st_gid) != 0)
-#endif
-        {
+        if (fchownat(dir_fd, name, stat.st_uid, stat.st_gid, AT_SYMLINK_NOFOLLOW) != 0) {
             err = ff_log(is_error ? FC_ERROR : FC_WARN, errno,
                     "%s set owner=%" FT_ULL " and group=%" FT_ULL " on %s `%s'",
                     fail_label, (ft_ull)stat.st_uid, (ft_ull)stat.st_gid, label, target);
@@ -978,7 +3314,7 @@ int fm_io_posix::copy_stat(const char * target, const ft_stat & stat)
          * 1. chmod() on a symbolic link has no sense, don't to it
          * 2. chmod() must be performed AFTER lchown(), because lchown() resets any SUID bits
          */
-        if (!is_symlink && chmod(target, stat.st_mode) != 0) {
+        if (!is_symlink && fchmodat(dir_fd, name, stat.st_mode, 0) != 0) {
             err = ff_log(is_error ? FC_ERROR : FC_WARN, errno,
                     "%s change mode to 0%" FT_OLL " on %s `%s'",
                     fail_label, (ft_ull)stat.st_mode, label, target);
@@ -1012,7 +3348,7 @@ bool fm_io_posix::is_target_lost_found(const ft_string & path) const
 
 
 /** create a target directory, copying its mode and other meta-data from 'stat' */
-int fm_io_posix::create_dir(const ft_string & path)
+int fm_io_posix::create_dir(int dir_fd, const ft_string & path)
 {
     const char * dir = path.c_str();
     int err = 0;
@@ -1021,7 +3357,7 @@ int fm_io_posix::create_dir(const ft_string & path)
     do {
         if (simulate_run())
             break;
-        if (::mkdir(dir, 0700) == 0)
+        if (::mkdirat(dir_fd, at_name(dir_fd, dir), 0700) == 0)
             break;
 
         /* if creating target root, ignore EEXIST error: target root is allowed to exist already */
@@ -1043,7 +3379,7 @@ int fm_io_posix::create_dir(const ft_string & path)
  * remove a source directory.
  * exception: we do not delete 'lost+found' directory inside source_root()
  */
-int fm_io_posix::remove_dir(const ft_string & path)
+int fm_io_posix::remove_dir(int dir_fd, const ft_string & path)
 {
     const char * dir = path.c_str();
     int err = 0;
@@ -1052,7 +3388,7 @@ int fm_io_posix::remove_dir(const ft_string & path)
         if (simulate_run() || is_source_lost_found(path))
             break;
 
-        if (::remove(dir) != 0) {
+        if (::unlinkat(dir_fd, at_name(dir_fd, dir), AT_REMOVEDIR) != 0) {
             /* ignore error if we are removing source root: it is allowed to be in use */
             if (path != source_root()) {
                 /* if force_run(), failure to remove a source directory is just a warning */
@@ -27,11 +27,62 @@
 #define FSMOVE_IO_IO_POSIX_HH
 
 #include "../types.hh"    // for ft_string */
+#include "../thread.hh"   // for ft_mutex */
 #include "io.hh"          // for fm_io */
+#include "io_posix_dir.hh" // for ft_io_posix_dir */
+#include "uring.hh"       // for fm_uring */
+
+#include <set>            // for std::set<T> */
+#include <utility>        // for std::pair<T1,T2> */
+#include <vector>         // for std::vector<T> */
 
 
 FT_IO_NAMESPACE_BEGIN
 
+struct fm_move_dir;
+struct fm_move_job;
+struct fm_remove_task;
+struct fm_remove_queue;
+
+/** a [start, end) range of file offsets */
+typedef std::pair<ft_off, ft_off> ft_segment;
+typedef std::vector<ft_segment> ft_segment_vector;
+
+/** name of a directory entry to move, and the key to sort it by: see fm_io::order() */
+typedef std::pair<ft_uoff, ft_string> fm_move_name;
+typedef std::vector<fm_move_name> fm_move_name_vector;
+
+/** a regular file postponed by make_plan(), or a directory containing such files */
+struct fm_move_deferred
+{
+    ft_string source_path, target_path;
+    ft_stat stat;
+    /** directory being moved by move_parallel() that contains this file, or NULL */
+    fm_move_dir * dir;
+};
+typedef std::vector<fm_move_deferred> fm_move_deferred_vector;
+
+/** a small regular file queued by queue_small_file() */
+struct fm_small_file
+{
+    ft_string source_path, target_path;
+    ft_stat stat;
+    /** 0 if copy_small_files() copied it, else error */
+    int err;
+    /** true if copy_small_files() created target file */
+    bool created;
+};
+
+/** small regular files inside the same directory, moved together by move_small_files() using io_uring */
+struct fm_small_batch
+{
+    fm_uring * ring;
+    int source_dir_fd, target_dir_fd;
+    std::vector<fm_small_file> files;
+    /** total length of 'files' */
+    ft_uoff bytes;
+};
+
 /**
  * class performing I/O on POSIX systems
  */
@@ -42,6 +93,54 @@ private:
 
     ft_uoff bytes_copied_since_last_check;
 
+    /** bytes written since last sync(), i.e. possibly not yet accounted in disk stats */
+    ft_uoff bytes_copied_since_last_sync;
+
+    /** total length of files being copied forward by other threads. protected by free_space_mutex */
+    ft_uoff bytes_in_flight;
+
+    /** file descriptors of source_root() and target_root(), used by sync() to call syncfs() */
+    int source_root_fd, target_root_fd;
+
+    /**
+     * set when source file system does not support ioctl(FS_IOC_FIEMAP): physical order falls back on inode order.
+     * accessed atomically, move_parallel() threads may race on it
+     */
+    bool fiemap_unsupported;
+
+    /**
+     * set when target file system does not support fallocate(): fallocate_target() is ignored.
+     * accessed atomically, copy threads may race on it
+     */
+    bool fallocate_unsupported;
+
+    /** set when io_uring is not available: io_uring() is ignored. accessed atomically, threads may race on it */
+    bool uring_unsupported;
+
+    /** io_uring used by sequential move() to move small files */
+    fm_uring uring;
+
+    /** regular files at least this large are moved after all other files, as chosen by make_plan(). 0 means none */
+    ft_uoff defer_min;
+
+    /** regular files postponed by defer_file(), and directories containing them. protected by defer_mutex */
+    fm_move_deferred_vector deferred_files, deferred_dirs;
+    ft_mutex defer_mutex;
+
+    /** source files and directories queued by remove_later(), removed by remove_thread(). NULL if none */
+    fm_remove_queue * remove_queue;
+
+    /** serializes periodic_check_free_space(), enough_free_space() and their data */
+    ft_mutex free_space_mutex;
+
+    enum { HARD_LINK_MUTEX_N = 64 };
+
+    /**
+     * held while moving files and special-devices with multiple links,
+     * so that other threads do not link() to them before they are created.
+     * one per inode stripe, see hard_link_mutex_of()
+     */
+    ft_mutex hard_link_mutex[HARD_LINK_MUTEX_N];
 
     enum {
         /**
@@ -54,20 +153,43 @@ private:
           * (directory, file or special device) even if it contains no actual data.
           */
         APPROX_INODE_COST = 256,
+        /**
+         * unless order() is FC_ORDER_READDIR, read at most this number of entries
+         * from a source directory, sort them and move them, then repeat
+         */
+        ORDER_WINDOW = 65536,
+        /** make_plan() never postpones files smaller than PLAN_DEFER_MIN */
+        PLAN_DEFER_MIN = 1 << 20,
+        /** with io_uring(), regular files at most this large are moved in batches by move_small_files() */
+        SMALL_FILE_MAX = 64 << 10,
+        /** move_small_files() moves at most this number of files at once */
+        SMALL_BATCH_MAX = 64,
     };
 
+    /** return the hard_link_mutex of 'inode'. all links to the same inode get the same one */
+    ft_mutex & hard_link_mutex_of(ft_inode inode);
+
     /**
      * return true if estimated free space is comfortably high enough to write 'bytes_to_write'
      * if first_check is true, does a more conservative estimation, requiring twice more free space than normal
      */
     bool enough_free_space(ft_uoff bytes_to_write = 0, bool first_check = false);
 
+    /** return the free space of the fuller disk, minus the bytes written since last sync() */
+    ft_uoff unflushed_free_space();
+
     /**
-     * call sync(), then call disk_stat() twice: one time on source_root() and another on target_root().
-	 * return error if statvfs() fails or if free disk space becomes critically low
+     * call sync() if needed, then call disk_stat() twice: one time on source_root() and another on target_root().
+     * return error if statvfs() fails or if free disk space becomes critically low
      */
     int check_free_space();
 
+    /**
+     * call sync() if data written since last sync(), and possibly not yet accounted by disk stats,
+     * reached half of free space or could bring free space down to critically low levels
+     */
+    void sync_if_needed();
+
     /**
      * fill 'disk_stat' with information about the file-system containing 'path'.
      * return error if statvfs() fails or if free disk space becomes critically low
@@ -81,14 +203,168 @@ private:
     void try_to_make_free_space(const char * path);
 
     /**
-     * fill 'stat' with information about the file/directory/special-device 'path'
+     * return the directory descriptor to pass to *at() functions for entries inside 'dir':
+     * dir.fd() if *at() functions are available, else AT_FDCWD
      */
-    int stat(const ft_string & path, ft_stat & stat);
+    static int at_fd(const ft_io_posix_dir & dir);
 
     /**
-     * move a single file/socket/device or a whole directory tree
+     * open target directory 'path' and store its descriptor in 'fd', for use with *at() functions.
+     * 'dir_fd' must be the descriptor of its parent directory, or AT_FDCWD.
+     * if *at() functions are not available, sets 'fd' to AT_FDCWD.
+     * if simulate_run(), sets 'fd' to -1
      */
-    int move(const ft_string & source_path, const ft_string & target_path);
+    int open_target_dir(int dir_fd, const ft_string & path, int & fd);
+
+    /** close a directory descriptor returned by open_target_dir() */
+    static void close_dir(int fd);
+
+    /**
+     * fill 'stat' with information about the file/directory/special-device 'path'.
+     * 'dir_fd' must be the descriptor of its parent directory, or AT_FDCWD
+     */
+    int stat(int dir_fd, const ft_string & path, ft_stat & stat);
+
+    /** function executed by the two threads started by move(): thread 0 calls move_tree(), thread 1 remove_thread() */
+    static int move_thread(void * arg, ft_size thread_i);
+
+    /** move the whole source tree into target, sequentially or with move_parallel() */
+    int move_tree();
+
+    /**
+     * remove in background the source files and directories queued by remove_later(),
+     * until move_tree() finished and the queue is empty
+     */
+    int remove_thread();
+
+    /**
+     * queue source file or directory 'path' for removal by remove_thread(), if it is slow to remove.
+     * 'bytes' is the space its removal will release.
+     * if the queue is full, remove its oldest entry before returning.
+     * if no queue exists, remove 'path' immediately
+     */
+    int remove_later(const ft_string & path, ft_uoff bytes, bool is_dir);
+
+    /** remove a source file or directory queued by remove_later() */
+    int remove_task(const fm_remove_task & task);
+
+    /**
+     * remove all source files and directories queued by remove_later(),
+     * and wait until remove_thread() removed the one it is working on.
+     * called when free space is low: the space they use is not free yet
+     */
+    int remove_pending();
+
+    /**
+     * move a single file/socket/device or a whole directory tree.
+     * source_dir_fd and target_dir_fd must be the descriptors of their parent directories, or AT_FDCWD.
+     * if 'batch' is not NULL, a small regular file may be queued in it instead of being moved immediately
+     */
+    int move(int source_dir_fd, const ft_string & source_path, int target_dir_fd, const ft_string & target_path,
+             fm_small_batch * batch = NULL);
+
+    /**
+     * sort 'names' as specified by order(), then move them from source directory 'source_path'
+     * to target directory 'target_path'. source_dir_fd and target_dir_fd must be their descriptors.
+     * if 'batch' is not NULL, small regular files are queued in it
+     */
+    int move_names(int source_dir_fd, const ft_string & source_path, int target_dir_fd, const ft_string & target_path,
+                   fm_move_name_vector & names, fm_small_batch * batch);
+
+    /** sort 'names' as specified by order() */
+    void sort_names(fm_move_name_vector & names) const;
+
+    /**
+     * return the key to sort directory entry 'dirent' by, as specified by order().
+     * dir_fd must be the descriptor of the source directory containing it
+     */
+    ft_uoff order_key(int dir_fd, const ft_io_posix_dirent * dirent);
+
+    /**
+     * set 'key' to the physical offset of the first extent of regular file 'name' inside directory 'dir_fd'.
+     * if check_type is true, first check that 'name' is actually a regular file.
+     * return false if it is not, if it has no extents or if ioctl(FS_IOC_FIEMAP) fails
+     */
+    bool physical_key(int dir_fd, const char * name, bool check_type, ft_uoff & key);
+
+    /**
+     * append to 'sizes' the length of each regular file inside source directory 'path', recursively,
+     * in the same order move() will find them. files with multiple links are appended only once.
+     * 'dir_fd' must be the descriptor of its parent directory, or AT_FDCWD
+     */
+    int plan_scan(int dir_fd, const ft_string & path, std::vector<ft_uoff> & sizes, std::set<ft_inode> & links);
+
+    /**
+     * return true if target file system is inside a loop-file inside source file system,
+     * i.e. removing source files does not increase the free space available for target
+     */
+    bool shares_free_space() const;
+
+    /**
+     * if target file system is inside a loop-file, store the loop-file path in 'path' and return true.
+     * only implemented on Linux, elsewhere always returns false
+     */
+    bool loop_file(ft_string & path) const;
+
+    /**
+     * if target file system is inside a loop-file, flush it and log how many extents the loop-file has:
+     * the fewer they are, the faster fsremap will be
+     */
+    void report_loop_extents();
+
+    /**
+     * if make_plan() chose to postpone regular file 'source_path', add it to deferred_files and return true.
+     * 'dir' is the directory being moved by move_parallel() that contains it, or NULL
+     */
+    bool defer_file(fm_move_job * job, fm_move_dir * dir, const ft_string & source_path, const ft_string & target_path,
+                    const ft_stat & stat);
+
+    /**
+     * move the regular files postponed by defer_file(), smallest first,
+     * then finish the directories containing them
+     */
+    int move_deferred(fm_move_job * job);
+
+    /**
+     * move the whole source tree into target using thread_n() threads.
+     * each thread has its own queue of tasks (scan a directory or move some of its entries)
+     * and steals tasks from other threads' queues when its own queue is empty
+     */
+    int move_parallel();
+
+    /** function executed by each thread started by move_parallel() */
+    static int move_parallel_thread(void * arg, ft_size thread_i);
+
+    /**
+     * move a single file/socket/device, or queue a task to move a whole directory tree.
+     * called by move_parallel() and its threads. if 'batch' is not NULL, a small regular file may be queued in it
+     */
+    int move_parallel_entry(fm_move_job & job, ft_size thread_i, fm_move_dir * parent,
+                            int source_dir_fd, const ft_string & source_path,
+                            int target_dir_fd, const ft_string & target_path, fm_small_batch * batch = NULL);
+
+    /**
+     * create target directory, then read source directory entries and queue tasks to move them.
+     * if our queue is already long, move the entries directly instead of queuing them
+     */
+    int move_parallel_scan(fm_move_job & job, ft_size thread_i, fm_move_dir & dir);
+
+    /** open source and target directories of 'dir', then move some of its entries */
+    int move_parallel_names(fm_move_job & job, ft_size thread_i, fm_move_dir & dir,
+                            fm_move_name_vector & names);
+
+    /**
+     * sort some entries of source directory 'dir' as specified by order(), then move them.
+     * source_dir_fd and target_dir_fd must be the descriptors of its source and target directories
+     */
+    int move_parallel_names(fm_move_job & job, ft_size thread_i, fm_move_dir & dir,
+                            fm_move_name_vector & names, int source_dir_fd, int target_dir_fd);
+
+    /**
+     * called when a task on 'dir' finished: if it was the last pending work on 'dir',
+     * copy its stat to target directory, remove source directory and repeat on its parent
+     */
+    int move_parallel_release(fm_move_job & job, fm_move_dir * dir);
 
     /**
      * try to rename a file, directory or special-device from 'source_path' to 'target_path'.
@@ -98,30 +374,182 @@ private:
     /**
      * move the single regular file 'source_path' to 'target_path'.
      */
-    int move_file(const ft_string & source_path, const ft_stat & source_stat, const ft_string & target_path);
+    int move_file(int source_dir_fd, const ft_string & source_path, const ft_stat & source_stat,
+                  int target_dir_fd, const ft_string & target_path);
 
     /**
-     * move the single special-device 'source_path' to 'target_path'.
+     * open 'ring' to move small files with io_uring.
+     * if io_uring is not available, log it only the first time and return false
+     */
+    bool open_uring(fm_uring & ring);
+
+    /**
+     * if 'batch' is not NULL and regular file 'source_path' is small, queue it in 'batch'
+     * and call move_small_files() when batch is full. else move it immediately with move_file()
      */
-    int move_special(const ft_string & source_path, const ft_stat & source_stat, const ft_string & target_path);
+    int queue_small_file(fm_small_batch * batch, int source_dir_fd, const ft_string & source_path, const ft_stat & stat,
+                         int target_dir_fd, const ft_string & target_path);
 
     /**
-     * move the single directory 'source_path' to 'target_path'.
+     * move all the small files queued in 'batch': copy their contents with copy_small_files(),
+     * copy their stat, then remove them with remove_small_files().
+     * files that cannot be copied this way are moved with move_file()
      */
-    int move_dir(const ft_string & source_path, const ft_stat & source_stat, const ft_string & target_path);
+    int move_small_files(fm_small_batch & batch);
+
+    /**
+     * copy the contents of all files in 'batch' with a single io_uring submission:
+     * for each file, a linked chain of open source, create target, read and write.
+     * sets the 'err' and 'created' fields of each file
+     */
+    void copy_small_files(fm_small_batch & batch);
+
+    /** remove the source files listed in 'index' with a single io_uring submission */
+    int remove_small_files(fm_small_batch & batch, const std::vector<ft_size> & index);
+
+    /**
+     * move the single special-device 'source_path' to 'target_path'.
+     */
+    int move_special(int source_dir_fd, const ft_string & source_path, const ft_stat & source_stat,
+                     int target_dir_fd, const ft_string & target_path);
 
     /**
      * forward or backward copy file/stream contents from in_fd to out_fd.
      *
-     * if disk space is low, we copy backward and progressively truncate in_fd to conserve space:
+     * if disk space is low, we copy forward and progressively punch holes in in_fd to conserve space.
+     * if punching holes is not supported, we copy backward and progressively truncate in_fd:
      * results in heavy fragmentation on target file, but at least we can continue
      */
     int copy_stream(int in_fd, int out_fd, const ft_stat & stat, const char * source, const char * target);
 
+    /**
+     * forward copy file contents from in_fd to out_fd in large chunks, skipping holes.
+     * after each chunk is safely written to out_fd, punch a hole in in_fd to release the space it used.
+     * used when free space is low: reads and writes are sequential, unlike copy_stream_backward()
+     */
+    int copy_stream_punch(int in_fd, int out_fd, const ft_segment_vector & segments, ft_off file_size,
+                          const char * source, const char * target);
+
+    /** return the length of next chunk to copy in copy_stream_punch() */
+    ft_off punch_chunk_length();
+
+    /**
+     * backward copy file contents from in_fd to out_fd in small chunks, skipping holes,
+     * and progressively truncate in_fd to release the space used by data already copied.
+     * used when free space is low and copy_stream_punch() is not supported.
+     * results in heavy fragmentation on target file, but at least we can continue
+     */
+    int copy_stream_backward(int in_fd, int out_fd, ft_segment_vector & segments, ft_off file_size,
+                             const char * source, const char * target);
+
     /**
      * forward copy file/stream contents from in_fd to out_fd.
+     * only the data segments reported by data_segments() are read, holes between them are re-created in target.
+     * segments known to contain no holes are copied with copy_stream_kernel(), the rest with copy_stream_user()
+     */
+    int copy_stream_forward(int in_fd, int out_fd, const ft_stat & stat, const char * source, const char * target);
+
+    /**
+     * fill 'segments' with the [start, end) ranges of file 'fd' that contain data, using lseek(SEEK_DATA/SEEK_HOLE).
+     * sets 'exact' to true if segments were found this way and thus contain no holes.
+     * if SEEK_DATA/SEEK_HOLE are not supported, sets 'exact' to false and fills 'segments'
+     * with the single range [0, length)
+     */
+    int data_segments(int fd, ft_off length, ft_segment_vector & segments, bool & exact, const char * path);
+
+    /**
+     * forward copy up to 'length' bytes from in_fd to out_fd through a user-space buffer,
+     * re-creating any zeroed block as a hole in target.
+     * returns 0 for success, else error.
+     * on return, 'length' will contain the number of bytes NOT copied because end-of-file was reached
+     */
+    int copy_stream_user(int in_fd, int out_fd, ft_uoff & length, const char * source, const char * target);
+
+    /**
+     * same as copy_stream_user() above, using caller-provided 'buf' of 'buf_size' bytes.
+     * buf_size must be a multiple of APPROX_BLOCK_SIZE
+     */
+    int copy_stream_user(int in_fd, int out_fd, ft_uoff & length, char * buf, ft_size buf_size,
+                         const char * source, const char * target);
+
+    /**
+     * forward copy 'segments' of file in_fd to out_fd using copy_thread_n() threads,
+     * which copy ranges of each segment concurrently at explicit offsets with copy_range().
+     * if 'kernel_copy', segments contain no holes to re-create.
+     * on return, 'file_size' is reduced if source file turned out to be shorter than expected
+     */
+    int copy_stream_parallel(int in_fd, int out_fd, const ft_segment_vector & segments, bool kernel_copy,
+                             ft_off & file_size, const char * source, const char * target);
+
+    /** function executed by each thread started by copy_stream_parallel() */
+    static int copy_parallel_thread(void * arg, ft_size thread_i);
+
+    /**
+     * copy up to 'length' bytes from in_fd at 'offset' to out_fd at the same offset, without using file offsets.
+     * if 'kernel_copy', try copy_file_range() first. else, or if not available, use pread() and pwrite()
+     * through 'buf' of 'buf_size' bytes, skipping zeroed blocks so that they remain holes in target.
+     * returns 0 for success, else error.
+     * on return, 'length' will contain the number of bytes NOT copied because end-of-file was reached
+     */
+    int copy_range(int in_fd, int out_fd, ft_off offset, ft_uoff & length, bool kernel_copy, char * buf, ft_size buf_size,
+                   const char * source, const char * target);
+
+    /**
+     * allocate a buffer of io_buffer_size() bytes, aligned as required to write bypassing the page cache.
+     * return NULL if not supported or out of memory. release it with free()
+     */
+    char * alloc_direct_buffer() const;
+
+    /**
+     * forward copy up to 'length' bytes from in_fd to out_fd inside the kernel, without user-space buffers:
+     * try copy_file_range(), then sendfile(), then splice() through a pipe.
+     * returns 0 for success, else error.
+     * on return, 'length' will contain the number of bytes NOT copied, because no kernel method is available
+     * or because end-of-file was reached: caller must try to copy them in user space
+     */
+    int copy_stream_kernel(int in_fd, int out_fd, ft_uoff & length, const char * source, const char * target);
+
+    /**
+     * allocate the space for 'segments' of file pointed by descriptor without changing its length,
+     * so that the file system can place them in a few large extents before we write them.
+     * failures are not errors: they only mean the file may be more fragmented
      */
-    int copy_stream_forward(int in_fd, int out_fd, const char * source, const char * target);
+    void fd_preallocate(int fd, const ft_segment_vector & segments, const char * path);
+
+    /**
+     * return true if fd_punch_hole() is supported on fd.
+     * probes by punching a hole past the end of file, which does not change the file
+     */
+    static bool fd_can_punch_hole(int fd, ft_off file_size);
+
+    /**
+     * punch a hole in file pointed by descriptor, releasing the space used by the specified range.
+     * file length is not changed
+     */
+    int fd_punch_hole(int fd, ft_off offset, ft_off length, const char * path);
+
+    /**
+     * flush to disk the data written to file pointed by descriptor
+     */
+    int fd_sync(int fd, const char * path);
+
+    /**
+     * start writing back to disk the specified range of file pointed by descriptor, without waiting for it.
+     * keeps dirty data from piling up, so that later calls to sync() are faster
+     */
+    static void fd_writeback(int fd, ft_off offset, ft_off length);
+
+    /**
+     * set or clear O_DIRECT on file pointed by descriptor, i.e. write bypassing the page cache.
+     * return true if the flag is now as requested and was not before
+     */
+    static bool fd_set_direct(int fd, bool direct);
+
+    /**
+     * tell the kernel the specified range of file pointed by descriptor will not be accessed again,
+     * so that the page cache can drop it
+     */
+    static void fd_drop_cache(int fd, ft_off offset, ft_off length);
 
     /**
      * truncate file pointed by descriptor to specified length
@@ -166,16 +594,26 @@ private:
      */
     int full_write(int out_fd, const char * data, ft_size len, const char * target_path);
 
+    /**
+     * same as full_read(), reading at 'offset' without using or changing the file offset
+     */
+    int full_pread(int in_fd, char * data, ft_size & len, ft_off offset, const char * source_path);
+
+    /**
+     * same as full_write(), writing at 'offset' without using or changing the file offset
+     */
+    int full_pwrite(int out_fd, const char * data, ft_size len, ft_off offset, const char * target_path);
+
     /**
      * check inode_cache for hard links and recreate them.
      * must be called if and only if stat.st_nlink > 1.
      *
      * returns EAGAIN if inode was not in inode_cache
      */
-    int hard_link(const ft_stat & stat, const ft_string & target_path);
+    int hard_link(const ft_stat & stat, int target_dir_fd, const ft_string & target_path);
 
     /** create a target directory */
-    int create_dir(const ft_string & path);
+    int create_dir(int dir_fd, const ft_string & path);
 
     /**
      * return true if path is the source directory lost+found.
@@ -190,42 +628,63 @@ private:
     bool is_target_lost_found(const ft_string & path) const;
 
 protected:
-    /** call ::sync(). slow, but needed to get accurate disk stats when loop devices are involved */
+    /**
+     * flush target file system, then source file system, with syncfs():
+     * needed to get accurate disk stats when loop devices are involved.
+     * falls back on ::sync() if syncfs() is not available
+     */
     virtual void sync();
 
     /**
      * add bytes_just_written to bytes_copied_since_last_check.
      *
-     * if enough_free_space() returns false,
-     * also call check_free_space() and reset bytes_copied_since_last_check to zero
+     * if enough_free_space() returns false, also call remove_pending(),
+     * check_free_space() and reset bytes_copied_since_last_check to zero
      */
     int periodic_check_free_space(ft_uoff bytes_just_written = APPROX_INODE_COST, ft_uoff bytes_to_write = 0);
 
+    /**
+     * scan source tree and predict how many bytes copy_stream() will copy forward
+     * and how many with the slower punch hole or backward copy, as free space evolves.
+     * if moving large files after all other files improves the prediction, set defer_min accordingly
+     */
+    virtual int make_plan();
+
+    /** return true if small files can be moved in batches by move_small_files(), i.e. if io_uring() is set */
+    virtual bool can_use_uring() const;
+
+    /**
+     * return the name to pass to *at() functions together with 'dir_fd' to access 'path':
+     * its last component if dir_fd is the descriptor of its parent directory, else the whole path
+     */
+    static const char * at_name(int dir_fd, const char * path);
+
     /**
      * copy the permission bits, owner/group and timestamps from 'stat' to 'target'
      */
-    int copy_stat(const char * target, const ft_stat & stat);
+    int copy_stat(int dir_fd, const char * target, const ft_stat & stat);
 
     /**
      * copy the contents of single regular file 'source_path' to 'target_path'.
      */
-    virtual int copy_file_contents(const ft_string & source_path, const ft_stat & source_stat, const ft_string & target_path);
+    virtual int copy_file_contents(int source_dir_fd, const ft_string & source_path, const ft_stat & source_stat,
+                                   int target_dir_fd, const ft_string & target_path);
 
     /**
      * remove a regular file inside source directory
      */
-    virtual int remove_file(const char * source_path);
+    virtual int remove_file(int dir_fd, const char * source_path);
 
     /**
      * remove a special file inside source directory
      */
-    virtual int remove_special(const char * source_path);
+    virtual int remove_special(int dir_fd, const char * source_path);
 
     /**
      * remove a source directory, which must be empty
      * exception: will not remove '/lost+found' directory inside source_root()
      */
-    virtual int remove_dir(const ft_string & path);
+    virtual int remove_dir(int dir_fd, const ft_string & path);
 
 public:
     /** constructor */
@@ -33,7 +33,7 @@
 #endif
 
 #ifdef FT_HAVE_FCNTL_H
-#include <fcntl.h>         // for open(), fallocate()
+#include <fcntl.h>         // for openat(), fallocate()
 #endif
 #ifdef FT_HAVE_SYS_STAT_H
 # include <sys/stat.h>     // for   "
@@ -47,6 +47,7 @@
 
 #include "../log.hh"       // for ff_log()
 #include "io_prealloc.hh"  // for fm_io_prealloc, FT_HAVE_FM_IO_IO_PREALLOC
+#include "util_posix.hh"   // for openat()
 
 
 #ifdef FT_HAVE_FM_IO_IO_PREALLOC
@@ -78,12 +79,28 @@ int fm_io_prealloc::open(const fm_args & args)
 void fm_io_prealloc::sync()
 { }
 
+/**
+ * does nothing: fr_io_prealloc never copies file contents, thus no file needs to be postponed.
+ */
+int fm_io_prealloc::make_plan()
+{
+    return 0;
+}
+
+/**
+ * return false: fr_io_prealloc never copies file contents, thus it has no use for io_uring.
+ */
+bool fm_io_prealloc::can_use_uring() const
+{
+    return false;
+}
+
 /**
  * remove the regular file 'source_path'
  * Since we are preallocating, we can (and will) avoid any modification
  * to the source file system. Thus this method does nothing.
  */
-int fm_io_prealloc::remove_file(const char * FT_ARG_UNUSED(source_path))
+int fm_io_prealloc::remove_file(int FT_ARG_UNUSED(dir_fd), const char * FT_ARG_UNUSED(source_path))
 {
     return 0;
 }
@@ -93,7 +110,7 @@ int fm_io_prealloc::remove_file(const char * FT_ARG_UNUSED(source_path))
  * Since we are preallocating, we can (and will) avoid any modification
  * to the source file system. Thus this method does nothing.
  */
-int fm_io_prealloc::remove_special(const char * FT_ARG_UNUSED(source_path))
+int fm_io_prealloc::remove_special(int FT_ARG_UNUSED(dir_fd), const char * FT_ARG_UNUSED(source_path))
 {
     return 0;
 }
@@ -104,7 +121,7 @@ int fm_io_prealloc::remove_special(const char * FT_ARG_UNUSED(source_path))
  * Since we are preallocating, we can (and will) avoid any modification
  * to the source file system. Thus this method does nothing.
  */
-int fm_io_prealloc::remove_dir(const ft_string & path)
+int fm_io_prealloc::remove_dir(int FT_ARG_UNUSED(dir_fd), const ft_string & path)
 {
     ff_log(FC_TRACE, 0, "remove_dir()   `%s'", path.c_str());
     return 0;
@@ -114,7 +131,8 @@ int fm_io_prealloc::remove_dir(const ft_string & path)
  * copy the contents of regular file 'source_path' to 'target_path'.
  * Since we are preallocating, we just preallocate enough blocks inside 'target_path'
  */
-int fm_io_prealloc::copy_file_contents(const ft_string & FT_ARG_UNUSED(source_path), const ft_stat & source_stat, const ft_string & target_path)
+int fm_io_prealloc::copy_file_contents(int FT_ARG_UNUSED(source_dir_fd), const ft_string & FT_ARG_UNUSED(source_path),
+                                       const ft_stat & source_stat, int target_dir_fd, const ft_string & target_path)
 {
     const char * target = target_path.c_str();
     int err = 0;
@@ -122,7 +140,7 @@ int fm_io_prealloc::copy_file_contents(const ft_string & FT_ARG_UNUSED(source_pa
 #ifndef O_EXCL
 # define O_EXCL 0
 #endif
-    int out_fd = ::open(target, O_CREAT|O_WRONLY|O_TRUNC|O_EXCL, 0600);
+    int out_fd = ::openat(target_dir_fd, at_name(target_dir_fd, target), O_CREAT|O_WRONLY|O_TRUNC|O_EXCL, 0600);
     if (out_fd < 0)
         err = ff_log(FC_ERROR, errno, "failed to create target file `%s'", target);
 
@@ -144,7 +162,7 @@ int fm_io_prealloc::copy_file_contents(const ft_string & FT_ARG_UNUSED(source_pa
         (void) ::close(out_fd);
 
     if (err == 0)
-        err = this->copy_stat(target, source_stat);
+        err = this->copy_stat(target_dir_fd, target, source_stat);
 
     return err;
 }
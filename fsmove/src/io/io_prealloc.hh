@@ -50,25 +50,36 @@ protected:
      */
     virtual void sync();
 
+    /**
+     * does nothing: fr_io_prealloc never copies file contents, thus no file needs to be postponed.
+     */
+    virtual int make_plan();
+
+    /**
+     * return false: fr_io_prealloc never copies file contents, thus it has no use for io_uring.
+     */
+    virtual bool can_use_uring() const;
+
     /**
      * copy the contents of single regular file 'source_path' to 'target_path'.
      * Since we are preallocating, we just preallocate enough blocks inside 'target_path'
      */
-    virtual int copy_file_contents(const ft_string & source_path, const ft_stat & source_stat, const ft_string & target_path);
+    virtual int copy_file_contents(int source_dir_fd, const ft_string & source_path, const ft_stat & source_stat,
+                                   int target_dir_fd, const ft_string & target_path);
 
     /**
      * remove a regular file inside source directory
      * Since we are preallocating, we can (and will) avoid any modification
      * to the source file system. Thus this method does nothing.
      */
-    virtual int remove_file(const char * source_path);
+    virtual int remove_file(int dir_fd, const char * source_path);
 
     /**
      * remove a special file inside source directory
      * Since we are preallocating, we can (and will) avoid any modification
      * to the source file system. Thus this method does nothing.
      */
-    virtual int remove_special(const char * source_path);
+    virtual int remove_special(int dir_fd, const char * source_path);
 
     /**
      * remove a source directory, which must be empty
@@ -76,7 +87,7 @@ protected:
      * Since we are preallocating, we can (and will) avoid any modification
      * to the source file system. Thus this method does nothing.
      */
-    virtual int remove_dir(const ft_string & path);
+    virtual int remove_dir(int dir_fd, const ft_string & path);
 
 public:
     /** default constructor. */
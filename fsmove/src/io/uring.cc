@@ -0,0 +1,335 @@
+/*
+ * fstransform - transform a file-system to another file-system type,
+ *               preserving its contents and without the need for a backup
+ *
+ * Copyright (C) 2011-2012 Massimiliano Ghilardi
+ *
+ *     This program is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as published by
+ *     the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     This program is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public License
+ *     along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * io/uring.cc
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: max
+ */
+
+#include "../first.hh"
+
+#if defined(FT_HAVE_ERRNO_H)
+# include <errno.h>        // for errno, ENOSYS, ENOMEM, EINTR
+#elif defined(FT_HAVE_CERRNO)
+# include <cerrno>         // for errno, ENOSYS, ENOMEM, EINTR
+#endif
+#if defined(FT_HAVE_STDLIB_H)
+# include <stdlib.h>       // for malloc(), free()
+#elif defined(FT_HAVE_CSTDLIB)
+# include <cstdlib>        // for malloc(), free()
+#endif
+#if defined(FT_HAVE_STRING_H)
+# include <string.h>       // for memset()
+#elif defined(FT_HAVE_CSTRING)
+# include <cstring>        // for memset()
+#endif
+
+#ifdef FT_HAVE_UNISTD_H
+# include <unistd.h>       // for syscall(), close()
+#endif
+#ifdef FT_HAVE_SYS_MMAN_H
+# include <sys/mman.h>     // for mmap(), munmap()
+#endif
+
+#include <vector>          // for std::vector<T>
+
+#include "uring.hh"        // for fm_uring, FT_IO_URING
+
+
+FT_IO_NAMESPACE_BEGIN
+
+#ifdef FT_IO_URING
+/** read a ring index written by the kernel */
+static FT_INLINE unsigned fm_uring_load(const unsigned * ptr)
+{
+    return __atomic_load_n(ptr, __ATOMIC_ACQUIRE);
+}
+
+/** write a ring index read by the kernel */
+static FT_INLINE void fm_uring_store(unsigned * ptr, unsigned value)
+{
+    __atomic_store_n(ptr, value, __ATOMIC_RELEASE);
+}
+#endif /* FT_IO_URING */
+
+
+/** default constructor */
+fm_uring::fm_uring()
+    : this_buf(NULL), this_buf_len(0), this_file_n(0), this_fd(-1)
+#ifdef FT_IO_URING
+    , sq_map(MAP_FAILED), cq_map(MAP_FAILED), sqes(NULL), cqes(NULL), sq_map_len(0), cq_map_len(0), sqes_len(0),
+      sq_head(NULL), sq_tail(NULL), sq_array(NULL), cq_head(NULL), cq_tail(NULL),
+      sq_mask(0), sq_entries(0), cq_mask(0), sq_pending_tail(0)
+#endif
+{ }
+
+/** destructor, calls close() */
+fm_uring::~fm_uring()
+{
+    close();
+}
+
+/**
+ * create an io_uring with at least 'entries' submission queue entries,
+ * 'file_n' empty direct descriptors and a buffer of 'buf_len' bytes.
+ * return 0 if success, else error
+ */
+int fm_uring::open(unsigned entries, unsigned file_n, ft_size buf_len)
+{
+    close();
+#ifdef FT_IO_URING
+    struct io_uring_params params;
+    memset(& params, '\0', sizeof(params));
+
+    int err = 0;
+    do {
+        if ((this_fd = (int) syscall(__NR_io_uring_setup, entries, & params)) < 0) {
+            err = errno;
+            break;
+        }
+        /* requests linked after IORING_OP_OPENAT must look up its direct descriptor only when executed */
+        if (!(params.features & IORING_FEAT_LINKED_FILE)) {
+            err = ENOSYS;
+            break;
+        }
+        sq_map_len = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cq_map_len = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+
+        /* since Linux 5.4, submission and completion rings can be mapped with a single mmap() */
+        if (params.features & IORING_FEAT_SINGLE_MMAP)
+            sq_map_len = cq_map_len = sq_map_len > cq_map_len ? sq_map_len : cq_map_len;
+
+        sq_map = mmap(NULL, sq_map_len, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, this_fd, IORING_OFF_SQ_RING);
+        if (sq_map == MAP_FAILED) {
+            err = errno;
+            break;
+        }
+        if (params.features & IORING_FEAT_SINGLE_MMAP)
+            cq_map = sq_map;
+        else if ((cq_map = mmap(NULL, cq_map_len, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE,
+                                this_fd, IORING_OFF_CQ_RING)) == MAP_FAILED)
+        {
+            err = errno;
+            break;
+        }
+        sqes_len = params.sq_entries * sizeof(struct io_uring_sqe);
+        void * sqes_map = mmap(NULL, sqes_len, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, this_fd, IORING_OFF_SQES);
+        if (sqes_map == MAP_FAILED) {
+            err = errno;
+            break;
+        }
+        sqes = (struct io_uring_sqe *) sqes_map;
+
+        char * sq = (char *) sq_map, * cq = (char *) cq_map;
+        sq_head  = (unsigned *) (sq + params.sq_off.head);
+        sq_tail  = (unsigned *) (sq + params.sq_off.tail);
+        sq_array = (unsigned *) (sq + params.sq_off.array);
+        sq_mask  = * (unsigned *) (sq + params.sq_off.ring_mask);
+        sq_entries = params.sq_entries;
+        cq_head  = (unsigned *) (cq + params.cq_off.head);
+        cq_tail  = (unsigned *) (cq + params.cq_off.tail);
+        cq_mask  = * (unsigned *) (cq + params.cq_off.ring_mask);
+        cqes     = (struct io_uring_cqe *) (cq + params.cq_off.cqes);
+        sq_pending_tail = * sq_tail;
+
+        /* submission queue entry i is always at sq_array[i] */
+        for (unsigned i = 0; i < sq_entries; i++)
+            sq_array[i] = i;
+
+        if (!probe_ops()) {
+            err = ENOSYS;
+            break;
+        }
+
+        /* direct descriptors are allocated by IORING_OP_OPENAT into empty slots */
+        struct io_uring_rsrc_register files;
+        memset(& files, '\0', sizeof(files));
+        files.nr = file_n;
+        files.flags = IORING_RSRC_REGISTER_SPARSE;
+        if (syscall(__NR_io_uring_register, this_fd, IORING_REGISTER_FILES2, & files, sizeof(files)) != 0) {
+            err = errno;
+            break;
+        }
+        this_file_n = file_n;
+
+        if (buf_len != 0 && (this_buf = (char *) malloc(buf_len)) == NULL) {
+            err = ENOMEM;
+            break;
+        }
+        this_buf_len = buf_len;
+    } while (0);
+
+    if (err != 0)
+        close();
+    return err;
+#else
+    (void) entries;
+    (void) file_n;
+    (void) buf_len;
+    return ENOSYS;
+#endif /* FT_IO_URING */
+}
+
+#ifdef FT_IO_URING
+/** return true if kernel supports all operations used by fsmove */
+bool fm_uring::probe_ops()
+{
+    enum { FC_PROBE_OPS = 256 };
+    std::vector<char> buf(sizeof(struct io_uring_probe) + FC_PROBE_OPS * sizeof(struct io_uring_probe_op));
+    struct io_uring_probe * probe = (struct io_uring_probe *) & buf[0];
+
+    if (syscall(__NR_io_uring_register, this_fd, IORING_REGISTER_PROBE, probe, (unsigned) FC_PROBE_OPS) != 0)
+        return false;
+
+    static const unsigned char op[] = { IORING_OP_OPENAT, IORING_OP_READ, IORING_OP_WRITE, IORING_OP_UNLINKAT };
+    for (ft_size i = 0; i < sizeof(op) / sizeof(op[0]); i++) {
+        if (op[i] > probe->last_op || !(probe->ops[op[i]].flags & IO_URING_OP_SUPPORTED))
+            return false;
+    }
+    return true;
+}
+#endif /* FT_IO_URING */
+
+/** close this io_uring, closing all its direct descriptors */
+void fm_uring::close()
+{
+#ifdef FT_IO_URING
+    if (sqes != NULL)
+        (void) munmap(sqes, sqes_len);
+    if (cq_map != MAP_FAILED && cq_map != sq_map)
+        (void) munmap(cq_map, cq_map_len);
+    if (sq_map != MAP_FAILED)
+        (void) munmap(sq_map, sq_map_len);
+    sq_map = cq_map = MAP_FAILED;
+    sqes = NULL;
+    cqes = NULL;
+    sq_map_len = cq_map_len = sqes_len = 0;
+    sq_head = sq_tail = sq_array = cq_head = cq_tail = NULL;
+    sq_mask = sq_entries = cq_mask = sq_pending_tail = 0;
+#endif
+    if (this_fd >= 0)
+        (void) ::close(this_fd);
+    this_fd = -1;
+    this_file_n = 0;
+
+    free(this_buf);
+    this_buf = NULL;
+    this_buf_len = 0;
+}
+
+/**
+ * return next free submission queue entry, filled with zeroes,
+ * or NULL if queue is full: call submit() to make room
+ */
+struct io_uring_sqe * fm_uring::get_sqe()
+{
+#ifdef FT_IO_URING
+    if (sq_pending_tail - fm_uring_load(sq_head) >= sq_entries)
+        return NULL;
+
+    struct io_uring_sqe * sqe = & sqes[sq_pending_tail++ & sq_mask];
+    memset(sqe, '\0', sizeof(* sqe));
+    return sqe;
+#else
+    return NULL;
+#endif
+}
+
+/**
+ * pass to the kernel all the entries returned by get_sqe(),
+ * and wait until at least 'wait_n' completions are available.
+ * return 0 if success, else error
+ */
+int fm_uring::submit(unsigned wait_n)
+{
+#ifdef FT_IO_URING
+    unsigned submit_n = sq_pending_tail - * sq_tail;
+    fm_uring_store(sq_tail, sq_pending_tail);
+
+    for (;;) {
+        long ret = syscall(__NR_io_uring_enter, this_fd, submit_n, wait_n, wait_n != 0 ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+        if (ret < 0) {
+            if (errno == EINTR)
+                continue;
+            return errno;
+        }
+        /* kernel may consume fewer entries than requested: submit the rest */
+        if ((unsigned) ret >= submit_n)
+            break;
+        submit_n -= (unsigned) ret;
+    }
+    /*
+     * io_uring_enter() can return before 'wait_n' completions are available,
+     * for example if interrupted by a signal or by SIGSTOP: wait again for the missing ones
+     */
+    while (fm_uring_load(cq_tail) - * cq_head < wait_n) {
+        if (syscall(__NR_io_uring_enter, this_fd, 0, wait_n, IORING_ENTER_GETEVENTS, NULL, 0) < 0 && errno != EINTR)
+            return errno;
+    }
+    return 0;
+#else
+    (void) wait_n;
+    return ENOSYS;
+#endif
+}
+
+/**
+ * get next completion: set 'user_data' and 'res' and return true,
+ * or return false if no completion is available
+ */
+bool fm_uring::next_cqe(ft_u64 & user_data, int & res)
+{
+#ifdef FT_IO_URING
+    unsigned head = * cq_head;
+    if (head == fm_uring_load(cq_tail))
+        return false;
+
+    const struct io_uring_cqe & cqe = cqes[head & cq_mask];
+    user_data = cqe.user_data;
+    res = cqe.res;
+    fm_uring_store(cq_head, head + 1);
+    return true;
+#else
+    (void) user_data;
+    (void) res;
+    return false;
+#endif
+}
+
+/** close all direct descriptors, leaving their slots empty. return 0 if success, else error */
+int fm_uring::close_files()
+{
+#ifdef FT_IO_URING
+    if (this_file_n == 0)
+        return 0;
+    std::vector<int> fds(this_file_n, -1);
+    struct io_uring_files_update update;
+    memset(& update, '\0', sizeof(update));
+    update.fds = (ft_u64) (unsigned long) & fds[0];
+
+    if (syscall(__NR_io_uring_register, this_fd, IORING_REGISTER_FILES_UPDATE, & update, this_file_n) < 0)
+        return errno;
+    return 0;
+#else
+    return ENOSYS;
+#endif
+}
+
+FT_IO_NAMESPACE_END
@@ -0,0 +1,141 @@
+/*
+ * fstransform - transform a file-system to another file-system type,
+ *               preserving its contents and without the need for a backup
+ *
+ * Copyright (C) 2011-2012 Massimiliano Ghilardi
+ *
+ *     This program is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as published by
+ *     the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     This program is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public License
+ *     along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * io/uring.hh
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: max
+ */
+
+#ifndef FSMOVE_IO_URING_HH
+#define FSMOVE_IO_URING_HH
+
+#include "../types.hh"       // for ft_size, ft_u64
+
+#ifdef FT_HAVE_LINUX_IO_URING_H
+# include <linux/io_uring.h> // for struct io_uring_sqe, struct io_uring_params, IORING_*
+#endif
+#ifdef FT_HAVE_SYS_SYSCALL_H
+# include <sys/syscall.h>    // for __NR_io_uring_setup, __NR_io_uring_enter, __NR_io_uring_register
+#endif
+
+/*
+ * io_uring is used through raw system calls, without liburing.
+ * it requires sparse tables of direct descriptors and linked requests using them, i.e. Linux >= 5.19,
+ * and compiler builtins for atomic loads and stores on the rings shared with the kernel
+ */
+#if defined(FT_HAVE_SYSCALL) && defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter) \
+    && defined(__NR_io_uring_register) && defined(IORING_RSRC_REGISTER_SPARSE) && defined(IORING_FEAT_LINKED_FILE) \
+    && defined(__ATOMIC_ACQUIRE)
+# define FT_IO_URING
+#else
+struct io_uring_sqe;
+#endif
+
+FT_IO_NAMESPACE_BEGIN
+
+/**
+ * minimal io_uring instance: a submission queue, a completion queue,
+ * a table of direct descriptors and a buffer for the data they read and write.
+ * an instance must be used by a single thread at a time.
+ * if io_uring is not supported, open() always fails with ENOSYS
+ */
+class fm_uring
+{
+private:
+    char * this_buf;
+    ft_size this_buf_len;
+    unsigned this_file_n;
+    int this_fd;
+
+#ifdef FT_IO_URING
+    void * sq_map, * cq_map;
+    struct io_uring_sqe * sqes;
+    struct io_uring_cqe * cqes;
+    ft_size sq_map_len, cq_map_len, sqes_len;
+
+    unsigned * sq_head, * sq_tail, * sq_array, * cq_head, * cq_tail;
+    unsigned sq_mask, sq_entries, cq_mask;
+    /** entries filled by get_sqe() up to sq_pending_tail, not yet passed to the kernel */
+    unsigned sq_pending_tail;
+
+    /** return true if kernel supports all operations used by fsmove */
+    bool probe_ops();
+#endif /* FT_IO_URING */
+
+    /** cannot call copy constructor */
+    fm_uring(const fm_uring &);
+
+    /** cannot call assignment operator */
+    const fm_uring & operator=(const fm_uring &);
+
+public:
+    /** default constructor */
+    fm_uring();
+
+    /** destructor, calls close() */
+    ~fm_uring();
+
+    FT_INLINE bool is_open() const { return this_fd >= 0; }
+
+    /**
+     * create an io_uring with at least 'entries' submission queue entries,
+     * 'file_n' empty direct descriptors and a buffer of 'buf_len' bytes.
+     * return 0 if success, else error
+     */
+    int open(unsigned entries, unsigned file_n, ft_size buf_len);
+
+    /** close this io_uring, closing all its direct descriptors */
+    void close();
+
+    /** return the buffer allocated by open() */
+    FT_INLINE char * buf() const { return this_buf; }
+
+    /** return the length of the buffer allocated by open() */
+    FT_INLINE ft_size buf_len() const { return this_buf_len; }
+
+    /** return the number of direct descriptors */
+    FT_INLINE unsigned file_n() const { return this_file_n; }
+
+    /**
+     * return next free submission queue entry, filled with zeroes,
+     * or NULL if queue is full: call submit() to make room
+     */
+    struct io_uring_sqe * get_sqe();
+
+    /**
+     * pass to the kernel all the entries returned by get_sqe(),
+     * and wait until at least 'wait_n' completions are available.
+     * return 0 if success, else error
+     */
+    int submit(unsigned wait_n);
+
+    /**
+     * get next completion: set 'user_data' and 'res' and return true,
+     * or return false if no completion is available
+     */
+    bool next_cqe(ft_u64 & user_data, int & res);
+
+    /** close all direct descriptors, leaving their slots empty. return 0 if success, else error */
+    int close_files();
+};
+
+FT_IO_NAMESPACE_END
+
+#endif /* FSMOVE_IO_URING_HH */
@@ -36,7 +36,7 @@
 #endif
 
 #ifdef FT_HAVE_UNISTD_H
-# include <unistd.h>       // for dup2(), close(), fork(), execvp()
+# include <unistd.h>       // for dup2(), close(), fork(), execvp(), lchown(), chown(), readlink(), symlink(), link(), rmdir(), unlink()
 #endif
 #ifdef FT_HAVE_FCNTL_H
 # include <fcntl.h>        // for open()
@@ -52,7 +52,90 @@
 #endif
 
 #include "../log.hh"      // for ff_log()
-#include "util_posix.hh"  // for ff_posix_exec_silent()
+#include "util_posix.hh"  // for ff_posix_exec_silent(), FT_IO_POSIX_AT
+
+#ifndef FT_IO_POSIX_AT
+/*
+ * emulate missing *at() functions with their path-based counterparts.
+ * fsmove calls them only with dir_fd == AT_FDCWD and full paths
+ */
+# ifndef FT_HAVE_FCHMODAT
+int fchmodat(int FT_ARG_UNUSED(dir_fd), const char * path, mode_t mode, int FT_ARG_UNUSED(flags))
+{
+    return chmod(path, mode);
+}
+# endif
+# ifndef FT_HAVE_FCHOWNAT
+int fchownat(int FT_ARG_UNUSED(dir_fd), const char * path, uid_t owner, gid_t group, int flags)
+{
+#  ifdef FT_HAVE_LCHOWN
+    if (flags & AT_SYMLINK_NOFOLLOW)
+        return lchown(path, owner, group);
+#  else
+    struct stat buf;
+    /* chown() would follow symbolic links: skip them */
+    if ((flags & AT_SYMLINK_NOFOLLOW) && lstat(path, & buf) == 0 && S_ISLNK(buf.st_mode))
+        return 0;
+#  endif
+    return chown(path, owner, group);
+}
+# endif
+# ifndef FT_HAVE_FSTATAT
+int fstatat(int FT_ARG_UNUSED(dir_fd), const char * path, struct stat * buf, int flags)
+{
+    return (flags & AT_SYMLINK_NOFOLLOW) ? lstat(path, buf) : stat(path, buf);
+}
+# endif
+# ifndef FT_HAVE_LINKAT
+int linkat(int FT_ARG_UNUSED(old_dir_fd), const char * old_path, int FT_ARG_UNUSED(new_dir_fd), const char * new_path,
+           int FT_ARG_UNUSED(flags))
+{
+    return link(old_path, new_path);
+}
+# endif
+# ifndef FT_HAVE_MKDIRAT
+int mkdirat(int FT_ARG_UNUSED(dir_fd), const char * path, mode_t mode)
+{
+    return mkdir(path, mode);
+}
+# endif
+# ifndef FT_HAVE_MKFIFOAT
+int mkfifoat(int FT_ARG_UNUSED(dir_fd), const char * path, mode_t mode)
+{
+    return mkfifo(path, mode);
+}
+# endif
+# ifndef FT_HAVE_MKNODAT
+int mknodat(int FT_ARG_UNUSED(dir_fd), const char * path, mode_t mode, dev_t dev)
+{
+    return mknod(path, mode, dev);
+}
+# endif
+# ifndef FT_HAVE_OPENAT
+int openat(int FT_ARG_UNUSED(dir_fd), const char * path, int flags, mode_t mode)
+{
+    return open(path, flags, mode);
+}
+# endif
+# ifndef FT_HAVE_READLINKAT
+ssize_t readlinkat(int FT_ARG_UNUSED(dir_fd), const char * path, char * buf, size_t len)
+{
+    return readlink(path, buf, len);
+}
+# endif
+# ifndef FT_HAVE_SYMLINKAT
+int symlinkat(const char * link_to, int FT_ARG_UNUSED(dir_fd), const char * path)
+{
+    return symlink(link_to, path);
+}
+# endif
+# ifndef FT_HAVE_UNLINKAT
+int unlinkat(int FT_ARG_UNUSED(dir_fd), const char * path, int flags)
+{
+    return (flags & AT_REMOVEDIR) ? rmdir(path) : unlink(path);
+}
+# endif
+#endif /* FT_IO_POSIX_AT */
 
 
 FT_IO_NAMESPACE_BEGIN
@@ -27,6 +27,73 @@
 
 #include "../types.hh"
 
+#ifdef FT_HAVE_FCNTL_H
+# include <fcntl.h>        // for AT_FDCWD, AT_SYMLINK_NOFOLLOW, AT_REMOVEDIR
+#endif
+#ifdef FT_HAVE_SYS_STAT_H
+# include <sys/stat.h>     // for struct stat, mode_t
+#endif
+#ifdef FT_HAVE_SYS_TYPES_H
+# include <sys/types.h>    // for uid_t, gid_t, dev_t
+#endif
+
+/*
+ * fsmove accesses directory entries with *at() functions relative to an open directory,
+ * so that the kernel resolves a single path component per system call instead of the whole path.
+ * if some of them are missing, FT_IO_POSIX_AT is not defined: fsmove then always passes AT_FDCWD
+ * and full paths, and the missing functions are emulated with their path-based counterparts
+ */
+#if defined(AT_FDCWD) && defined(AT_SYMLINK_NOFOLLOW) && defined(AT_REMOVEDIR) \
+    && defined(FT_HAVE_FCHMODAT) && defined(FT_HAVE_FCHOWNAT) && defined(FT_HAVE_FSTATAT) \
+    && defined(FT_HAVE_LINKAT) && defined(FT_HAVE_MKDIRAT) && defined(FT_HAVE_MKFIFOAT) \
+    && defined(FT_HAVE_MKNODAT) && defined(FT_HAVE_OPENAT) && defined(FT_HAVE_READLINKAT) \
+    && defined(FT_HAVE_SYMLINKAT) && defined(FT_HAVE_UNLINKAT) && defined(FT_HAVE_UTIMENSAT)
+# define FT_IO_POSIX_AT
+#else
+# ifndef AT_FDCWD
+#  define AT_FDCWD            -100
+# endif
+# ifndef AT_SYMLINK_NOFOLLOW
+#  define AT_SYMLINK_NOFOLLOW 0x100
+# endif
+# ifndef AT_REMOVEDIR
+#  define AT_REMOVEDIR        0x200
+# endif
+# ifndef FT_HAVE_FCHMODAT
+int fchmodat(int dir_fd, const char * path, mode_t mode, int flags);
+# endif
+# ifndef FT_HAVE_FCHOWNAT
+int fchownat(int dir_fd, const char * path, uid_t owner, gid_t group, int flags);
+# endif
+# ifndef FT_HAVE_FSTATAT
+int fstatat(int dir_fd, const char * path, struct stat * buf, int flags);
+# endif
+# ifndef FT_HAVE_LINKAT
+int linkat(int old_dir_fd, const char * old_path, int new_dir_fd, const char * new_path, int flags);
+# endif
+# ifndef FT_HAVE_MKDIRAT
+int mkdirat(int dir_fd, const char * path, mode_t mode);
+# endif
+# ifndef FT_HAVE_MKFIFOAT
+int mkfifoat(int dir_fd, const char * path, mode_t mode);
+# endif
+# ifndef FT_HAVE_MKNODAT
+int mknodat(int dir_fd, const char * path, mode_t mode, dev_t dev);
+# endif
+# ifndef FT_HAVE_OPENAT
+int openat(int dir_fd, const char * path, int flags, mode_t mode = 0);
+# endif
+# ifndef FT_HAVE_READLINKAT
+ssize_t readlinkat(int dir_fd, const char * path, char * buf, size_t len);
+# endif
+# ifndef FT_HAVE_SYMLINKAT
+int symlinkat(const char * link_to, int dir_fd, const char * path);
+# endif
+# ifndef FT_HAVE_UNLINKAT
+int unlinkat(int dir_fd, const char * path, int flags);
+# endif
+#endif /* FT_IO_POSIX_AT */
+
 FT_IO_NAMESPACE_BEGIN
 
 /**
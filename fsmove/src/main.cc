@@ -25,11 +25,21 @@
 
 #undef  FM_TEST_ROPE
 #undef  FM_TEST_ZSTRING
+#undef  FM_TEST_ZERO
+#undef  FM_TEST_CACHE
 
 #if defined(FM_TEST_ROPE)
 # include "rope/rope_test.hh" // rope self-test
 #define FM_MAIN(argc, argv) FT_NS rope_test(argc, argv)
 
+#elif defined(FM_TEST_ZERO)
+# include "zero_test.hh"      // zero-scan kernels self-test and benchmark
+#define FM_MAIN(argc, argv) FT_NS ff_zero_test(argc, argv)
+
+#elif defined(FM_TEST_CACHE)
+# include "cache/cache_test.hh" // concurrent inode cache self-test and benchmark
+#define FM_MAIN(argc, argv) FT_NS ff_cache_test(argc, argv)
+
 #elif defined(FM_TEST_ZSTRING)
 # include "zstring.hh"        // zstring self-test
 #define FM_MAIN(argc, argv) FT_NS ztest()
@@ -26,6 +26,7 @@
 #include "first.hh"
 
 #include "move.hh"
+#include "misc.hh"           // for ff_str2un(), ff_str2un_scaled()
 #include "io/io.hh"          // for fm_io
 #include "io/io_posix.hh"    // for fm_io_posix
 #include "io/io_prealloc.hh" // for fm_io_prealloc
@@ -166,13 +167,25 @@ int fm_move::usage(const char * program_name)
      "Mandatory arguments to long options are mandatory for short options too.\n"
      "  --                    end of options. treat subsequent parameters as arguments\n"
      "                          even if they start with '-'\n"
+     "      --copy-threads=N  copy each file at least 32M large using N threads.\n"
+     "                          0 means one per CPU (default: 1)\n"
+     "      --direct-io=SIZE  bypass the page cache when copying files\n"
+     "                          at least SIZE bytes large (default: 64M)\n"
      "  -e, --exclude FILE... skip these files, i.e. do not move them.\n"
      "                          must be last argument\n"
+     "      --fallocate       preallocate each target file before copying it.\n"
+     "                          reduces fragmentation of TARGET, and of LOOP-FILE\n"
+     "                          if TARGET is inside a loop-file\n"
      "  -f, --force-run       run even if some safety checks fail\n"
      "      --io=posix        use POSIX I/O and move files (default)\n"
 #ifdef FT_HAVE_FM_IO_IO_PREALLOC
      "      --io=prealloc     use POSIX I/O and preallocate files (do NOT move them)\n"
 #endif
+     "      --io-buffer=SIZE  copy large files using a buffer of SIZE bytes\n"
+     "                          (default: 1M)\n"
+     "      --io-uring        move small files in batches using io_uring\n"
+     "      --inode-cache-compress\n"
+     "                        compress the paths stored in inode cache\n"
      "      --inode-cache-mem use in-memory inode cache (default)\n"
      "      --inode-cache=DIR create and use directory DIR for inode cache\n"
      "      --log-color=MODE  set messages color. MODE is one of:"
@@ -182,8 +195,16 @@ int fm_move::usage(const char * program_name)
      "                          time_level_function_msg\n"
      "  -n, --no-action, --simulate-run\n"
      "                        do not actually move any file or directory\n"
+     "      --no-direct-io    never bypass the page cache when copying files\n"
+     "      --no-plan         do not scan SOURCE before moving to predict free space\n"
+     "                          and postpone large files\n"
+     "      --order=ORDER     move the entries of each directory in ORDER. one of:\n"
+     "                          readdir (default), inode: by inode number,\n"
+     "                          physical: by position on disk, for rotating disks\n"
      "  -q, --quiet           be quiet\n"
      "  -qq                   be very quiet, only print warnings or errors\n"
+     "      --threads=N       move files and directories using N threads.\n"
+     "                          0 means one per CPU (default: 1)\n"
      "  -v, --verbose         be verbose, print what is being done\n"
      "  -vv                   be very verbose, print a lot of detailed output\n"
      "  -vvv                  be incredibly verbose (warning: prints LOTS of output)\n"
@@ -317,6 +338,10 @@ int fm_move::init(int argc, char const* const* argv)
                     ft_log_level logger_level = equal ? (ft_log_level) atoi(equal+1) : FC_INFO;
                     ft_log::get_logger(logger_name).set_level(logger_level);
                 }
+                /* --fallocate */
+                else if (!strcmp(arg, "--fallocate")) {
+                    args.fallocate_target = true;
+                }
                 /* -f force run: degrade failed sanity checks from ERRORS (which stop execution) to WARNINGS (which let execution continue) */
                 else if (!strcmp(arg, "-f") || !strcmp(arg, "--force-run")) {
                     args.force_run = true;
@@ -342,6 +367,9 @@ int fm_move::init(int argc, char const* const* argv)
 #endif
                     }
                 }
+                else if (!strcmp(arg, "--inode-cache-compress")) {
+                    args.inode_cache_compress = true;
+                }
                 else if (!strcmp(arg, "--inode-cache-mem")) {
                     args.inode_cache_path = NULL;
                 }
@@ -350,6 +378,58 @@ int fm_move::init(int argc, char const* const* argv)
                     if (arg[14] != '\0')
                         args.inode_cache_path = arg + 14;
                 }
+                /* --order=(readdir|inode|physical) */
+                else if (!strncmp(arg, "--order=", 8)) {
+                    arg += 8;
+                    if (!strcmp(arg, "readdir"))
+                        args.order = FC_ORDER_READDIR;
+                    else if (!strcmp(arg, "inode"))
+                        args.order = FC_ORDER_INODE;
+                    else if (!strcmp(arg, "physical"))
+                        args.order = FC_ORDER_PHYSICAL;
+                    else {
+                        err = invalid_cmdline(program_name, 0, "invalid order '%s'", arg);
+                        break;
+                    }
+                }
+                /* --direct-io=SIZE */
+                else if (!strncmp(arg, "--direct-io=", 12)) {
+                    if ((err = ff_str2un_scaled(arg + 12, & args.direct_io_min)) != 0) {
+                        err = invalid_cmdline(program_name, err, "invalid file size '%s'", arg + 12);
+                        break;
+                    }
+                }
+                else if (!strcmp(arg, "--no-direct-io")) {
+                    args.direct_io_min = 0;
+                }
+                else if (!strcmp(arg, "--no-plan")) {
+                    args.plan = false;
+                }
+                /* --io-buffer=SIZE */
+                else if (!strncmp(arg, "--io-buffer=", 12)) {
+                    if ((err = ff_str2un_scaled(arg + 12, & args.io_buffer_size)) != 0
+                        || args.io_buffer_size < ((ft_size)1 << 16) || (args.io_buffer_size & (((ft_size)1 << 12) - 1)) != 0) {
+                        err = invalid_cmdline(program_name, err, "invalid buffer size '%s': must be a multiple of 4k, and at least 64k", arg + 12);
+                        break;
+                    }
+                }
+                else if (!strcmp(arg, "--io-uring")) {
+                    args.io_uring = true;
+                }
+                /* --copy-threads=N */
+                else if (!strncmp(arg, "--copy-threads=", 15)) {
+                    if ((err = ff_str2un(arg + 15, & args.copy_thread_n)) != 0) {
+                        err = invalid_cmdline(program_name, err, "invalid number of threads '%s'", arg + 15);
+                        break;
+                    }
+                }
+                /* --threads=N */
+                else if (!strncmp(arg, "--threads=", 10)) {
+                    if ((err = ff_str2un(arg + 10, & args.thread_n)) != 0) {
+                        err = invalid_cmdline(program_name, err, "invalid number of threads '%s'", arg + 10);
+                        break;
+                    }
+                }
                 else if (!strcmp(arg, "--help")) {
                     return usage(args.program_name);
                 }
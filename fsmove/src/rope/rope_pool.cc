@@ -25,26 +25,47 @@
 
 #include "../first.hh"
 
+/* SSE2 is part of the x86_64 baseline, so no runtime dispatch is needed */
+#if defined(FT_HAVE_IMMINTRIN_H) && defined(__SSE2__)
+# define FT_ROPE_POOL_SSE2
+# include <immintrin.h>    // for _mm_*()
+#endif
+
 #include "rope_impl.hh"
 #include "rope_pool.hh"
 
 FT_NAMESPACE_BEGIN
 
+/** return the index of the lowest bit set in 'mask', which must be != 0 */
+static FT_INLINE ft_size ff_lowest_bit(ft_u32 mask)
+{
+#if defined(__GNUC__)
+	return (ft_size)__builtin_ctz(mask);
+#else
+	ft_size i = 0;
+	for (; !(mask & 1); mask >>= 1)
+		i++;
+	return i;
+#endif
+}
+
 /** default constructor. */
-ft_rope_pool::ft_rope_pool() : count(0), table()
+ft_rope_pool::ft_rope_pool() : ctrl(), slots(), count(0), growth_left(0)
 { }
 
 /** copy constructor. */
 ft_rope_pool::ft_rope_pool(const ft_rope_pool & other)
-: count(other.count), table(other.table)
+: ctrl(other.ctrl), slots(other.slots), count(other.count), growth_left(other.growth_left)
 { }
 
 /** assignment operator. */
 const ft_rope_pool & ft_rope_pool::operator=(const ft_rope_pool & other)
 {
 	if (this != & other) {
+		ctrl = other.ctrl;
+		slots = other.slots;
 		count = other.count;
-		table = other.table;
+		growth_left = other.growth_left;
 	}
 	return *this;
 }
@@ -53,49 +74,124 @@ const ft_rope_pool & ft_rope_pool::operator=(const ft_rope_pool & other)
 ft_rope_pool::~ft_rope_pool()
 { }
 
-void ft_rope_pool::rehash(ft_size new_len)
+/** scramble ft_rope::hash(): multiply by 2^N / golden ratio, then fold high bits into low ones */
+ft_size ft_rope_pool::mix(ft_size h)
+{
+	h *= (ft_size)0x9E3779B97F4A7C15ULL;
+	return h ^ (h >> (sizeof(ft_size) * 4));
+}
+
+/** return the bitmask of control bytes in group starting at 'pos' that are equal to 'c' */
+ft_u32 ft_rope_pool::match(ft_size pos, ft_u8 c) const
+{
+#ifdef FT_ROPE_POOL_SSE2
+	__m128i group = _mm_loadu_si128((const __m128i *)(& ctrl[pos]));
+	return (ft_u32)_mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8((char)c)));
+#else
+	const ft_u8 * group = & ctrl[pos];
+	ft_u32 mask = 0;
+	for (ft_size i = 0; i < GROUP; i++)
+		mask |= (ft_u32)(group[i] == c) << i;
+	return mask;
+#endif
+}
+
+/** return the bitmask of control bytes in group starting at 'pos' that are EMPTY or DELETED, i.e. have the high bit set */
+ft_u32 ft_rope_pool::match_free(ft_size pos) const
+{
+#ifdef FT_ROPE_POOL_SSE2
+	return (ft_u32)_mm_movemask_epi8(_mm_loadu_si128((const __m128i *)(& ctrl[pos])));
+#else
+	const ft_u8 * group = & ctrl[pos];
+	ft_u32 mask = 0;
+	for (ft_size i = 0; i < GROUP; i++)
+		mask |= (ft_u32)(group[i] >> 7) << i;
+	return mask;
+#endif
+}
+
+/** set control byte of slot 'i', and its mirror */
+void ft_rope_pool::set_ctrl(ft_size i, ft_u8 c)
+{
+	ctrl[i] = c;
+	if (i < GROUP)
+		ctrl[capacity() + i] = c;
+}
+
+/**
+ * return index of slot containing s[0, len), or capacity() if not found.
+ * groups are probed in triangular sequence, which visits each of them once
+ * because capacity() / GROUP is a power of two
+ */
+ft_size ft_rope_pool::find_index(const char s[], ft_size len, ft_size h) const
 {
-	// assert((new_len & new_lenn-1)) == 0); // must be power-of-two
-	ft_table tmp(new_len);
-	tmp.swap(table);
-	ft_bucket::const_iterator iter, end;
-	for (ft_size i = 0, n = tmp.size(); i < n; i++) {
-		const ft_bucket & bucket = tmp[i];
-		iter = bucket.begin();
-		end = bucket.end();
-		for (; iter != end; ++iter) {
-			const ft_rope & r = *iter;
-			ft_size index = r.hash() & (new_len - 1);
-			table[index].push_front(r);
+	const ft_size n = capacity();
+	if (n == 0)
+		return n;
+	const ft_size mask = n - 1;
+	const ft_u8 t = tag(h);
+	ft_size pos = (h >> 7) & mask;
+	for (ft_size step = GROUP; ; step += GROUP) {
+		for (ft_u32 m = match(pos, t); m != 0; m &= m - 1) {
+			ft_size i = (pos + ff_lowest_bit(m)) & mask;
+			const ft_slot & slot = slots[i];
+			if (slot.hash == h && slot.rope.equals(s, len))
+				return i;
 		}
+		if (match(pos, CTRL_EMPTY) != 0)
+			return n;
+		pos = (pos + step) & mask;
+	}
+}
+
+/** return index of first EMPTY or DELETED slot in the probe sequence of 'h' */
+ft_size ft_rope_pool::find_free(ft_size h) const
+{
+	const ft_size mask = capacity() - 1;
+	ft_size pos = (h >> 7) & mask;
+	for (ft_size step = GROUP; ; step += GROUP) {
+		ft_u32 m = match_free(pos);
+		if (m != 0)
+			return (pos + ff_lowest_bit(m)) & mask;
+		pos = (pos + step) & mask;
 	}
 }
 
+/** move all ropes to a new table with 'new_cap' slots, discarding DELETED slots */
+void ft_rope_pool::rehash(ft_size new_cap)
+{
+	// assert((new_cap & (new_cap - 1)) == 0 && new_cap >= GROUP); // must be power-of-two
+	std::vector<ft_u8> old_ctrl(new_cap + GROUP, (ft_u8)CTRL_EMPTY);
+	std::vector<ft_slot> old_slots(new_cap);
+	old_ctrl.swap(ctrl);
+	old_slots.swap(slots);
+
+	for (ft_size i = 0, n = old_slots.size(); i < n; i++) {
+		if (old_ctrl[i] & 0x80)
+			continue;
+		const ft_slot & old = old_slots[i];
+		ft_size j = find_free(old.hash);
+		set_ctrl(j, tag(old.hash));
+		slots[j] = old;
+	}
+	growth_left = max_load(new_cap) - count;
+}
+
 // returned pointer is valid only while pool is not modified
 const ft_rope * ft_rope_pool::find(const char s[], ft_size len) const
 {
-	ft_size n = table.size();
-	if (n == 0)
-		return NULL;
-	// assert((n & (n-1)) == 0); // must be power-of-two
-	ft_size index = ft_rope::hash(s, len) & (n - 1);
-	const ft_bucket & bucket = table[index];
-	ft_bucket::const_iterator iter = bucket.begin(), end = bucket.end();
-	for (; iter != end; ++iter) {
-		const ft_rope & r = *iter;
-		if (r.equals(s, len))
-			return & r;
-	}
-	return NULL;
+	ft_size i = find_index(s, len, mix(ft_rope::hash(s, len)));
+	return i != capacity() ? & slots[i].rope : NULL;
 }
 
 ft_rope ft_rope_pool::make(const char s[], ft_size len)
 {
 	if (len == 0)
 		return ft_rope();
-	const ft_rope * r = find(s, len);
-	if (r != NULL)
-		return *r;
+	const ft_size h = mix(ft_rope::hash(s, len));
+	ft_size i = find_index(s, len, h);
+	if (i != capacity())
+		return slots[i].rope;
 
 	enum { SPLIT_LO = sizeof(ft_rope_impl), SPLIT_HI = SPLIT_LO / 3 };
 
@@ -118,16 +214,35 @@ ft_rope ft_rope_pool::make(const char s[], ft_size len)
 	ft_rope result(& prefix, suffix, suffix_len);
 	if (suffix[suffix_len - 1] == '/') {
 		// only cache directory names
-		ft_size n = table.size();
-		if (count / 2 >= n)
-			rehash(n = (n ? n * 2 : 64));
-
-		ft_size index = ft_rope::hash(s, len) & (n - 1);
-		ft_bucket & bucket = table[index];
-		bucket.push_front(result);
+		if (growth_left == 0) {
+			// grow if at least half full, otherwise just discard DELETED slots
+			ft_size n = capacity();
+			rehash(n == 0 ? (ft_size)MIN_CAPACITY : count >= max_load(n) / 2 ? n * 2 : n);
+		}
+		i = find_free(h);
+		if (ctrl[i] == CTRL_EMPTY)
+			growth_left--;
+		set_ctrl(i, tag(h));
+		slots[i].rope = result;
+		slots[i].hash = h;
 		count++;
 	}
 	return result;
 }
 
+/** remove s[0, len) from pool. ropes already returned by make() remain valid */
+void ft_rope_pool::erase(const char s[], ft_size len)
+{
+	ft_size i = find_index(s, len, mix(ft_rope::hash(s, len)));
+	if (i == capacity())
+		return;
+	slots[i].rope = ft_rope();
+	if (--count == 0) {
+		// reuse the whole table
+		ctrl.assign(ctrl.size(), (ft_u8)CTRL_EMPTY);
+		growth_left = max_load(capacity());
+	} else
+		set_ctrl(i, (ft_u8)CTRL_DELETED);
+}
+
 FT_NAMESPACE_END
@@ -26,12 +26,10 @@
 #ifndef FSTRANSFORM_ROPE_POOL_HH
 #define FSTRANSFORM_ROPE_POOL_HH
 
-#include <list>
 #include <vector>
 
-#include "../types.hh"  // for ft_string
+#include "../types.hh"  // for ft_string, ft_size, ft_u8, ft_u32
 #include "rope.hh"      // for ft_rope
-#include "rope_list.hh" // for ft_rope_list
 
 FT_NAMESPACE_BEGIN
 
@@ -39,17 +37,71 @@ FT_NAMESPACE_BEGIN
 /**
  * pool of ropes. useful to compress large sets of repetitive strings,
  * in particular for the strings in the inode cache ft_cache<ft_inode, ft_rope>
+ *
+ * open-addressing hash table in the style of Swiss tables:
+ * each slot has a control byte, containing either 7 bits of its hash or the markers
+ * EMPTY and DELETED. lookups compare GROUP control bytes at once (with SSE2 if available)
+ * and call ft_rope::equals() only on slots whose control byte and cached hash both match.
  */
 class ft_rope_pool
 {
 private:
-	typedef ft_rope_list ft_bucket;
-	typedef std::vector<ft_bucket> ft_table;
+	enum {
+		GROUP = 16,           //< control bytes probed together
+		CTRL_EMPTY = 0x80,
+		CTRL_DELETED = 0xFE,
+		MIN_CAPACITY = 64
+	};
+
+	/** a pooled rope and its (mixed) hash */
+	struct ft_slot {
+		ft_rope rope;
+		ft_size hash;
+
+		FT_INLINE ft_slot() : rope(), hash(0)
+		{ }
+	};
+
+	/* capacity + GROUP bytes: the first GROUP bytes are mirrored at the end, so probing never wraps inside a group */
+	std::vector<ft_u8> ctrl;
+	std::vector<ft_slot> slots;
+	ft_size count, growth_left;
+
+	/** return the number of slots */
+	FT_INLINE ft_size capacity() const {
+		return slots.size();
+	}
+
+	/** return the maximum number of used and deleted slots before rehash() */
+	static FT_INLINE ft_size max_load(ft_size cap) {
+		return cap - cap / 8;
+	}
+
+	/** scramble ft_rope::hash(), whose high bits are poorly distributed */
+	static ft_size mix(ft_size h);
+
+	/** return the control byte of a full slot with hash 'h' */
+	static FT_INLINE ft_u8 tag(ft_size h) {
+		return (ft_u8)(h & 0x7F);
+	}
+
+	/** return the bitmask of control bytes in group starting at 'pos' that are equal to 'c' */
+	ft_u32 match(ft_size pos, ft_u8 c) const;
 
-	ft_size count;
-	ft_table table;
+	/** return the bitmask of control bytes in group starting at 'pos' that are EMPTY or DELETED */
+	ft_u32 match_free(ft_size pos) const;
 
-	void rehash(ft_size new_len);
+	/** set control byte of slot 'i', and its mirror */
+	void set_ctrl(ft_size i, ft_u8 c);
+
+	/** return index of slot containing s[0, len), or capacity() if not found */
+	ft_size find_index(const char s[], ft_size len, ft_size h) const;
+
+	/** return index of first EMPTY or DELETED slot in the probe sequence of 'h' */
+	ft_size find_free(ft_size h) const;
+
+	/** move all ropes to a new table with 'new_cap' slots, discarding DELETED slots */
+	void rehash(ft_size new_cap);
 
 public:
 	/** default constructor. */
@@ -64,7 +116,12 @@ public:
 	/* destructor. */
 	~ft_rope_pool();
 
-	/** returned pointer is valid only until pool is rehashed.
+	/** return number of ropes in pool */
+	FT_INLINE ft_size size() const {
+		return count;
+	}
+
+	/** returned pointer is valid only until pool is modified.
 	  * copy returned ft_rope if you need it further */
 	const ft_rope * find(const char s[], ft_size len) const;
 
@@ -77,7 +134,13 @@ public:
 	FT_INLINE ft_rope make(const ft_string & s) {
 		return make(s.c_str(), s.size());
 	}
-	void erase(const ft_string & s);
+
+	/** remove s[0, len) from pool. ropes already returned by make() remain valid */
+	void erase(const char s[], ft_size len);
+
+	FT_INLINE void erase(const ft_string & s) {
+		erase(s.c_str(), s.size());
+	}
 };
 
 FT_NAMESPACE_END
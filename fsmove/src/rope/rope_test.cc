@@ -25,6 +25,12 @@
 
 #include "../first.hh"
 
+#if defined(FT_HAVE_CERRNO)
+# include <cerrno>       // for EINVAL
+#elif defined(FT_HAVE_ERRNO_H)
+# include <errno.h>      // for EINVAL
+#endif
+
 #if defined(FT_HAVE_STDIO_H)
 # include <stdio.h>     // for getchar()
 #elif defined(FT_HAVE_CSTDIO)
@@ -38,9 +44,9 @@
 #endif
 
 #if defined(FT_HAVE_STRING_H)
-# include <string.h>     // for strcmp(), strdup(), strlen()
+# include <string.h>     // for memcpy(), strcmp(), strdup(), strlen()
 #elif defined(FT_HAVE_CSTRING)
-# include <cstring>      // for strcmp(), strdup(), strlen()
+# include <cstring>      // for memcpy(), strcmp(), strdup(), strlen()
 #endif
 
 #ifdef FT_HAVE_FT_UNSORTED_MAP
@@ -52,8 +58,11 @@
 #endif
 
 #include "../log.hh"
+#include "../misc.hh"      // for ff_now(), ff_str2un_scaled()
 #include "../io/io_posix_dir.hh"
 #include "../cache/cache_mem.hh"
+#include "../cache/cache_mem_rope.hh"
+#include "../cache/cache_zstring.hh"
 #include "../zstring.hh"
 
 #include "rope_test.hh"
@@ -176,6 +185,33 @@ static ft_uoff recursive_readdir_cachemem(ft_cache_mem<ft_inode, ft_string> & ca
 	}
 	return count;
 }
+
+static ft_uoff recursive_readdir_cache(ft_cache<ft_inode, ft_string> & cache,
+				       const ft_string & path)
+{
+	ft_uoff count = 0;
+	io::ft_io_posix_dir dir;
+	if (dir.open(path) != 0) {
+		return count;
+	}
+	io::ft_io_posix_dirent * dirent = NULL;
+	while (dir.next(dirent) == 0 && dirent != NULL) {
+		if (!strcmp(dirent->d_name, ".") || !strcmp(dirent->d_name, ".."))
+			continue;
+
+		ft_string subpath = path, tmp;
+		if (subpath[subpath.size() - 1] != '/')
+			subpath += '/';
+		subpath += dirent->d_name;
+		tmp = subpath;
+		cache.find_or_add(dirent->d_ino, tmp); // modifies tmp!
+
+		if (dirent->d_type == DT_DIR) {
+			count += recursive_readdir_cache(cache, subpath);
+		}
+	}
+	return count;
+}
 	
 static ft_uoff recursive_readdir_pool(ft_rope_pool & pool,
 				      ft_cache_mem<ft_inode, ft_rope> & cache,
@@ -205,10 +241,87 @@ static ft_uoff recursive_readdir_pool(ft_rope_pool & pool,
 	return count;
 }
 
+/**
+ * write into 'buf' the i-th synthetic directory name used by rope_pool_bench(),
+ * i.e. "/fsmove.bench/AAA/BBB/CCC/" for i = AAABBBCCC. return its length
+ */
+static ft_size rope_pool_bench_path(char buf[], ft_size i)
+{
+	static const char root[] = "/fsmove.bench/";
+	ft_size len = sizeof(root) - 1;
+	memcpy(buf, root, len);
+	for (ft_size div = 1000000; div != 0; div /= 1000) {
+		ft_size n = (i / div) % 1000;
+		buf[len++] = (char)('0' + n / 100);
+		buf[len++] = (char)('0' + n / 10 % 10);
+		buf[len++] = (char)('0' + n % 10);
+		buf[len++] = '/';
+	}
+	return len;
+}
+
+static void rope_pool_bench_report(const char * label, ft_size n, double start, double end,
+				   const char * result_label, ft_size result)
+{
+	double elapsed = end - start;
+	ff_log(FC_INFO, 0, "%-10s %8.3f seconds, %8.2f M ops/s, %s = %" FT_ULL, label, elapsed,
+	       elapsed > 0.0 ? (double) n / elapsed * 1e-6 : 0.0, result_label, (ft_ull) result);
+}
+
+/**
+ * benchmark ft_rope_pool::make(), find() and erase() on 'n' synthetic directory names.
+ * n can be up to 10^9, but 10^8 already needs about 7GB of RAM
+ */
+static int rope_pool_bench(ft_size n)
+{
+	if (n > 1000000000)
+		return ff_log(FC_ERROR, EINVAL, "rope_test bench: at most 1G entries, got %" FT_ULL, (ft_ull) n);
+
+	ft_rope_pool pool;
+	char buf[64];
+	ft_size i, hits;
+	double start = 0.0, end = 0.0;
+
+	(void) ff_now(start);
+	for (i = 0; i < n; i++)
+		pool.make(buf, rope_pool_bench_path(buf, i));
+	(void) ff_now(end);
+	rope_pool_bench_report("make", n, start, end, "pool size", pool.size());
+
+	(void) ff_now(start);
+	for (i = hits = 0; i < n; i++)
+		hits += pool.find(buf, rope_pool_bench_path(buf, i)) != NULL;
+	(void) ff_now(end);
+	rope_pool_bench_report("find hit", n, start, end, "found", hits);
+
+	/* names with a different first directory are never in pool */
+	(void) ff_now(start);
+	for (i = hits = 0; i < n; i++) {
+		ft_size len = rope_pool_bench_path(buf, i);
+		buf[1] = 'F';
+		hits += pool.find(buf, len) != NULL;
+	}
+	(void) ff_now(end);
+	rope_pool_bench_report("find miss", n, start, end, "found", hits);
+
+	(void) ff_now(start);
+	for (i = 0; i < n; i++)
+		pool.erase(buf, rope_pool_bench_path(buf, i));
+	(void) ff_now(end);
+	rope_pool_bench_report("erase", n, start, end, "pool size", pool.size());
+	return 0;
+}
+
 int rope_test(int argc, char ** argv)
 {
-	ft_string path = "/";
-	if (argc > 1 && !strcmp(argv[1], "pool")) {
+	ft_string path = argc > 2 ? argv[2] : "/";
+	if (argc > 1 && !strcmp(argv[1], "bench")) {
+		ft_size n = 1000000;
+		int err = 0;
+		if (argc > 2 && (err = ff_str2un_scaled(argv[2], & n)) != 0)
+			return ff_log(FC_ERROR, err, "Usage: %s bench [N_ENTRIES]", argv[0]);
+		return rope_pool_bench(n);
+	} else if (argc > 1 && !strcmp(argv[1], "pool")) {
 		ft_rope_pool pool;
 		ft_cache_mem<ft_inode, ft_rope> cache;
 		recursive_readdir_pool(pool, cache, path);
@@ -221,8 +334,27 @@ int rope_test(int argc, char ** argv)
 		fputs("recursive_readdir_cachemem() completed. check RAM usage and press ENTER\n", stdout);
 		fflush(stdout);
 		fgetc(stdin);
+	} else if (argc > 1 && !strcmp(argv[1], "cacherope")) {
+		ft_cache_mem_rope<ft_inode> cache;
+		recursive_readdir_cache(cache, path);
+		fputs("recursive_readdir_cache() on ft_cache_mem_rope completed. check RAM usage and press ENTER\n", stdout);
+		fflush(stdout);
+		fgetc(stdin);
+	} else if (argc > 1 && !strcmp(argv[1], "zcachemem")) {
+		ft_cache_zstring<ft_inode> cache(new ft_cache_mem<ft_inode, ft_string>());
+		recursive_readdir_cache(cache, path);
+		fputs("recursive_readdir_cache() on ft_cache_zstring<ft_cache_mem> completed. check RAM usage and press ENTER\n", stdout);
+		fflush(stdout);
+		fgetc(stdin);
+	} else if (argc > 1 && !strcmp(argv[1], "zcacherope")) {
+		ft_cache_zstring<ft_inode> cache(new ft_cache_mem_rope<ft_inode>());
+		recursive_readdir_cache(cache, path);
+		fputs("recursive_readdir_cache() on ft_cache_zstring<ft_cache_mem_rope> completed. check RAM usage and press ENTER\n", stdout);
+		fflush(stdout);
+		fgetc(stdin);
 	} else if (argc > 1 && !strcmp(argv[1], "zstring")) {
 		ft_map<ft_inode, ft_string> cache;
+		zinit();
 		recursive_readdir_zstring(cache, path);
 		fputs("recursive_zstring() completed. check RAM usage and press ENTER\n", stdout);
 		fflush(stdout);
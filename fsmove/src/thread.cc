@@ -0,0 +1 @@
+../../fsremap/src/thread.cc
\ No newline at end of file
@@ -0,0 +1 @@
+../../fsremap/src/thread.hh
\ No newline at end of file
@@ -0,0 +1 @@
+../../fsremap/src/zero.cc
\ No newline at end of file
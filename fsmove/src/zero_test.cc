@@ -0,0 +1 @@
+../../fsremap/src/zero_test.cc
\ No newline at end of file
@@ -0,0 +1 @@
+../../fsremap/src/zero_test.hh
\ No newline at end of file
@@ -63,8 +63,9 @@ static FT_INLINE bool operator<(const zhuff & lhs, const zhuff & rhs)
 };
 
 struct unzbyte {
-        // how to decode a single byte
-        ft_u8 nbits[3], sym[3];
+        // how to decode up to 3 symbols with a single lookup:
+        // n = number of symbols, nbits[i] = bits consumed by sym[0...i]
+        ft_u8 n, nbits[3], sym[3];
 };
 
 static ft_u8 code_min_len;
@@ -124,9 +125,10 @@ void zinit()
                                         ((ft_u16)unzvec[k].bits << free_len);
                                 for (ft_size f = 0; f < (1U<<free_len); f++) {
                                         unzbyte & entry = unztable[bits + f];
+                                        entry.n = 3;
                                         entry.nbits[0] = ilen;
-                                        entry.nbits[1] = jlen;
-                                        entry.nbits[2] = klen;
+                                        entry.nbits[1] = ilen + jlen;
+                                        entry.nbits[2] = ilen + jlen + klen;
                                         entry.sym[0] = unzvec[i].sym;
                                         entry.sym[1] = unzvec[j].sym;
                                         entry.sym[2] = unzvec[k].sym;
@@ -136,11 +138,11 @@ void zinit()
                         ft_u16 bits = ((ft_u16)unzvec[i].bits << (UNZBITS - ilen)) | ((ft_u16)unzvec[j].bits << free_len);
                         for (ft_size f = 0; f < (1U<<free_len); f++) {
                                 unzbyte & entry = unztable[bits + f];
-                                if (entry.nbits[0])
+                                if (entry.n)
                                         continue;
+                                entry.n = 2;
                                 entry.nbits[0] = ilen;
-                                entry.nbits[1] = jlen;
-                                entry.nbits[2] = 0;
+                                entry.nbits[1] = entry.nbits[2] = ilen + jlen;
                                 entry.sym[0] = unzvec[i].sym;
                                 entry.sym[1] = unzvec[j].sym;
                                 entry.sym[2] = 0;
@@ -150,11 +152,10 @@ void zinit()
                 ft_u16 bits = (ft_u16)unzvec[i].bits << free_len;
                 for (ft_size f = 0; f < (1U<<free_len); f++) {
                         unzbyte & entry = unztable[bits + f];
-                        if (entry.nbits[0])
+                        if (entry.n)
                                 continue;
-                        entry.nbits[0] = ilen;
-                        entry.nbits[1] = 0;
-                        entry.nbits[2] = 0;
+                        entry.n = 1;
+                        entry.nbits[0] = entry.nbits[1] = entry.nbits[2] = ilen;
                         entry.sym[0] = unzvec[i].sym;
                         entry.sym[1] = 0;
                         entry.sym[2] = 0;
@@ -179,6 +180,7 @@ void z(ft_string & dst, const ft_string & src, bool force)
         ft_u32 bits = 0;
         ft_u8 len = 0;
 
+        dst.reserve(src.size() + 1);
         dst.push_back('\0'); // compressed strings marker
         for (ft_size i = 0, n = src.size(); i < n; i++) {
                 const zhuff & code = zvec[(ft_u8)s[i]];
@@ -208,45 +210,56 @@ void unz(ft_string & dst, const ft_string & src)
         if (src.empty())
                 return;
 
-        const char * s = src.c_str();
-        ft_u32 bits = 0;
-        ft_u8 len = 0;
-
-        if (s[0] != '\0') {
+        if (src[0] != '\0') {
                 // src is not compressed
                 dst = src;
                 return;
         }
-        ft_size i = 1, n = src.size();
-        dst.reserve(n);
+        const ft_u8 * s = reinterpret_cast<const ft_u8 *>(src.data()) + 1, * end = s + src.size() - 1;
 
-        while (i < n) {
-                do {
-                        bits = (bits << 8) | (ft_u8)s[i++];
-                        len += 8;
-                } while (i < n && len <= 24);
+        // compressed paths are usually ~65% of the original: start with 1.5 times the compressed size,
+        // then grow as needed. 64 bits of input decode to at most 64 / code_min_len + 2 bytes
+        // (the fast path below may write 2 extra bytes)
+        ft_size room = 64 / code_min_len + 2;
+        dst.resize(src.size() + src.size() / 2 + room);
+        char * out = & dst[0], * out_end = out + dst.size();
 
-                while (len >= code_min_len) {
-                        ft_u16 match_bits = len >= UNZBITS ? (bits >> (len - UNZBITS)) : (bits << (UNZBITS - len));
-                        const unzbyte & entry = unztable[match_bits & ((1<<UNZBITS)-1)];
-                        ft_u8 nbits = entry.nbits[0];
-                        if (nbits > len)
-                                break;
-                        
-                        dst.push_back(entry.sym[0]);
-                        len -= nbits;
-                        if ((nbits = entry.nbits[1]) && nbits <= len) {
-                                dst.push_back(entry.sym[1]);
-                                len -= nbits;
-                                if ((nbits = entry.nbits[2]) && nbits <= len) {
-                                        dst.push_back(entry.sym[2]);
-                                        len -= nbits;
-                                }
-                        }
-                        // actually consume bits
-                        bits &= ((ft_u32)0x7fffffffu >> (31 - len)); // (ft_u32)x >> 32 is implementation-defined
+        ft_u64 bits = 0; // only the lowest 'len' bits are meaningful
+        ft_u8 len = 0;
+        for (;;) {
+                if ((ft_size)(out_end - out) < room) {
+                        ft_size pos = out - & dst[0];
+                        dst.resize(dst.size() * 2);
+                        out = & dst[0] + pos;
+                        out_end = & dst[0] + dst.size();
+                }
+                while (len <= 56 && s != end) {
+                        bits = (bits << 8) | *s++;
+                        len += 8;
                 }
+                if (len < UNZBITS)
+                        break;
+                // fast path: every symbol of the table entry is complete
+                do {
+                        const unzbyte & entry = unztable[(bits >> (len - UNZBITS)) & ((1<<UNZBITS)-1)];
+                        out[0] = entry.sym[0];
+                        out[1] = entry.sym[1];
+                        out[2] = entry.sym[2];
+                        out += entry.n;
+                        len -= entry.nbits[2];
+                } while (len >= UNZBITS);
+        }
+        // last bits: source is exhausted, decode only complete symbols
+        while (len >= code_min_len) {
+                const unzbyte & entry = unztable[(bits << (UNZBITS - len)) & ((1<<UNZBITS)-1)];
+                ft_u8 i = 0;
+                for (; i < entry.n && entry.nbits[i] <= len; i++)
+                        *out++ = entry.sym[i];
+                if (i == 0)
+                        break;
+                len -= entry.nbits[i - 1];
         }
+        dst.resize(out - & dst[0]);
 }
 
 int ztest()
@@ -33,7 +33,7 @@ FT_ARCH_NAMESPACE_BEGIN
 
 /**
  * return an approximation of free system memory in bytes,
- * or 0 if cannot be determined
+ * also honoring cgroup memory limits on Linux, or 0 if cannot be determined
  */
 ft_uoff ff_arch_mem_system_free() {
 #if defined(__linux__)
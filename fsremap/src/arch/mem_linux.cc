@@ -39,20 +39,21 @@
 # include <cstdio>       // for FILE, fopen(), fclose()
 #endif
 #if defined(FT_HAVE_STRING_H)
-# include <string.h>     // for strcmp()
+# include <string.h>     // for strcmp(), strchr(), strncmp()
 #elif defined(FT_HAVE_CSTRING)
-# include <cstring>      // for strcmp()
+# include <cstring>      // for strcmp(), strchr(), strncmp()
 #endif
 
 
-#include "../log.hh" // for ff_log()
+#include "../log.hh"  // for ff_log()
+#include "../misc.hh" // for ff_min2(), ff_pretty_size()
 
 
 FT_ARCH_NAMESPACE_BEGIN
 
 /**
  * return an approximation of free system memory in bytes,
- * or 0 if cannot be determined
+ * also honoring cgroup memory limits, or 0 if cannot be determined
  */
 ft_uoff ff_arch_linux_mem_system_free() {
     FILE * f = fopen("/proc/meminfo", "r");
@@ -108,9 +109,165 @@ ft_uoff ff_arch_linux_mem_system_free() {
     }
     if (fclose(f) != 0)
         ff_log(FC_WARN, errno, "error closing /proc/meminfo");
+
+    ft_uoff cgroup_free = ff_arch_linux_mem_cgroup_free();
+    if (cgroup_free != (ft_uoff)-1 && (total == 0 || cgroup_free < total)) {
+        double pretty_len = 0.0;
+        const char * pretty_label = ff_pretty_size(cgroup_free, & pretty_len);
+        ff_log(FC_DEBUG, 0, "cgroup memory limits leave only %.2f %sbytes RAM available", pretty_len, pretty_label);
+
+        /* 0 would mean "cannot be determined" */
+        total = cgroup_free != 0 ? cgroup_free : 1;
+    }
     return total;
 }
 
+
+/**
+ * read a number of bytes from the first line of a cgroup file.
+ * return false if file cannot be read or does not contain a number,
+ * for example because it contains "max" i.e. no limit
+ */
+static bool ff_arch_linux_cgroup_read(const ft_string & path, ft_uoff & ret_n)
+{
+    FILE * f = fopen(path.c_str(), "r");
+    if (f == NULL)
+        return false;
+
+    ft_ull n_ull = 0;
+    bool ok = fscanf(f, "%" FT_ULL, & n_ull) == 1;
+    fclose(f);
+
+    if (ok) {
+        ret_n = (ft_uoff) n_ull;
+        /* overflow? then approximate.. */
+        if ((ft_ull) ret_n != n_ull)
+            ret_n = (ft_uoff)-1;
+    }
+    return ok;
+}
+
+/**
+ * read the value of 'key' from a cgroup memory.stat file.
+ * return 0 if file cannot be read or 'key' is not found
+ */
+static ft_uoff ff_arch_linux_cgroup_read_stat(const ft_string & path, const char * key)
+{
+    FILE * f = fopen(path.c_str(), "r");
+    if (f == NULL)
+        return 0;
+
+    char label[256];
+    ft_ull n_ull = 0;
+    ft_uoff ret = 0;
+    while (fscanf(f, "%255s %" FT_ULL, label, & n_ull) == 2) {
+        if (!strcmp(label, key)) {
+            ret = (ft_uoff) n_ull;
+            if ((ft_ull) ret != n_ull)
+                ret = (ft_uoff)-1;
+            break;
+        }
+    }
+    fclose(f);
+    return ret;
+}
+
+/**
+ * return the memory still available inside a single cgroup directory:
+ * its tightest limit, minus its current usage not counting reclaimable page cache.
+ * return (ft_uoff)-1 if the cgroup has no memory limits
+ */
+static ft_uoff ff_arch_linux_cgroup_dir_free(const ft_string & dir, bool v2)
+{
+    ft_uoff limit = (ft_uoff)-1, usage = 0, n;
+
+    if (v2) {
+        if (ff_arch_linux_cgroup_read(dir + "/memory.max", n))
+            limit = n;
+        /* exceeding memory.high does not kill us, but throttles us with heavy reclaim */
+        if (ff_arch_linux_cgroup_read(dir + "/memory.high", n))
+            limit = ff_min2(limit, n);
+    } else if (ff_arch_linux_cgroup_read(dir + "/memory.limit_in_bytes", n))
+        limit = n;
+
+    if (limit == (ft_uoff)-1
+        || !ff_arch_linux_cgroup_read(dir + (v2 ? "/memory.current" : "/memory.usage_in_bytes"), usage))
+        return limit;
+
+    /* as ff_arch_linux_mem_system_free() does, consider page cache as free */
+    ft_uoff cache = ff_arch_linux_cgroup_read_stat(dir + "/memory.stat", v2 ? "file" : "total_cache");
+    usage -= ff_min2(usage, cache);
+
+    return usage < limit ? limit - usage : 0;
+}
+
+/**
+ * return an approximation of the memory available to this process
+ * according to cgroup v2 or v1 memory limits of its cgroup and all its ancestors,
+ * or (ft_uoff)-1 if there are no limits or they cannot be determined
+ */
+ft_uoff ff_arch_linux_mem_cgroup_free()
+{
+    FILE * f = fopen("/proc/self/cgroup", "r");
+    if (f == NULL)
+        return (ft_uoff)-1;
+
+    ft_string v1_path, v2_path;
+    bool v1_found = false, v2_found = false;
+    char line[4096];
+
+    /* each line is "hierarchy-ID:controller-list:cgroup-path". cgroup v2 is "0::cgroup-path" */
+    while (fgets(line, sizeof(line), f) != NULL) {
+        char * controllers = strchr(line, ':'), * path, * end;
+        if (controllers == NULL || (path = strchr(++controllers, ':')) == NULL)
+            continue;
+        *path++ = '\0';
+        if ((end = strchr(path, '\n')) != NULL)
+            *end = '\0';
+
+        if (controllers[0] == '\0' && !strcmp(line, "0:")) {
+            v2_path = path;
+            v2_found = true;
+            continue;
+        }
+        /* look for "memory" inside comma-separated controller-list */
+        const char * c = controllers;
+        while (c != NULL) {
+            if (!strncmp(c, "memory", 6) && (c[6] == ',' || c[6] == '\0')) {
+                v1_path = path;
+                v1_found = true;
+                break;
+            }
+            if ((c = strchr(c, ',')) != NULL)
+                c++;
+        }
+    }
+    fclose(f);
+
+    /* on hybrid hierarchies, the memory controller is attached to cgroup v1 */
+    const bool v2 = !v1_found;
+    if (!v1_found && !v2_found)
+        return (ft_uoff)-1;
+
+    const ft_string root = v2 ? "/sys/fs/cgroup" : "/sys/fs/cgroup/memory";
+    ft_string path = v2 ? v2_path : v1_path;
+    ft_uoff ret = (ft_uoff)-1;
+
+    /*
+     * limits of ancestors apply too: walk up to the root.
+     * inside containers, cgroup-path may not exist below the mounted /sys/fs/cgroup:
+     * the walk then reaches the container's own cgroup, mounted as root
+     */
+    for (;;) {
+        ret = ff_min2(ret, ff_arch_linux_cgroup_dir_free(root + path, v2));
+        if (path.empty() || path == "/")
+            break;
+        ft_string::size_type slash = path.rfind('/');
+        path.erase(slash == ft_string::npos ? 0 : slash);
+    }
+    return ret;
+}
+
 FT_ARCH_NAMESPACE_END
 
 
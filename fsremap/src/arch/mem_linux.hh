@@ -34,10 +34,17 @@ FT_ARCH_NAMESPACE_BEGIN
 
 /**
  * return an approximation of free system memory in bytes,
- * or 0 if cannot be determined
+ * also honoring cgroup memory limits, or 0 if cannot be determined
  */
 ft_uoff ff_arch_linux_mem_system_free();
 
+/**
+ * return an approximation of the memory available to this process
+ * according to cgroup v2 or v1 memory limits of its cgroup and all its ancestors,
+ * or (ft_uoff)-1 if there are no limits or they cannot be determined
+ */
+ft_uoff ff_arch_linux_mem_cgroup_free();
+
 FT_ARCH_NAMESPACE_END
 
 #endif /* __linux__ */
@@ -30,7 +30,7 @@
 
 FT_NAMESPACE_BEGIN
 
-enum fr_storage_size     { FC_MEM_BUFFER_SIZE, FC_SECONDARY_STORAGE_SIZE, FC_PRIMARY_STORAGE_EXACT_SIZE, FC_SECONDARY_STORAGE_EXACT_SIZE, FC_STORAGE_SIZE_N, };
+enum fr_storage_size     { FC_MEM_BUFFER_SIZE, FC_SECONDARY_STORAGE_SIZE, FC_PRIMARY_STORAGE_EXACT_SIZE, FC_SECONDARY_STORAGE_EXACT_SIZE, FC_MEM_BUDGET_SIZE, FC_STORAGE_SIZE_N, };
 
 enum fr_clear_free_space { FC_CLEAR_AUTODETECT, FC_CLEAR_ALL, FC_CLEAR_MINIMAL, FC_CLEAR_NONE, };
 enum fr_job_id_kind      { FC_JOB_ID_AUTODETECT = 0 };
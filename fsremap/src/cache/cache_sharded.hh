@@ -0,0 +1,161 @@
+/*
+ * fstransform - transform a file-system to another file-system type,
+ *               preserving its contents and without the need for a backup
+ *
+ * Copyright (C) 2011-2012 Massimiliano Ghilardi
+ *
+ *     This program is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as published by
+ *     the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     This program is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public License
+ *     along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * cache/cache_sharded.hh
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: max
+ */
+
+#ifndef FSTRANSFORM_CACHE_SHARDED_HH
+#define FSTRANSFORM_CACHE_SHARDED_HH
+
+#include <vector>          // for std::vector<T>
+
+#include "../assert.hh"    // for ff_assert()
+#include "../thread.hh"    // for ft_mutex, ft_mutex_guard
+#include "../types.hh"     // for ft_size, ft_u64
+#include "cache.hh"        // for ft_cache<K,V>
+
+FT_NAMESPACE_BEGIN
+
+/**
+ * thread-safe associative array from keys (type K) to values (type V).
+ * Used to implement inode cache - see cache.hh for details.
+ *
+ * keys are spread among several shards, each made of a mutex and a wrapped ft_cache<K,V>:
+ * threads working on keys in different shards do not wait for each other.
+ * all the methods are thread-safe, as long as each wrapped cache is used only through this object.
+ */
+template<class K, class V>
+class ft_cache_sharded : public ft_cache<K, V>
+{
+private:
+    typedef ft_cache<K,V> super_type;
+
+    enum { FC_CACHE_LINE = 64, FC_SHARD_RUN_BITS = 6 };
+
+    /** one shard. padded, so that mutexes of different shards do not share cache lines */
+    struct ft_shard {
+        ft_mutex mutex;
+        super_type * cache;
+        char pad[FC_CACHE_LINE - (sizeof(ft_mutex) + sizeof(super_type *)) % FC_CACHE_LINE];
+
+        ft_shard() : mutex(), cache(NULL)
+        { }
+    };
+
+    ft_shard * shards;
+    ft_size shard_mask;
+
+    /** cannot call copy constructor */
+    ft_cache_sharded(const ft_cache_sharded<K,V> &);
+
+    /** cannot call assignment operator */
+    const ft_cache_sharded<K,V> & operator=(const ft_cache_sharded<K,V> &);
+
+    /**
+     * return the shard of 'key'. runs of 2^FC_SHARD_RUN_BITS consecutive keys share the same shard:
+     * consecutive inodes are common, and spreading them among shards wastes the locality
+     * of the wrapped caches. runs are spread among shards multiplying by 2^64 / golden ratio
+     */
+    FT_INLINE ft_shard & shard(const K key) const
+    {
+        ft_u64 h = ((ft_u64)key >> FC_SHARD_RUN_BITS) * (ft_u64)0x9E3779B97F4A7C15ULL;
+        return shards[(ft_size)(h >> 32) & shard_mask];
+    }
+
+public:
+    /**
+     * constructor. takes ownership of the caches in 'shard_caches',
+     * which will be deleted by destructor. their number must be a power of two
+     */
+    explicit ft_cache_sharded(const std::vector<super_type *> & shard_caches, const V & init_zero_payload = V())
+        : super_type(init_zero_payload), shards(NULL), shard_mask(0)
+    {
+        ft_size n = shard_caches.size();
+        ff_assert(n != 0 && (n & (n - 1)) == 0);
+        shards = new ft_shard[n];
+        shard_mask = n - 1;
+        for (ft_size i = 0; i < n; i++)
+            shards[i].cache = shard_caches[i];
+    }
+
+    /** destructor */
+    virtual ~ft_cache_sharded()
+    {
+        for (ft_size i = 0; i <= shard_mask; i++)
+            delete shards[i].cache;
+        delete[] shards;
+    }
+
+    /** return the number of shards */
+    FT_INLINE ft_size shard_count() const
+    {
+        return shard_mask + 1;
+    }
+
+    /**
+     * if cached inode found, set payload and return 1.
+     * Otherwise add it to cache and return 0.
+     * On error, return < 0.
+     * if returns 0, find_and_delete() must be called on the same inode when done with payload!
+     */
+    virtual int find_or_add(const K key, V & inout_payload)
+    {
+        ft_shard & s = shard(key);
+        ft_mutex_guard guard(s.mutex);
+        return s.cache->find_or_add(key, inout_payload);
+    }
+
+    /**
+     * if cached key found, set result_payload, remove cached key and return 1.
+     * Otherwise return 0. On error, return < 0.
+     */
+    virtual int find_and_delete(const K key, V & result_payload)
+    {
+        ft_shard & s = shard(key);
+        ft_mutex_guard guard(s.mutex);
+        return s.cache->find_and_delete(key, result_payload);
+    }
+
+    /**
+     * if cached inode found, change its payload and return 1.
+     * Otherwise return 0. On error, return < 0.
+     */
+    virtual int find_and_update(const K key, const V & new_payload)
+    {
+        ft_shard & s = shard(key);
+        ft_mutex_guard guard(s.mutex);
+        return s.cache->find_and_update(key, new_payload);
+    }
+
+    /** clear each shard in turn. not atomic with respect to concurrent calls on other shards */
+    virtual void clear()
+    {
+        for (ft_size i = 0; i <= shard_mask; i++) {
+            ft_mutex_guard guard(shards[i].mutex);
+            shards[i].cache->clear();
+        }
+    }
+};
+
+FT_NAMESPACE_END
+
+#endif /* FSTRANSFORM_CACHE_SHARDED_HH */
@@ -46,19 +46,21 @@
 FT_NAMESPACE_BEGIN
 
 /** one-arg constructor */
-ft_cache_symlink::ft_cache_symlink()
+ft_cache_symlink::ft_cache_symlink() : path(), reused(false)
 { }
 
 /** copy constructor */
-ft_cache_symlink::ft_cache_symlink(const ft_cache_symlink & other) : path(other.path)
+ft_cache_symlink::ft_cache_symlink(const ft_cache_symlink & other) : path(other.path), reused(other.reused)
 { }
 
 
 /** assignment operator */
 const ft_cache_symlink & ft_cache_symlink::operator=(const ft_cache_symlink & other)
 {
-    if (this != &other)
+    if (this != &other) {
         path = other.path;
+        reused = other.reused;
+    }
     return *this;
 }
 
@@ -79,6 +81,7 @@ int ft_cache_symlink::init(const ft_string & init_path)
         err = ff_log(exists ? FC_WARN : FC_ERROR, err, "failed to create cache directory `%s'", init_path.c_str());
         if (exists)
             err = 0;
+        reused = exists;
     }
     if (err == 0)
     {
@@ -40,6 +40,8 @@ class ft_cache_symlink
 {
 protected:
 	ft_string path;
+	/* true if cache directory already existed, i.e. it may contain entries from a previous run */
+	bool reused;
 
 	enum FT_ICP_OPTIONS { FT_ICP_READONLY, FT_ICP_READWRITE };
 
@@ -66,6 +68,9 @@ public:
     /* guaranteed NOT to end with '/', unless it's exactly the path "/" */
     const char * get_path() const { return path.c_str(); }
 
+    /* true if init() found an existing cache directory, possibly left by an interrupted run */
+    bool is_reused() const { return reused; }
+
     /* initialize the cache. return 0 on success, else return error */
     int init(const ft_string & init_path);
 
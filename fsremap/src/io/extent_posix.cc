@@ -31,9 +31,9 @@
 # include <cerrno>         // for errno, ENOMEM, EINVAL, EFBIG
 #endif
 #if defined(FT_HAVE_STDLIB_H)
-# include <stdlib.h>       // for malloc(), free()
+# include <stdlib.h>       // for malloc(), realloc(), free()
 #elif defined(FT_HAVE_CSTDLIB)
-# include <cstdlib>        // for malloc(), free()
+# include <cstdlib>        // for malloc(), realloc(), free()
 #endif
 #if defined(FT_HAVE_STRING_H)
 # include <string.h>       // for memset()
@@ -58,6 +58,8 @@
 
 
 #include "../log.hh"       // for ff_log() */
+#include "../misc.hh"      // for ff_min2(), ff_max2(), ff_now() */
+#include "../thread.hh"    // for ft_mutex, ff_thread_run(), ff_thread_cpu_count() */
 #include "../traits.hh"    // for FT_TYPE_TO_UNSIGNED(T) */
 #include "../types.hh"     // for ft_off */
 #include "../extent.hh"    // for fr_extent<T>, fr_map<T>, ff_filemap() */
@@ -67,6 +69,153 @@
 
 FT_IO_NAMESPACE_BEGIN
 
+/**
+ * increment a counter of DEBUG messages and return its previous value.
+ * atomic: extents of several files may be read at the same time by different threads
+ */
+static FT_INLINE ft_ull ff_extent_log_count(ft_ull & count)
+{
+    return __atomic_fetch_add(& count, 1, __ATOMIC_RELAXED);
+}
+
+#ifdef FIBMAP
+
+enum {
+    /** do not start more threads than (file blocks / FC_FIBMAP_BLOCKS_PER_THREAD) */
+    FC_FIBMAP_BLOCKS_PER_THREAD = 65536,
+};
+
+/* ioctl(FIBMAP) fallback settings and statistics, shared by all files */
+static ft_mutex fc_fibmap_mutex;
+static bool fc_fibmap_probe = false;
+static ft_ull fc_fibmap_file_n = 0, fc_fibmap_ioctl_n = 0;
+static double fc_fibmap_seconds = 0.0;
+
+/** shared state of the threads started by ff_posix_fibmap() */
+struct ft_fibmap_job
+{
+    int fd, block_n;
+    ft_uoff block_size;
+    ft_size thread_n;
+    bool probe;
+
+    /** per-thread results, concatenated after all threads finished */
+    struct result {
+        fr_vector<ft_uoff> list;
+        ft_ull ioctl_n;
+    };
+    std::vector<result> results;
+};
+
+/**
+ * call ioctl(FIBMAP) on a single logical block and return the physical block in ret_physical.
+ * FIBMAP reports holes (i.e. unallocated blocks in the file) as physical == 0. ugly
+ */
+static int ff_posix_fibmap1(int fd, int logical, int & ret_physical, ft_ull & ioctl_n)
+{
+    int err, physical = logical;
+
+    ioctl_n++;
+    if ((err = ff_posix_ioctl(fd, FIBMAP, & physical)) != 0)
+        return ff_log(FC_ERROR, err, "ff_posix_fibmap(): error in ioctl(%d, FIBMAP, %" FT_ULL ")", fd, (ft_ull) logical);
+
+    ret_physical = physical;
+    return err;
+}
+
+/**
+ * find how many blocks starting from 'logical' continue the run started by 'physical',
+ * i.e. map to consecutive physical blocks (or are all holes if physical == 0).
+ * probes logical + 1, + 2, + 4 ... until a mismatch, then binary-searches the end of the run.
+ *
+ * NOTE: blocks between two probes are assumed, NOT verified, to belong to the run.
+ */
+static int ff_posix_fibmap_probe(int fd, int logical, int physical, int logical_end, int & ret_run_n, ft_ull & ioctl_n)
+{
+    // blocks [logical, logical + lo] belong to the run,
+    // block logical + hi does not (or is logical_end)
+    int lo = 0, hi = logical_end - logical, k, p, err = 0;
+    bool exponential = true;
+
+    while (lo + 1 < hi) {
+        if (exponential)
+            k = (lo == 0) ? 1 : lo <= (hi - 1) / 2 ? lo * 2 : hi - 1;
+        else
+            k = lo + (hi - lo) / 2;
+
+        if ((err = ff_posix_fibmap1(fd, logical + k, p, ioctl_n)) != 0)
+            break;
+
+        if (physical == 0 ? p == 0 : p != 0 && (ft_uoff) p == (ft_uoff) physical + (ft_uoff) k)
+            lo = k;
+        else
+            hi = k, exponential = false;
+    }
+    ret_run_n = lo + 1;
+    return err;
+}
+
+/** ft_thread_func executed by each thread started by ff_posix_fibmap() */
+static int ff_posix_fibmap_thread(void * arg, ft_size thread_i)
+{
+    ft_fibmap_job & job = * (ft_fibmap_job *) arg;
+    ft_fibmap_job::result & result = job.results[thread_i];
+    const ft_uoff block_size = job.block_size;
+
+    // each thread examines a contiguous range of logical blocks
+    int logical = (int) ((ft_uoff) job.block_n * thread_i / job.thread_n);
+    int logical_end = (int) ((ft_uoff) job.block_n * (thread_i + 1) / job.thread_n);
+    int physical, run_n, err = 0;
+
+    while (logical < logical_end) {
+        if ((err = ff_posix_fibmap1(job.fd, logical, physical, result.ioctl_n)) != 0)
+            break;
+
+        run_n = 1;
+        if (job.probe && (err = ff_posix_fibmap_probe(job.fd, logical, physical, logical_end, run_n, result.ioctl_n)) != 0)
+            break;
+
+        if (physical != 0) {
+            /* fr_vector<T>::append() merges adjacent extents */
+            result.list.append((ft_uoff) physical * block_size, (ft_uoff) logical * block_size,
+                               (ft_uoff) run_n * block_size, FC_DEFAULT_USER_DATA);
+        }
+        logical += run_n;
+    }
+    return err;
+}
+#endif /* FIBMAP */
+
+/**
+ * enable or disable run-length probing in the ioctl(FIBMAP) fallback. default: disabled.
+ * see ff_posix_fibmap() for details
+ */
+void ff_posix_fibmap_set_probe(bool probe)
+{
+#ifdef FIBMAP
+    ft_mutex_guard guard(fc_fibmap_mutex);
+    fc_fibmap_probe = probe;
+#else
+    (void) probe;
+#endif
+}
+
+/**
+ * if the ioctl(FIBMAP) fallback was used, log how many files used it,
+ * how many ioctl(FIBMAP) were needed and how much time they took
+ */
+void ff_posix_fibmap_show_stats()
+{
+#ifdef FIBMAP
+    ft_mutex_guard guard(fc_fibmap_mutex);
+    if (fc_fibmap_file_n == 0)
+        return;
+    ff_log(FC_NOTICE, 0, "slow ioctl(FIBMAP) used instead of ioctl(FS_IOC_FIEMAP) on %" FT_ULL " file%s: %" FT_ULL " call%s in %.2f seconds%s",
+           fc_fibmap_file_n, fc_fibmap_file_n == 1 ? "" : "s", fc_fibmap_ioctl_n, fc_fibmap_ioctl_n == 1 ? "" : "s",
+           fc_fibmap_seconds, fc_fibmap_probe ? " (with run-length probing)" : "");
+#endif
+}
+
 /**
  * retrieves file blocks allocation map (extents) for specified file descriptor
  * and appends them to ret_vector (with user_data = FC_DEFAULT_USER_DATA).
@@ -74,18 +223,31 @@ FT_IO_NAMESPACE_BEGIN
  *
  * must (and will) also check that device size can be represented by ret_list,
  *
- * implementation: calls ioctl(FIBMAP)
+ * implementation: calls ioctl(FIBMAP), which maps a single block per call,
+ * from one thread per CPU (at most 'thread_max', if not zero) each examining a contiguous range of the file.
+ * if enabled by ff_posix_fibmap_set_probe(), uses ff_posix_fibmap_probe()
+ * to find contiguous runs with much fewer calls
  */
-static int ff_posix_fibmap(int fd, ft_uoff dev_length, fr_vector<ft_uoff> & ret_list, ft_uoff & ret_block_size_bitmask)
+static int ff_posix_fibmap(int fd, ft_uoff dev_length, fr_vector<ft_uoff> & ret_list, ft_uoff & ret_block_size_bitmask,
+                           ft_size thread_max)
 {
 #ifdef FIBMAP
     ft_uoff file_length, file_block_count, dev_block_count;
-    ft_uoff ioctl_n = 0, block_size = 0, logical_uoff, physical_uoff;
+    ft_uoff block_size = 0;
+    ft_ull ioctl_n = 0;
+    double time_start = 0.0, time_end = 0.0;
 
     ft_size extent_n = ret_list.size();
 
     /* lower-level API ff_posix_ioctl(FIGETBSZ) and ff_posix_ioctl(FIBMAP) need these to be int */
-    int err = 0, block_size_int, logical, physical;
+    int err = 0, block_size_int;
+
+    ft_fibmap_job job;
+    {
+        ft_mutex_guard guard(fc_fibmap_mutex);
+        job.probe = fc_fibmap_probe;
+    }
+    ff_now(time_start);
 
     do {
         if ((err = ff_posix_ioctl(fd, FIGETBSZ, & block_size_int))) {
@@ -126,35 +288,50 @@ static int ff_posix_fibmap(int fd, ft_uoff dev_length, fr_vector<ft_uoff> & ret_
                          (ft_ull) dev_block_count, (ft_ull) file_block_count);
             break;
         }
+        if (n == 0)
+            break;
 
-        for (logical = 0; logical < n; logical++) {
-            physical = logical;
-            ioctl_n++;
-            if ((err = ff_posix_ioctl(fd, FIBMAP, & physical))) {
-                err = ff_log(FC_ERROR, err, "ff_posix_fibmap(): error in ioctl(%d, FIBMAP, %" FT_ULL ")", fd, (ft_ull) logical);
-                break;
-            }
-            /* FIBMAP reports holes (i.e. unallocated blocks in the file) as physical == 0. ugly */
-            if (physical != 0) {
-                physical_uoff = (ft_uoff) physical * block_size;
-                logical_uoff = (ft_uoff) logical * block_size;
-
-                /* this is painful... FIBMAP reports one block per call */
-                ret_list.append(physical_uoff, logical_uoff, block_size, FC_DEFAULT_USER_DATA);
-            }
+        job.fd = fd;
+        job.block_n = n;
+        job.block_size = block_size;
+        if (thread_max == 0)
+            thread_max = ff_thread_cpu_count();
+        job.thread_n = ff_max2((ft_size) 1, ff_min2(thread_max, (ft_size) (n / FC_FIBMAP_BLOCKS_PER_THREAD)));
+        job.results.resize(job.thread_n);
+
+        ft_size i;
+        for (i = 0; i < job.thread_n; i++)
+            job.results[i].ioctl_n = 0;
+
+        err = ff_thread_run(job.thread_n, ff_posix_fibmap_thread, & job);
+
+        for (i = 0; i < job.thread_n; i++) {
+            ioctl_n += job.results[i].ioctl_n;
+            /* threads examined consecutive ranges: concatenating their results keeps ret_list sorted by ->logical */
+            if (err == 0)
+                ret_list.append_all(job.results[i].list);
         }
     } while (0);
 
+    ff_now(time_end);
+    {
+        ft_mutex_guard guard(fc_fibmap_mutex);
+        fc_fibmap_file_n++;
+        fc_fibmap_ioctl_n += ioctl_n;
+        fc_fibmap_seconds += time_end - time_start;
+    }
+
     if (err == 0) {
         static ft_ull log_count = 0;
+        const ft_ull log_n = ff_extent_log_count(log_count);
 
-        if (log_count++ == 5)
+        if (log_n == 5)
             ff_log(FC_DEBUG, 0, "decreasing to level TRACE any further DEBUG message 'ioctl(FIBMAP) successful'");
 
         extent_n = ret_list.size() - extent_n;
 
-        ff_log(log_count < 5 ? FC_DEBUG : FC_TRACE, 0, "ioctl(%d, FIBMAP) successful: retrieved %" FT_ULL " extent%s in %" FT_ULL " call%s",
-                fd, (ft_ull) extent_n, extent_n == 1 ? "" : "s", (ft_ull) ioctl_n, ioctl_n == 1 ? "" : "s");
+        ff_log(log_n < 5 ? FC_DEBUG : FC_TRACE, 0, "ioctl(%d, FIBMAP) successful: retrieved %" FT_ULL " extent%s in %" FT_ULL " call%s, %.3f seconds",
+                fd, (ft_ull) extent_n, extent_n == 1 ? "" : "s", ioctl_n, ioctl_n == 1 ? "" : "s", time_end - time_start);
         /* keep track of bits used by extents. needed to compute effective block size */
         ret_block_size_bitmask |= block_size;
     }
@@ -166,7 +343,7 @@ static int ff_posix_fibmap(int fd, ft_uoff dev_length, fr_vector<ft_uoff> & ret_
 
 
 #ifdef FS_IOC_FIEMAP
-static int ff_linux_fiemap(int fd, ft_uoff file_start, ft_uoff file_end, ft_u32 extent_n, struct fiemap * k_map)
+static int ff_linux_fiemap(int fd, ft_uoff file_start, ft_uoff file_end, ft_u32 flags, ft_u32 extent_n, struct fiemap * k_map)
 {
     ft_size k_len = sizeof(struct fiemap) + extent_n * sizeof(struct fiemap_extent);
 
@@ -174,17 +351,18 @@ static int ff_linux_fiemap(int fd, ft_uoff file_start, ft_uoff file_end, ft_u32
 
     k_map->fm_start = (ft_u64) file_start;
     k_map->fm_length = (ft_u64) (file_end - file_start);
-    k_map->fm_flags = FIEMAP_FLAG_SYNC;
+    k_map->fm_flags = flags;
     k_map->fm_extent_count = extent_n;
 
     int err = 0;
     if ((err = ff_posix_ioctl(fd, FS_IOC_FIEMAP, k_map)) != 0) {
         static ft_ull log_count = 0;
-        if (log_count++ == 5)
+        const ft_ull log_n = ff_extent_log_count(log_count);
+        if (log_n == 5)
             ff_log(FC_DEBUG, 0, "decreasing to level TRACE any further DEBUG message 'ioctl(FIEMAP) failed'");
 
         /* do not mark the error as reported, this is just a DEBUG message */
-        ff_log(log_count < 5 ? FC_DEBUG : FC_TRACE, 0,
+        ff_log(log_n < 5 ? FC_DEBUG : FC_TRACE, 0,
                 "ioctl(%d, FIEMAP, extents[%" FT_ULL "]) failed (%s), falling back on ioctl(FIBMAP) ...",
                 fd, (ft_ull) extent_n, strerror(err));
     }
@@ -199,7 +377,10 @@ static int ff_linux_fiemap(int fd, ft_uoff file_start, ft_uoff file_end, ft_u32
  *
  * must (and will) also check that device size can be represented by ret_list
  *
- * implementation: calls ioctl(FS_IOC_FIEMAP)
+ * implementation: calls ioctl(FS_IOC_FIEMAP).
+ * the first call has fm_extent_count = 0 and FIEMAP_FLAG_SYNC: it flushes the file
+ * and only counts its extents, so that the following calls can retrieve all of them
+ * at once into a heap buffer of the right size (clamped to [K_EXTENT_N_MIN, K_EXTENT_N_MAX])
  */
 static int ff_linux_fiemap(int fd, fr_vector<ft_uoff> & ret_list, ft_uoff & ret_block_size_bitmask)
 {
@@ -210,18 +391,35 @@ static int ff_linux_fiemap(int fd, fr_vector<ft_uoff> & ret_list, ft_uoff & ret_
     if ((err = ff_posix_size(fd, & file_size)) || file_size == 0)
         return err;
 
-    fr_vector<ft_uoff> tmp_list;
-
     enum {
-        K_EXTENT_N = 1024,
-        K_SIZEOF_FIEMAP = sizeof(struct fiemap) + K_EXTENT_N * sizeof(struct fiemap_extent)
+        K_EXTENT_N_MIN = 32,
+        K_EXTENT_N_MAX = 65536,
     };
-    char buf[K_SIZEOF_FIEMAP];
-    struct fiemap * k_map = (struct fiemap *) buf;
+    struct fiemap k_probe;
+    struct fiemap * k_map = NULL;
+    ft_u32 k_extent_n = 0;
     ft_uoff ioctl_n = 0, block_size_bitmask = ret_block_size_bitmask;
 
+    /* sync the file only once, and ask how many extents it has */
+    ioctl_n++;
+    if ((err = ff_linux_fiemap(fd, file_start, file_size, FIEMAP_FLAG_SYNC, 0, & k_probe)) != 0)
+        return err;
+
+    k_extent_n = k_probe.fm_mapped_extents;
+    if (k_extent_n < K_EXTENT_N_MIN)
+        k_extent_n = K_EXTENT_N_MIN;
+    else if (k_extent_n > K_EXTENT_N_MAX)
+        k_extent_n = K_EXTENT_N_MAX;
+
+    if ((k_map = (struct fiemap *) malloc(sizeof(struct fiemap) + k_extent_n * sizeof(struct fiemap_extent))) == NULL)
+        return ff_log(FC_ERROR, ENOMEM, "ff_linux_fiemap(): failed to allocate buffer for ioctl(%d, FS_IOC_FIEMAP, extents[%" FT_ULL "])",
+                      fd, (ft_ull) k_extent_n);
+
+    fr_vector<ft_uoff> tmp_list;
+    tmp_list.reserve(k_probe.fm_mapped_extents);
+
     // call ioctl() repeatedly until we retrieve all extents
-    while (ioctl_n++, (err = ff_linux_fiemap(fd, file_start, file_size, K_EXTENT_N, k_map)) == 0) {
+    while (ioctl_n++, (err = ff_linux_fiemap(fd, file_start, file_size, 0, k_extent_n, k_map)) == 0) {
 
         ft_u32 i, extent_n = k_map->fm_mapped_extents;
         const struct fiemap_extent * extents = k_map->fm_extents;
@@ -283,7 +481,20 @@ static int ff_linux_fiemap(int fd, fr_vector<ft_uoff> & ret_list, ft_uoff & ret_
             // should not happen, but not too dangerous
             file_size = new_file_start + 1;
         file_start = new_file_start;
+
+        // the file has more extents than counted by the first call: grow the buffer
+        if (extent_n == k_extent_n && k_extent_n < K_EXTENT_N_MAX) {
+            ft_u32 new_extent_n = k_extent_n <= K_EXTENT_N_MAX / 2 ? k_extent_n * 2 : (ft_u32) K_EXTENT_N_MAX;
+            struct fiemap * new_map = (struct fiemap *) realloc(k_map, sizeof(struct fiemap) + new_extent_n * sizeof(struct fiemap_extent));
+            if (new_map != NULL) {
+                k_map = new_map;
+                k_extent_n = new_extent_n;
+            }
+            // if realloc() fails, just continue with the old buffer
+        }
     }
+    free(k_map);
+
     if (err != 0)
         return err;
 
@@ -294,10 +505,11 @@ static int ff_linux_fiemap(int fd, fr_vector<ft_uoff> & ret_list, ft_uoff & ret_
     ret_list.append_all(tmp_list);
 
     static ft_ull log_count = 0;
-    if (log_count++ == 5)
+    const ft_ull log_n = ff_extent_log_count(log_count);
+    if (log_n == 5)
         ff_log(FC_DEBUG, 0, "decreasing to level TRACE any further DEBUG message 'ioctl(FIEMAP) successful'");
 
-    ff_log(log_count < 5 ? FC_DEBUG : FC_TRACE, 0, "ioctl(%d, FIEMAP) successful: retrieved %" FT_ULL " extent%s in %" FT_ULL " call%s",
+    ff_log(log_n < 5 ? FC_DEBUG : FC_TRACE, 0, "ioctl(%d, FIEMAP) successful: retrieved %" FT_ULL " extent%s in %" FT_ULL " call%s",
             fd, (ft_ull) extent_n, extent_n == 1 ? "" : "s", (ft_ull) ioctl_n, ioctl_n == 1 ? "" : "s");
     ret_block_size_bitmask = block_size_bitmask;
 
@@ -315,14 +527,16 @@ static int ff_linux_fiemap(int fd, fr_vector<ft_uoff> & ret_list, ft_uoff & ret_
  * in case of failure returns errno-compatible error code, and ret_vector contents will be UNDEFINED.
  *
  * implementation: calls ioctl(FS_IOC_FIEMAP) and if it fails, tries with ioctl(FIBMAP)
+ * using at most 'fibmap_thread_max' threads, or one per CPU if zero
  */
-int ff_read_extents_posix(int fd, ft_uoff dev_length, fr_vector<ft_uoff> & ret_list, ft_uoff & ret_block_size_bitmask)
+int ff_read_extents_posix(int fd, ft_uoff dev_length, fr_vector<ft_uoff> & ret_list, ft_uoff & ret_block_size_bitmask,
+                          ft_size fibmap_thread_max)
 {
     int err;
     do {
         err = ff_linux_fiemap(fd, ret_list, ret_block_size_bitmask);
         if (err != 0) {
-            int err2 = ff_posix_fibmap(fd, dev_length, ret_list, ret_block_size_bitmask);
+            int err2 = ff_posix_fibmap(fd, dev_length, ret_list, ret_block_size_bitmask, fibmap_thread_max);
             if (err2 != 0) {
                 if (!ff_log_is_reported(err))
                     err = ff_log(FC_ERROR, err,  "%s", "failed to list file blocks with ioctl(FS_IOC_FIEMAP)");
@@ -38,8 +38,27 @@ FT_IO_NAMESPACE_BEGIN
  * in case of failure returns errno-compatible error code, and ret_vector contents will be UNDEFINED.
  *
  * implementation: calls ioctl(FS_IOC_FIEMAP) and if it fails, tries with ioctl(FIBMAP)
+ * using at most 'fibmap_thread_max' threads, or one per CPU if zero.
+ * callers already running in one of several threads should pass a small fibmap_thread_max
  */
-int ff_read_extents_posix(int fd, ft_uoff dev_length, fr_vector<ft_uoff> & ret_list, ft_uoff & ret_block_size_bitmask);
+int ff_read_extents_posix(int fd, ft_uoff dev_length, fr_vector<ft_uoff> & ret_list, ft_uoff & ret_block_size_bitmask,
+                          ft_size fibmap_thread_max = 0);
+
+/**
+ * enable or disable run-length probing in the ioctl(FIBMAP) fallback. default: disabled.
+ *
+ * ioctl(FIBMAP) maps a single block per call. with probing enabled, after mapping a block
+ * the following blocks +1, +2, +4 ... are mapped until one of them does not continue
+ * the contiguous run, then the end of the run is binary-searched.
+ * much faster on large files, but blocks between two probes are assumed, NOT verified, to belong to the run
+ */
+void ff_posix_fibmap_set_probe(bool probe);
+
+/**
+ * if the ioctl(FIBMAP) fallback was used, log how many files used it,
+ * how many ioctl(FIBMAP) were needed and how much time they took
+ */
+void ff_posix_fibmap_show_stats();
 
 
 FT_IO_NAMESPACE_END
@@ -25,6 +25,11 @@
 
 #include "../first.hh"
 
+#if defined(FT_HAVE_ERRNO_H)
+# include <errno.h>        // for errno
+#elif defined(FT_HAVE_CERRNO)
+# include <cerrno>         // for errno
+#endif
 #if defined(FT_HAVE_STDIO_H)
 # include <stdio.h>        // for fopen(), fclose()
 #elif defined(FT_HAVE_CSTDIO)
@@ -34,6 +39,7 @@
 
 #include "../log.hh"       // for ff_log()
 #include "../misc.hh"      // for ff_can_sum()
+#include "../thread.hh"    // for ff_thread_run()
 #include "../ui/ui.hh"     // for fr_ui
 #include "io.hh"           // for fr_io
 #include "extent_file.hh"  // for ff_write_extents_file()
@@ -194,38 +200,47 @@ int fr_io::load_extents(fr_vector<ft_uoff> & loop_file_extents,
     return err;
 }
 
+/** shared state of the threads started by fr_io::save_extents() */
+struct fr_io_save_extents_job
+{
+    const ft_string * job_dir;
+    const fr_vector<ft_uoff> * extents[fr_io::FC_IO_EXTENTS_COUNT];
+};
+
+/** ft_thread_func executed by each thread started by fr_io::save_extents(): saves extents[i] */
+static int ff_io_save_extents_thread(void * arg, ft_size i)
+{
+    const fr_io_save_extents_job & job = * (const fr_io_save_extents_job *) arg;
+    ft_string path = * job.job_dir;
+    path += fr_io::extents_filename[i];
+    const char * path_cstr = path.c_str();
+    FILE * f = NULL;
+    int err = 0;
+
+    if ((f = fopen(path_cstr, "w")) == NULL)
+        return ff_log(FC_ERROR, errno, "error opening persistence file '%s'", path_cstr);
+
+    if ((err = ff_save_extents_file(f, * job.extents[i])) != 0)
+        err = ff_log(FC_ERROR, err, "error writing to persistence file '%s'", path_cstr);
+
+    if (fclose(f) != 0)
+        ff_log(FC_WARN, errno, "error closing persistence file '%s'", path_cstr);
+
+    return err;
+}
+
 /**
  * saves extents to files job.job_dir() + '/loop_extents.txt' and job.job_dir() + '/free_space_extents.txt'
- * by calling the function ff_save_extents_file()
+ * by calling the function ff_save_extents_file().
+ * the files are written in parallel, one thread each
  */
 int fr_io::save_extents(const fr_vector<ft_uoff> & loop_file_extents,
                         const fr_vector<ft_uoff> & free_space_extents,
                         const fr_vector<ft_uoff> & to_zero_extents) const
 {
-	const fr_vector<ft_uoff> * extents[] = { & loop_file_extents, & free_space_extents, & to_zero_extents };
-    ft_string path;
-    const ft_string & job_dir = this_job.job_dir();
-    FILE * f = NULL;
-    const char * path_cstr = NULL;
-    int err = 0;
+    fr_io_save_extents_job job = { & this_job.job_dir(), { & loop_file_extents, & free_space_extents, & to_zero_extents } };
 
-    for (ft_size i = 0; err == 0 && i < FC_IO_EXTENTS_COUNT; i++) {
-        path = job_dir;
-        path += extents_filename[i];
-        path_cstr = path.c_str();
-        if ((f = fopen(path_cstr, "w")) == NULL) {
-            err = ff_log(FC_ERROR, errno, "error opening persistence file '%s'", path_cstr);
-            break;
-        }
-        if ((err = ff_save_extents_file(f, * extents[i])) != 0)
-            err = ff_log(FC_ERROR, err, "error writing to persistence file '%s'", path_cstr);
-
-        if (fclose(f) != 0) {
-            ff_log(FC_WARN, errno, "error closing persistence file '%s'", path_cstr);
-            f = NULL;
-        }
-    }
-    return err;
+    return ff_thread_run(FC_IO_EXTENTS_COUNT, ff_io_save_extents_thread, & job);
 }
 
 /**
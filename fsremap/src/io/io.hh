@@ -302,7 +302,8 @@ public:
 
     /**
      * saves extents to files 'loop_extents.txt', 'free_space_extents.txt' and 'to_zero_extents.txt'
-     * inside folder job.job_dir() by calling the function ff_save_extents_file()
+     * inside folder job.job_dir() by calling the function ff_save_extents_file().
+     * the files are written in parallel, one thread each
      */
     int save_extents(const fr_vector<ft_uoff> & loop_file_extents,
                      const fr_vector<ft_uoff> & free_space_extents,
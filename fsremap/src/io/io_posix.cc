@@ -59,16 +59,20 @@
 # include <unistd.h>       // for close()
 #endif
 #ifdef FT_HAVE_SYS_MMAN_H
-# include <sys/mman.h>     // for mmap(), munmap()
+# include <sys/mman.h>     // for mmap(), munmap(), mlock(), madvise()
 #endif
 
 
 #include "../log.hh"      // for ff_log()
 #include "../misc.hh"     // for ff_max2(), ff_min2()
 
+#include "../thread.hh"   // for ff_thread_run(), ff_thread_cpu_count()
+#include "../zero.hh"     // for ff_mem_is_zero()
+
+#include "../arch/mem.hh" // for ff_arch_mem_page_size()
 #include "../ui/ui.hh"    // for fr_ui
 
-#include "extent_posix.hh" // for ff_read_extents_posix()
+#include "extent_posix.hh" // for ff_read_extents_posix(), ff_posix_fibmap_show_stats()
 #include "util_posix.hh"   // for ff_posix_*() misc functions
 #include "io_posix.hh"     // for fr_io_posix
 
@@ -422,6 +426,8 @@ int fr_io_posix::read_extents(fr_vector<ft_uoff> & loop_file_extents,
 
     } while (0);
 
+    ff_posix_fibmap_show_stats();
+
     if (err == 0)
         ret_block_size_bitmask = block_size_bitmask;
 
@@ -683,7 +689,9 @@ int fr_io_posix::create_storage(ft_size secondary_size, ft_size mem_buffer_size)
             ff_log(FC_FATAL, 0, "internal error, mapped %s extents in RAM used %" FT_ULL " bytes instead of expected %" FT_ULL " bytes",
                     label[FC_STORAGE], (ft_ull) mem_offset, (ft_ull) storage_mmap_size);
             err = EINVAL;
+            break;
         }
+        err = prefault_storage();
     } while (0);
 
     if (err == 0) {
@@ -757,20 +765,6 @@ int fr_io_posix::replace_storage_mmap(int fd, const char * label_i,
                 " mmap(address + %" FT_ULL ", length = %" FT_ULL ", MAP_FIXED) = ok",
                 label_i, (ft_ull) extent_index, (ft_ull) mem_start, (ft_ull) len);
 
-#ifdef FT_HAVE_MLOCK
-        if (!simulate_run() && mlock(addr_new, len) != 0) {
-            ff_log(FC_WARN, errno, "%s extent #%" FT_ULL " mlock(address + %" FT_ULL ", length = %" FT_ULL ") failed",
-                   label_i, (ft_ull) extent_index, (ft_ull) mem_start, (ft_ull) len);
-        }
-#else
-#warning mlock() not found on this platform. fsremap will be vulnerable to memory exhaustion from other programs
-        static bool warned_no_mlock = false;
-        if (!warned_no_mlock) {
-            warned_no_mlock = true;
-            ff_log(FC_WARN, 0, "fsremap was compiled without support for mlock()");
-            ff_log(FC_WARN, 0, "for the safety of your data, please do not start memory-hungry programs while fsremap is running");
-        }
-#endif
         /**
          * all ok, let's store mmapped() address offset into extent.user_data to remember it,
          * as msync() inside flush() and munmap() inside close_storage() could need it
@@ -784,6 +778,94 @@ int fr_io_posix::replace_storage_mmap(int fd, const char * label_i,
 }
 
 
+/** argument passed to ff_io_posix_prefault_thread() */
+struct fr_io_posix_prefault_job
+{
+    const char * label;
+    char * mem;
+    ft_size mem_len;
+    ft_size chunk_len;
+    ft_size page_size;
+};
+
+/**
+ * pre-fault the chunk of mmapped() STORAGE assigned to thread_i:
+ * mlock() it if possible, which also faults it in,
+ * otherwise read one byte from each page.
+ * always returns 0: failures only cost performance, not correctness
+ */
+static int ff_io_posix_prefault_thread(void * arg, ft_size thread_i)
+{
+    const fr_io_posix_prefault_job & job = * (const fr_io_posix_prefault_job *) arg;
+    const ft_size mem_start = thread_i * job.chunk_len;
+    if (mem_start >= job.mem_len)
+        return 0;
+
+    const ft_size len = ff_min2(job.chunk_len, job.mem_len - mem_start);
+    char * mem = job.mem + mem_start;
+
+#ifdef FT_HAVE_MLOCK
+    if (mlock(mem, len) == 0)
+        return 0;
+    ff_log(FC_WARN, errno, "%s mlock(address + %" FT_ULL ", length = %" FT_ULL ") failed",
+           job.label, (ft_ull) mem_start, (ft_ull) len);
+#endif
+    const volatile char * page = mem;
+    for (ft_size offset = 0; offset < len; offset += job.page_size)
+        (void) page[offset];
+    return 0;
+}
+
+/**
+ * pre-fault and mlock() the whole mmapped() STORAGE, splitting the work among multiple threads,
+ * so that relocation does not stall on page faults.
+ * return 0 if success, else error
+ */
+int fr_io_posix::prefault_storage()
+{
+    enum { FC_PREFAULT_CHUNK_MIN = 16*1024*1024 };
+
+#ifndef FT_HAVE_MLOCK
+#warning mlock() not found on this platform. fsremap will be vulnerable to memory exhaustion from other programs
+    ff_log(FC_WARN, 0, "fsremap was compiled without support for mlock()");
+    ff_log(FC_WARN, 0, "for the safety of your data, please do not start memory-hungry programs while fsremap is running");
+#endif
+    if (simulate_run() || storage_mmap_size == 0)
+        return 0;
+
+    fr_io_posix_prefault_job job;
+    job.label = label[FC_STORAGE];
+    job.mem = (char *) storage_mmap;
+    job.mem_len = storage_mmap_size;
+    if ((job.page_size = FT_ARCH_NS ff_arch_mem_page_size()) == 0)
+        job.page_size = 4096;
+
+#ifdef FT_HAVE_MADVISE
+    /* start asynchronous read-ahead of the whole STORAGE, threads below will wait for it */
+    if (madvise(storage_mmap, storage_mmap_size, MADV_WILLNEED) != 0)
+        ff_log(FC_DEBUG, errno, "%s madvise(length = %" FT_ULL ", MADV_WILLNEED) failed",
+               label[FC_STORAGE], (ft_ull) storage_mmap_size);
+#endif
+
+    ft_size thread_n = ff_min2(ff_thread_cpu_count(), (job.mem_len + FC_PREFAULT_CHUNK_MIN - 1) / FC_PREFAULT_CHUNK_MIN);
+    if (thread_n == 0)
+        thread_n = 1;
+    /* round chunks up to page size: mlock() wants page-aligned addresses */
+    job.chunk_len = (job.mem_len + thread_n - 1) / thread_n;
+    job.chunk_len = (job.chunk_len + job.page_size - 1) / job.page_size * job.page_size;
+
+    double time_start = 0.0, time_end = 0.0;
+    ff_now(time_start);
+
+    int err = ff_thread_run(thread_n, ff_io_posix_prefault_thread, & job);
+
+    ff_now(time_end);
+    ff_log(FC_INFO, 0, "%s pre-faulted in RAM by %" FT_ULL " thread%s in %.2f seconds", label[FC_STORAGE],
+           (ft_ull) thread_n, thread_n == 1 ? "" : "s", time_end - time_start);
+    return err;
+}
+
+
 /**
  * create and open SECONDARY-STORAGE in job.job_dir() + '.storage'
  * and fill it with 'secondary_len' bytes of zeros. do not mmap() it.
@@ -832,7 +914,7 @@ int fr_io_posix::create_secondary_storage(ft_size len)
                 ff_log(FC_INFO, 0, "%s: opened existing file '%s', is %.2f %sbytes long", label[j],
                         path, pretty_len, pretty_label);
         } else {
-            ff_log(FC_INFO, 0, "%s:%s writing %.2f %sbytes to '%s' ...", label[j], simulated_msg,
+            ff_log(FC_INFO, 0, "%s:%s preallocating %.2f %sbytes in '%s' ...", label[j], simulated_msg,
                     pretty_len, pretty_label, path);
             if (simulated) {
                 if ((err = ff_posix_lseek(fd[j], len - 1)) != 0) {
@@ -1073,11 +1155,7 @@ int fr_io_posix::flush_copy_bytes(fr_dir_posix dir, const fr_extent<ft_uoff> & r
 #ifdef ENABLE_CHECK_IF_MEM_IS_ZERO
 /** returns true if the specified memory range contains ONLY zeroes. */
 static bool fr_io_posix_mem_is_zero(const char * mem_address, ft_size mem_length) {
-    for (ft_size i = 0; i < mem_length; i++) {
-        if (mem_address[i] != 0)
-            return false;
-    }
-    return true;
+    return ff_mem_is_zero(mem_address, mem_length);
 }
 #endif // ENABLE_CHECK_IF_MEM_IS_ZERO
 
@@ -162,6 +162,13 @@ protected:
     int replace_storage_mmap(int fd, const char * label, fr_extent<ft_uoff> & storage_extent,
                              ft_size extent_index, ft_size & mem_offset);
 
+    /**
+     * pre-fault and mlock() the whole mmapped() STORAGE, splitting the work among multiple threads,
+     * so that relocation does not stall on page faults.
+     * return 0 if success, else error
+     */
+    int prefault_storage();
+
     /**
      * create and open SECONDARY-STORAGE in job.job_dir() + '.storage.bin'
      * and fill it with 'secondary_len' bytes of zeros. do not mmap() it.
@@ -35,37 +35,93 @@
 # include <sys/types.h>      // for DIR, opendir()
 #endif
 #ifdef FT_HAVE_DIRENT_H
-# include <dirent.h>         //  "   "     "      , readdir(), closedir()
+# include <dirent.h>         //  "   "     "      , readdir(), closedir(), fdopendir(), getdents64()
+#endif
+#ifdef FT_HAVE_FCNTL_H
+# include <fcntl.h>          // for open(), openat()
+#endif
+#ifdef FT_HAVE_UNISTD_H
+# include <unistd.h>         // for close()
 #endif
 
 #include "../log.hh"        // for ff_log()
 #include "io_posix_dir.hh"  // for ft_io_posix_dir
 
+#ifndef O_DIRECTORY
+# define O_DIRECTORY 0
+#endif
+#ifndef O_NOFOLLOW
+# define O_NOFOLLOW 0
+#endif
+#ifndef AT_FDCWD
+# define AT_FDCWD -100
+#endif
 
 FT_IO_NAMESPACE_BEGIN
 
 /** default constructor */
 ft_io_posix_dir::ft_io_posix_dir()
+#ifdef FT_IO_POSIX_DIR_GETDENTS64
+    : this_path(), this_buf(NULL), this_buf_len(0), this_buf_pos(0), this_fd(-1)
+#else
     : this_path(), this_dir(NULL)
+#endif
 { }
 
 /** destructor. calls close() */
 ft_io_posix_dir::~ft_io_posix_dir()
 {
     close();
+#ifdef FT_IO_POSIX_DIR_GETDENTS64
+    delete[] this_buf;
+#endif
 }
 
 /** open a directory */
 int ft_io_posix_dir::open(const ft_string & path)
+{
+    return open_at(AT_FDCWD, path.c_str(), path, 0);
+}
+
+/**
+ * open directory 'name' relative to directory file descriptor 'dir_fd' (can be AT_FDCWD).
+ * does not follow symbolic links. 'path' is only used for messages and returned by path()
+ */
+int ft_io_posix_dir::open(int dir_fd, const char * name, const ft_string & path)
+{
+    return open_at(dir_fd, name, path, O_NOFOLLOW);
+}
+
+/** open directory 'name' relative to directory file descriptor 'dir_fd', adding 'flags' to open() flags */
+int ft_io_posix_dir::open_at(int dir_fd, const char * name, const ft_string & path, int flags)
 {
     int err = 0;
-    if (this_dir != NULL)
+    if (is_open())
         err = EISCONN;
-    else if ((this_dir = opendir(path.c_str())) == NULL)
-        err = errno;
     else {
-        this_path = path;
-        return err;
+#if defined(FT_IO_POSIX_DIR_GETDENTS64)
+        this_fd = ::openat(dir_fd, name, O_RDONLY|O_DIRECTORY|flags);
+        if (this_fd < 0)
+            err = errno;
+        this_buf_len = this_buf_pos = 0;
+#elif defined(FT_HAVE_OPENAT) && defined(FT_HAVE_FDOPENDIR)
+        int fd = ::openat(dir_fd, name, O_RDONLY|O_DIRECTORY|flags);
+        if (fd < 0 || (this_dir = fdopendir(fd)) == NULL) {
+            err = errno;
+            if (fd >= 0)
+                (void) ::close(fd);
+        }
+#else
+        (void) dir_fd;
+        (void) name;
+        (void) flags;
+        if ((this_dir = opendir(path.c_str())) == NULL)
+            err = errno;
+#endif
+        if (err == 0) {
+            this_path = path;
+            return err;
+        }
     }
     return ff_log(FC_ERROR, err, "failed to open directory `%s'", path.c_str());
 }
@@ -73,11 +129,19 @@ int ft_io_posix_dir::open(const ft_string & path)
 /** close the currently open directory */
 int ft_io_posix_dir::close()
 {
+#ifdef FT_IO_POSIX_DIR_GETDENTS64
+    if (this_fd >= 0) {
+        if (::close(this_fd) != 0)
+            return ff_log(FC_ERROR, errno, "failed to close directory `%s'", this_path.c_str());
+        this_fd = -1;
+    }
+#else
     if (this_dir != NULL) {
     	if (closedir(this_dir) != 0)
     		return ff_log(FC_ERROR, errno, "failed to close directory `%s'", this_path.c_str());
     	this_dir = NULL;
     }
+#endif
 	this_path.clear();
     return 0;
 }
@@ -91,6 +155,33 @@ int ft_io_posix_dir::close()
 int ft_io_posix_dir::next(ft_io_posix_dirent * & result)
 {
     int err;
+#ifdef FT_IO_POSIX_DIR_GETDENTS64
+    if (this_fd < 0)
+        err = ENOTCONN;
+    else {
+        if (this_buf_pos >= this_buf_len) {
+            /* buffer is exhausted: read as many entries as fit in it with a single system call */
+            if (this_buf == NULL)
+                this_buf = new char[FC_BUFSIZE];
+            ssize_t got;
+            while ((got = getdents64(this_fd, this_buf, FC_BUFSIZE)) == -1 && errno == EINTR)
+                ;
+            this_buf_pos = this_buf_len = 0;
+            if (got > 0)
+                this_buf_len = (ft_size) got;
+            else if (got == 0) {
+                result = NULL; // end-of-dir
+                return 0;
+            }
+        }
+        if (this_buf_pos < this_buf_len) {
+            result = (ft_io_posix_dirent *) (this_buf + this_buf_pos);
+            this_buf_pos += result->d_reclen;
+            return 0;
+        }
+        err = errno;
+    }
+#else
     if (this_dir == NULL)
         err = ENOTCONN;
     else {
@@ -99,6 +190,7 @@ int ft_io_posix_dir::next(ft_io_posix_dirent * & result)
         if ((err = errno) == 0) // 0 for success or end-of-dir
             return err;
     }
+#endif
     return ff_log(FC_ERROR, err, "failed to read directory `%s'", this_path.c_str());
 }
 
@@ -26,22 +26,45 @@
 #ifndef FSTRANSFORM_IO_IO_POSIX_DIR_HH
 #define FSTRANSFORM_IO_IO_POSIX_DIR_HH
 
-#include "../types.hh"    // for ft_string, ft_inode
+#include "../types.hh"    // for ft_string, ft_inode, ft_size
 
 #ifdef FT_HAVE_DIRENT_H
-# include <dirent.h>      // for DIR, DT_UNKNOWN
+# include <dirent.h>      // for DIR, DT_UNKNOWN, struct dirent, struct dirent64
+#endif
+
+/* read directories with getdents64() into a large buffer, instead of readdir() */
+#if defined(FT_HAVE_GETDENTS64) && defined(FT_HAVE_OPENAT)
+# define FT_IO_POSIX_DIR_GETDENTS64
 #endif
 
 FT_IO_NAMESPACE_BEGIN
 
 
+#ifdef FT_IO_POSIX_DIR_GETDENTS64
+typedef struct dirent64 ft_io_posix_dirent;
+#else
 typedef struct dirent ft_io_posix_dirent;
+#endif
 
 class ft_io_posix_dir
 {
 private:
     ft_string this_path;
+#ifdef FT_IO_POSIX_DIR_GETDENTS64
+    char * this_buf;
+    ft_size this_buf_len, this_buf_pos;
+    int this_fd;
+
+    enum {
+        /** size of buffer passed to getdents64(). allocated by first call to next() */
+        FC_BUFSIZE = (ft_size)1 << 16,
+    };
+#else
     DIR * this_dir;
+#endif
+
+    /** open directory 'name' relative to directory file descriptor 'dir_fd', adding 'flags' to open() flags */
+    int open_at(int dir_fd, const char * name, const ft_string & path, int flags);
 
     /** cannot call copy constructor */
     ft_io_posix_dir(const ft_io_posix_dir &);
@@ -59,9 +82,24 @@ public:
     /** open a directory */
     int open(const ft_string & path);
 
+    /**
+     * open directory 'name' relative to directory file descriptor 'dir_fd' (can be AT_FDCWD).
+     * does not follow symbolic links. 'path' is only used for messages and returned by path()
+     */
+    int open(int dir_fd, const char * name, const ft_string & path);
+
+#ifdef FT_IO_POSIX_DIR_GETDENTS64
+    FT_INLINE bool is_open() const { return this_fd >= 0; };
+
+    /** return the file descriptor of this directory, for use with *at() functions */
+    FT_INLINE int fd() const { return this_fd; }
+#else
     FT_INLINE bool is_open() const { return this_dir != NULL; };
 
-    FT_INLINE DIR * dir() { return this_dir; }
+    /** return the file descriptor of this directory, for use with *at() functions */
+    FT_INLINE int fd() const { return this_dir != NULL ? dirfd(this_dir) : -1; }
+#endif
+
     FT_INLINE const ft_string & path() const { return this_path; }
 
     /**
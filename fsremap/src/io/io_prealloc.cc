@@ -51,11 +51,12 @@
 
 #include "../log.hh"       // for ff_log()
 #include "../misc.hh"      // for ff_max2(), ff_min2()
+#include "../thread.hh"    // for ft_mutex, ff_thread_run(), ff_thread_cpu_count()
 #include "../vector.hh"    // for fr_vector<T>
 #include "../cache/cache_mem.hh" // for ft_cache_mem<K,V>
 
 #include "util_posix.hh"   // for ff_posix_stat()
-#include "extent_posix.hh" // for ff_read_extents_posix()
+#include "extent_posix.hh" // for ff_read_extents_posix(), ff_posix_fibmap_show_stats()
 #include "io_prealloc.hh"  // for fr_io_prealloc
 
 
@@ -66,7 +67,7 @@ const char * const fr_io_prealloc::MP_LABEL[] = { LABEL[FC_DEVICE], LABEL[FC_LOO
 
 /** constructor. */
 fr_io_prealloc::fr_io_prealloc(fr_persist & persist)
-: super_type(persist), this_inode_cache(NULL), mount_point(),
+: super_type(persist), pending_files(), this_inode_cache(NULL), mount_point(),
   loop_file_path(), loop_dev_path(NULL), cmd_losetup(NULL)
 {
     // TODO: command-line option to use ft_cache_symlink_kv<K,V>
@@ -148,6 +149,7 @@ int fr_io_prealloc::open(const fr_args & args)
 void fr_io_prealloc::close()
 {
     this_inode_cache->clear();
+    pending_files.clear();
     ft_size i, n = FC_MOUNT_POINTS_N;
     for (i = 0; i < n; i++) {
         mount_point[i].close();
@@ -261,6 +263,10 @@ int fr_io_prealloc::read_extents(fr_vector<ft_uoff> & loop_file_extents,
                 mount_point[FC_MOUNT_POINT_LOOP_FILE].path(),
                 loop_file_extents, to_zero_extents, block_size_bitmask);
 
+        if (err == 0)
+            err = read_extents_pending(loop_file_extents, to_zero_extents, block_size_bitmask);
+
+        pending_files.clear();
         if (err != 0)
             break;
 
@@ -318,6 +324,8 @@ int fr_io_prealloc::read_extents(fr_vector<ft_uoff> & loop_file_extents,
 
     } while (0);
 
+    ff_posix_fibmap_show_stats();
+
     return err;
 }
 
@@ -505,8 +513,17 @@ int fr_io_prealloc::read_extents_dir(ft_io_posix_dir & src, const ft_string & ds
         }
 
         if (fr_io_posix_is_file(src_stat)) {
-            err = read_extents_file(src_path, src_stat, dst_path, dst_stat,
-                                    loop_file_extents, to_zero_extents, block_size_bitmask);
+            // do not examine the file now: collect it and examine many files in parallel
+            pending_files.push_back(pending_file());
+            pending_file & pending = pending_files.back();
+            pending.src_path = src_file;
+            pending.dst_path = dst_file;
+            pending.src_stat = src_stat;
+            pending.dst_stat = dst_stat;
+
+            if (pending_files.size() >= FC_PENDING_FILES_MAX
+                && (err = read_extents_pending(loop_file_extents, to_zero_extents, block_size_bitmask)) != 0)
+                break;
         }
     }
     if (err == 0)
@@ -520,13 +537,16 @@ int fr_io_prealloc::read_extents_dir(ft_io_posix_dir & src, const ft_string & ds
  *
  * any preallocated extents in files inside loop file
  * which do NOT have a correspondence in files inside device
- * are added to to_zero_extents
+ * are added to to_zero_extents.
+ *
+ * if ioctl(FS_IOC_FIEMAP) is not supported, uses at most 'fibmap_thread_max' threads per file
  */
 int fr_io_prealloc::read_extents_file(const char * src_path, const ft_stat & src_stat,
                                       const char * dst_path, const ft_stat & dst_stat,
                                       fr_vector<ft_uoff> & loop_file_extents,
                                       fr_vector<ft_uoff> & to_zero_extents,
-                                      ft_uoff & ret_block_size_bitmask)
+                                      ft_uoff & ret_block_size_bitmask,
+                                      ft_size fibmap_thread_max)
 {
     ft_uoff block_size_bitmask = ret_block_size_bitmask;
     int err = 0;
@@ -554,7 +574,7 @@ int fr_io_prealloc::read_extents_file(const char * src_path, const ft_stat & src
                 break;
             }
 
-            err = ff_read_extents_posix(fd, len[i], extent[i], block_size_bitmask);
+            err = ff_read_extents_posix(fd, len[i], extent[i], block_size_bitmask, fibmap_thread_max);
 
             if (::close(fd) < 0)
                 ff_log(FC_WARN, errno, "failed to close file '%s' inside %s", path[i], MP_LABEL[i]);
@@ -592,4 +612,98 @@ int fr_io_prealloc::read_extents_file(const char * src_path, const ft_stat & src
 }
 
 
+/** shared state of the threads started by fr_io_prealloc::read_extents_pending() */
+struct fr_io_prealloc_pending_job
+{
+    fr_io_prealloc * io;
+    ft_mutex mutex;
+    ft_size next_i;
+    /** CPUs left to each thread for ioctl(FIBMAP): each thread must not start one thread per CPU */
+    ft_size fibmap_thread_max;
+    int err;
+
+    /** per-thread results, merged after all threads finished */
+    struct result {
+        fr_vector<ft_uoff> loop_file_extents, to_zero_extents;
+        ft_uoff block_size_bitmask;
+    };
+    std::vector<result> results;
+};
+
+/**
+ * call read_extents_file() on all pending_files, using one thread per CPU,
+ * then clear pending_files.
+ *
+ * NOTE: loop_file_extents will be filled with UNSORTED data
+ */
+int fr_io_prealloc::read_extents_pending(fr_vector<ft_uoff> & loop_file_extents,
+                                         fr_vector<ft_uoff> & to_zero_extents,
+                                         ft_uoff & ret_block_size_bitmask)
+{
+    const ft_size file_n = pending_files.size();
+    if (file_n == 0)
+        return 0;
+
+    const ft_size cpu_n = ff_thread_cpu_count(), thread_n = ff_min2(cpu_n, file_n);
+
+    fr_io_prealloc_pending_job job;
+    job.io = this;
+    job.next_i = 0;
+    job.fibmap_thread_max = ff_max2((ft_size) 1, cpu_n / thread_n);
+    job.err = 0;
+    job.results.resize(thread_n);
+    for (ft_size i = 0; i < thread_n; i++)
+        job.results[i].block_size_bitmask = 0;
+
+    ff_log(FC_TRACE, 0, "examining %" FT_ULL " preallocated files with %" FT_ULL " thread%s",
+           (ft_ull) file_n, (ft_ull) thread_n, thread_n == 1 ? "" : "s");
+
+    int err = ff_thread_run(thread_n, read_extents_pending_thread, & job);
+    pending_files.clear();
+    if (err != 0)
+        return err;
+
+    ft_uoff block_size_bitmask = ret_block_size_bitmask;
+    for (ft_size i = 0; i < thread_n; i++) {
+        fr_io_prealloc_pending_job::result & result = job.results[i];
+        loop_file_extents.append_all(result.loop_file_extents);
+        to_zero_extents.append_all(result.to_zero_extents);
+        block_size_bitmask |= result.block_size_bitmask;
+    }
+    ret_block_size_bitmask = block_size_bitmask;
+    return err;
+}
+
+/** ft_thread_func executed by each thread started by read_extents_pending() */
+int fr_io_prealloc::read_extents_pending_thread(void * arg, ft_size thread_i)
+{
+    fr_io_prealloc_pending_job & job = * (fr_io_prealloc_pending_job *) arg;
+    fr_io_prealloc_pending_job::result & result = job.results[thread_i];
+    fr_io_prealloc & io = * job.io;
+    const ft_size file_n = io.pending_files.size();
+    ft_size i;
+    int err = 0;
+
+    for (;;) {
+        job.mutex.lock();
+        // stop all threads as soon as one of them fails
+        if (err != 0 && job.err == 0)
+            job.err = err;
+        if (job.err != 0 || (i = job.next_i) >= file_n) {
+            job.mutex.unlock();
+            break;
+        }
+        job.next_i++;
+        job.mutex.unlock();
+
+        const pending_file & pending = io.pending_files[i];
+        err = io.read_extents_file(pending.src_path.c_str(), pending.src_stat,
+                                   pending.dst_path.c_str(), pending.dst_stat,
+                                   result.loop_file_extents, result.to_zero_extents,
+                                   result.block_size_bitmask, job.fibmap_thread_max);
+    }
+    return err;
+}
+
+
 FT_IO_NAMESPACE_END
@@ -26,6 +26,8 @@
 #ifndef FSREMAP_IO_IO_PREALLOC_HH
 #define FSREMAP_IO_IO_PREALLOC_HH
 
+#include <vector>            // for std::vector<T>
+
 #include "../args.hh"        // for FC_MOUNT_POINT*
 #include "../types.hh"       // for ft_uoff
 #include "../cache/cache.hh" // for ft_cache<K,V>
@@ -44,6 +46,23 @@ private:
 
     static const char * const MP_LABEL[FC_MOUNT_POINTS_N];
 
+    enum {
+        /**
+         * max number of regular files collected by read_extents_dir()
+         * before examining them in parallel with read_extents_pending()
+         */
+        FC_PENDING_FILES_MAX = 4096,
+    };
+
+    /** regular file found by read_extents_dir(), waiting to be examined by read_extents_file() */
+    struct pending_file {
+        ft_string src_path, dst_path;
+        ft_stat src_stat, dst_stat;
+    };
+
+    // regular files found by read_extents_dir() and not yet examined
+    std::vector<pending_file> pending_files;
+
     // inode-cache. used to examine only once multiple links to the same file
     ft_cache<ft_nlink,ft_nlink> * this_inode_cache;
 
@@ -98,13 +117,29 @@ private:
      *
      * any preallocated extents in files inside loop file
      * which do NOT have a correspondence in files inside device
-     * are added to to_zero_extents
+     * are added to to_zero_extents.
+     *
+     * if ioctl(FS_IOC_FIEMAP) is not supported, uses at most 'fibmap_thread_max' threads per file
      */
     int read_extents_file(const char * src_path, const ft_stat & src_stat,
                           const char * dst_path, const ft_stat & dst_stat,
                           fr_vector<ft_uoff> & loop_file_extents,
                           fr_vector<ft_uoff> & to_zero_extents,
-                          ft_uoff & ret_block_size_bitmask);
+                          ft_uoff & ret_block_size_bitmask,
+                          ft_size fibmap_thread_max);
+
+    /**
+     * call read_extents_file() on all pending_files, using one thread per CPU,
+     * then clear pending_files.
+     *
+     * NOTE: loop_file_extents will be filled with UNSORTED data
+     */
+    int read_extents_pending(fr_vector<ft_uoff> & loop_file_extents,
+                             fr_vector<ft_uoff> & to_zero_extents,
+                             ft_uoff & ret_block_size_bitmask);
+
+    /** ft_thread_func executed by each thread started by read_extents_pending() */
+    static int read_extents_pending_thread(void * arg, ft_size thread_i);
 
 protected:
 
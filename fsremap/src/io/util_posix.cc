@@ -35,6 +35,11 @@
 #elif defined(FT_HAVE_CSTDLIB)
 # include <cstdlib>        // for exit(), posix_fallocate()
 #endif
+#if defined(FT_HAVE_STRING_H)
+# include <string.h>       // for memset()
+#elif defined(FT_HAVE_CSTRING)
+# include <cstring>        // for memset()
+#endif
 
 #ifdef FT_HAVE_FCNTL_H
 # include <fcntl.h>        // for fallocate()
@@ -277,16 +282,21 @@ int ff_posix_write(int fd, const void * mem, ft_uoff length)
 
 /**
  * preallocate and fill with zeroes 'length' bytes on disk for a file descriptor.
- * uses fallocate() if available, else posix_fallocate(), else plain write() loop.
+ * uses fallocate() if available and supported by the file system,
+ * else posix_fallocate(), else plain write() loop.
  */
 int ff_posix_fallocate(int fd, ft_off length, const ft_string & err_msg)
 {
-	int err = 0;
+	int err = -1;
 #if defined(FT_HAVE_FALLOCATE)
-	if ((err = fallocate(fd, 0, 0, length)) != 0)
-#elif defined(FT_HAVE_POSIX_FALLOCATE)
-	if ((err = posix_fallocate(fd, 0, length)) != 0)
+	err = fallocate(fd, 0, 0, length);
 #endif /* FT_HAVE_FALLOCATE */
+#if defined(FT_HAVE_POSIX_FALLOCATE)
+	/* fallocate() may be unsupported by the file system (EOPNOTSUPP): posix_fallocate() emulates it */
+	if (err != 0)
+		err = posix_fallocate(fd, 0, length);
+#endif /* FT_HAVE_POSIX_FALLOCATE */
+	if (err != 0)
 	{
 		/* fall back on write() */
 		enum { zero_len = 64*1024 };
@@ -294,6 +304,8 @@ int ff_posix_fallocate(int fd, ft_off length, const ft_string & err_msg)
 		ft_off pos = 0;
 		ft_size chunk;
 
+		memset(zero, '\0', zero_len);
+		err = 0;
 		while (pos < length) {
 			// safe cast ft_uoff -> ft_size, the value is <= zero_len
 			chunk = (ft_size) ff_min2<ft_off>(zero_len, length - pos);
@@ -76,7 +76,8 @@ int ff_posix_write(int fd, const void * mem, ft_uoff length);
 
 /**
  * preallocate and fill with zeroes 'length' bytes on disk for a file descriptor.
- * uses fallocate() if available, else posix_fallocate(), else plain write() loop.
+ * uses fallocate() if available and supported by the file system,
+ * else posix_fallocate(), else plain write() loop.
  */
 int ff_posix_fallocate(int fd, ft_off length, const ft_string & err_msg);
 
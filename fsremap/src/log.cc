@@ -39,6 +39,9 @@
 #if defined(FT_HAVE_UNISTD_H)
 # include <unistd.h>     /* for isatty() */
 #endif
+#if defined(FT_HAVE_PTHREAD_H)
+# include <pthread.h>    /* for pthread_mutex_lock(), pthread_mutex_unlock() */
+#endif
 
 
 #include <utility>       // for std::make_pair()
@@ -93,6 +96,16 @@ static all_loggers_type * fc_log_all_loggers = NULL;
 static ft_log * fc_log_root_logger = NULL;
 static bool fc_log_initialized = false;
 
+#if defined(FT_HAVE_PTHREAD_H)
+/* serializes ff_log() calls from concurrent threads */
+static pthread_mutex_t fc_log_mutex = PTHREAD_MUTEX_INITIALIZER;
+# define ff_log_lock()   pthread_mutex_lock(& fc_log_mutex)
+# define ff_log_unlock() pthread_mutex_unlock(& fc_log_mutex)
+#else
+# define ff_log_lock()   ((void)0)
+# define ff_log_unlock() ((void)0)
+#endif
+
 
 /** list of all appenders */
 ft_log_appenders & ft_log_appender::get_all_appenders()
@@ -412,9 +425,13 @@ bool ff_logl_is_enabled(const char * file, int file_len, ft_log_level level)
     ff_pretty_file(event);
 
     ft_mstring logger_name(event.file, event.file_len);
+
+    ff_log_lock();
     ft_log & logger = ft_log::get_logger(logger_name);
+    bool enabled = logger.is_enabled(level);
+    ff_log_unlock();
 
-    return logger.is_enabled(level);
+    return enabled;
 }
 
 
@@ -431,6 +448,7 @@ int ff_logl(const char * file, int file_len, const char * func, int line, ft_log
      * log subsystem is automatically initialized upon first call to
      * ff_log(), ff_vlog(), ff_log_register() or ff_log_set_threshold().
      */
+    ff_log_lock();
     ft_log_event event = {
         ff_strftime(), file, "", func, fmt,
         file_len, line, err,
@@ -445,6 +463,7 @@ int ff_logl(const char * file, int file_len, const char * func, int line, ft_log
     va_start(event.vargs, fmt);
     logger.log(event);
     va_end(event.vargs);
+    ff_log_unlock();
 
     /* note 1.2.1) ff_log() and ff_vlog() always return errors as reported (-EINVAL, -ENOMEM...) */
     return ff_log_is_reported(err) ? err : -err;
@@ -466,6 +485,7 @@ int ff_logv(const char * file, int file_len, const char * func, int line, ft_log
      * log subsystem is automatically initialized upon first call to
      * ff_log(), ff_vlog(), ff_log_register() or ff_log_set_threshold().
      */
+    ff_log_lock();
     ft_log_event event = {
         ff_strftime(), file, "", func, fmt,
         file_len, line, err,
@@ -480,6 +500,7 @@ int ff_logv(const char * file, int file_len, const char * func, int line, ft_log
     ff_va_copy(event.vargs, vargs);
     logger.log(event);
     va_end(event.vargs);
+    ff_log_unlock();
 
     /* note 1.2.1) ff_log() and ff_vlog() always return errors as reported (-EINVAL, -ENOMEM...) */
     return ff_log_is_reported(err) ? err : -err;
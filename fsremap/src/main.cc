@@ -33,6 +33,7 @@
 #undef FR_TEST_IOCTL_FIEMAP
 #undef FR_TEST_WRITE_ZEROES
 #undef FR_TEST_PRETTY_TIME
+#undef FR_TEST_ZERO
 
 
 
@@ -235,6 +236,12 @@ FT_IO_NAMESPACE_END
 # define FR_MAIN(argc, argv) FT_IO_NS ff_zero_loop_file_holes(argc, argv)
 
 
+#elif defined(FR_TEST_ZERO)
+
+# include "zero_test.hh"
+# define FR_MAIN(argc, argv) FT_NS ff_zero_test(argc, argv)
+
+
 #elif defined(FR_TEST_PRETTY_TIME)
 
 
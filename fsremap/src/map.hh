@@ -344,6 +344,21 @@ public:
      */
     void complement0_physical_shift(const fr_vector<ft_uoff> & other, ft_uoff effective_block_size_log2, ft_uoff device_length);
 
+    /**
+     * makes the physical complement of the union of 'others[0] ... others[others_n-1]' vectors,
+     * i.e. calculates the physical extents NOT used in any of them,
+     * shifts them by effective_block_size_log2,
+     * and inserts it in this map.
+     *
+     * the union is never materialized: the vectors are k-way merged on the fly.
+     *
+     * each vector must be already sorted by physical, and the vectors must not intersect!
+     * does not merge and does not check for merges
+     * does not check for overflows
+     */
+    void complement0_physical_shift(const fr_vector<ft_uoff> * const others[], ft_size others_n,
+                                    ft_uoff effective_block_size_log2, ft_uoff device_length);
+
     /**
      * makes the logical complement of 'other' vector,
      * i.e. calculates the logical extents NOT used in 'other' vector,
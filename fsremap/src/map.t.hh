@@ -25,6 +25,8 @@
 
 #include "first.hh"
 
+#include <vector>        // for std::vector<T>
+
 #include "assert.hh"     // for ff_assert macro
 #include "map.hh"        // for fr_map<T>
 #include "misc.hh"       // for ff_max2(), ff_min2()
@@ -817,6 +819,75 @@ void fr_map<T>::complement0_physical_shift(const fr_vector<ft_uoff> & other,
 }
 
 
+/**
+ * makes the physical complement of the union of 'others[0] ... others[others_n-1]' vectors,
+ * i.e. calculates the physical extents NOT used in any of them,
+ * shifts them by effective_block_size_log2,
+ * and inserts it in this map (with user_data = FC_DEFAULT_USER_DATA)
+ *
+ * the union is never materialized: the vectors are k-way merged on the fly.
+ *
+ * each vector must be already sorted by physical, and the vectors must not intersect!
+ * does not merge and does not check for merges
+ * does not check for overflows
+ */
+template<typename T>
+void fr_map<T>::complement0_physical_shift(const fr_vector<ft_uoff> * const others[], ft_size others_n,
+                                           ft_uoff effective_block_size_log2, ft_uoff device_length)
+{
+    T physical, last;
+    std::vector<ft_size> pos(others_n, 0);
+    const fr_extent<ft_uoff> * prev = NULL;
+    ft_size k, min_k;
+
+    if (empty())
+        last = 0;
+    else {
+        const value_type & back = *--this->end();
+        last = back.first.physical + back.second.length;
+    }
+    /* loop on the union of 'others' extents, in physical order */
+    for (;;) {
+        /* k-way merge: find the vector whose next extent has the smallest ->physical(). k is small, a linear scan is enough */
+        min_k = others_n;
+        for (k = 0; k < others_n; k++) {
+            if (pos[k] < others[k]->size()
+                && (min_k == others_n || (*others[k])[pos[k]].physical() < (*others[min_k])[pos[min_k]].physical()))
+                min_k = k;
+        }
+        if (min_k == others_n)
+            break;
+
+        const fr_extent<ft_uoff> & curr = (*others[min_k])[pos[min_k]++];
+        physical = curr.physical() >> effective_block_size_log2;
+
+        if (physical == last) {
+            /* nothing to do */
+        } else if (physical > last) {
+            /* add "hole" with logical == physical */
+            append0(last, last, physical - last, FC_DEFAULT_USER_DATA);
+        } else {
+            /* oops.. some programmer really screwed up */
+            ff_log(FC_FATAL, 0, "internal error in ft_map<T>::complement0_physical_shift():");
+            if (prev != NULL)
+                ff_log(FC_FATAL, 0, "\textent {physical = %" FT_ULL ", logical = %" FT_ULL ", length = %" FT_ULL " /* physical end = %" FT_ULL " */} does not end before",
+                        (ft_ull) prev->physical(), (ft_ull) prev->logical(), (ft_ull) prev->length(), (ft_ull) (prev->physical() + prev->length()));
+            ff_log(FC_FATAL, 0, "\textent {physical = %" FT_ULL ", logical = %" FT_ULL ", length = %" FT_ULL " /* physical end = %" FT_ULL " */}",
+                    (ft_ull) curr.physical(), (ft_ull) curr.logical(), (ft_ull) curr.length(), (ft_ull) (curr.physical() + curr.length()));
+            ff_assert_fail("internal error in ft_map<T>::complement0_physical_shift(): vectors are not sorted by ->physical() or they intersect");
+        }
+
+        last = physical + (curr.length() >> effective_block_size_log2);
+        prev = & curr;
+    }
+    device_length >>= effective_block_size_log2;
+    if (last < device_length) {
+        /* add last "hole" with logical == physical */
+        append0(last, last, device_length - last, FC_DEFAULT_USER_DATA);
+    }
+}
+
+
 /**
  * makes the logical complement of 'other' vector,
  * i.e. calculates the logical extents NOT used in 'other' vector,
@@ -50,6 +50,7 @@
 # include "io/io_prealloc.hh"  // for fr_io_prealloc
 #endif
 #include "io/io_self_test.hh" // for fr_io_self_test
+#include "io/extent_posix.hh" // for ff_posix_fibmap_set_probe()
 #include "io/util_dir.hh"     // for ff_mkdir()
 
 
@@ -156,6 +157,9 @@ int fr_remap::usage(const char * program_name)
 #endif
      "  -m, --mem-buffer=RAM_SIZE[k|M|G|T|P|E|Z|Y]\n"
      "                        set RAM buffer size (default: autodetect)\n"
+     "      --memory-budget=RAM_SIZE[k|M|G|T|P|E|Z|Y]\n"
+     "                        set total RAM to divide among maps, storage\n"
+     "                          and buffer (default: autodetect)\n"
      "  -n, --no-action, --simulate-run\n"
      "                        do not actually read or write any disk block\n"
      "      --questions=MODE  set interactive mode. MODE is one of:\n"
@@ -181,6 +185,10 @@ int fr_remap::usage(const char * program_name)
      "  -xs, --exact-secondary-storage=SECONDARY_SIZE[k|M|G|T|P|E|Z|Y]\n"
      "                        set _exact_ secondary storage length, or fail\n"
      "                          (default: autodetect)\n"
+     "      --x-fibmap-probe  if ioctl(FS_IOC_FIEMAP) is not supported, find contiguous\n"
+     "                          runs with fewer ioctl(FIBMAP) calls. faster, but skips\n"
+     "                          the per-block FIBMAP check: blocks between two probes\n"
+     "                          are assumed to belong to the run\n"
      "      --x-OPTION=VALUE  set internal, undocumented option. for maintainers only\n"
      "      --help            display this help and exit\n"
      "      --version         output version information and exit\n",
@@ -358,6 +366,14 @@ int fr_remap::init(int argc, char const* const* argv)
                     if (is_short_opt)
                         --argc, ++argv;
                 }
+                /* --memory-budget=RAM_SIZE[k|M|G|T|P|E|Z|Y] */
+                else if (!strncmp(arg, "--memory-budget=", opt_len)) {
+
+                    if ((err = ff_str2un_scaled(opt_arg, & args.storage_size[FC_MEM_BUDGET_SIZE])) != 0) {
+                        err = invalid_cmdline(args, err, "invalid memory budget '%s'", opt_arg);
+                        break;
+                    }
+                }
                 else if (!strncmp(arg, "--device-mount-point=", opt_len)) {
                     args.mount_points[FC_MOUNT_POINT_DEVICE] = opt_arg;
                 }
@@ -427,6 +443,10 @@ int fr_remap::init(int argc, char const* const* argv)
                     if (is_short_opt)
                         --argc, ++argv;
                 }
+                /* --x-fibmap-probe: find contiguous runs with fewer ioctl(FIBMAP) calls, without verifying every block */
+                else if (!strcmp(arg, "--x-fibmap-probe")) {
+                    FT_IO_NS ff_posix_fibmap_set_probe(true);
+                }
                 /* --x-log-FILE=LEVEL */
                 else if (!strncmp(arg, "--x-log-", 8)) {
                     ft_mstring logger_name(arg + 8, opt_len - 9); // 9 == 8 for "--x-log-" plus 1 for '='
@@ -0,0 +1,219 @@
+/*
+ * fstransform - transform a file-system to another file-system type,
+ *               preserving its contents and without the need for a backup
+ *
+ * Copyright (C) 2011-2012 Massimiliano Ghilardi
+ *
+ *     This program is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as published by
+ *     the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     This program is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public License
+ *     along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * thread.cc
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: max
+ */
+
+#include "first.hh"
+
+#ifdef FT_HAVE_UNISTD_H
+# include <unistd.h>     // for sysconf(), _SC_NPROCESSORS_ONLN
+#endif
+
+#include <vector>        // for std::vector<T>
+
+#include "log.hh"        // for ff_log()
+#include "thread.hh"     // for ft_mutex, ft_cond, ff_thread_run()
+
+
+FT_NAMESPACE_BEGIN
+
+/** default constructor */
+ft_mutex::ft_mutex()
+{
+#ifdef FT_HAVE_PTHREAD_H
+    pthread_mutex_init(& impl, NULL);
+#endif
+}
+
+/** destructor */
+ft_mutex::~ft_mutex()
+{
+#ifdef FT_HAVE_PTHREAD_H
+    pthread_mutex_destroy(& impl);
+#endif
+}
+
+/** acquire this mutex, waiting until it is available */
+void ft_mutex::lock()
+{
+#ifdef FT_HAVE_PTHREAD_H
+    pthread_mutex_lock(& impl);
+#endif
+}
+
+/** release this mutex */
+void ft_mutex::unlock()
+{
+#ifdef FT_HAVE_PTHREAD_H
+    pthread_mutex_unlock(& impl);
+#endif
+}
+
+
+
+/** default constructor */
+ft_cond::ft_cond()
+{
+#ifdef FT_HAVE_PTHREAD_H
+    pthread_cond_init(& impl, NULL);
+#endif
+}
+
+/** destructor */
+ft_cond::~ft_cond()
+{
+#ifdef FT_HAVE_PTHREAD_H
+    pthread_cond_destroy(& impl);
+#endif
+}
+
+/** atomically release 'mutex' and wait until signaled, then re-acquire 'mutex'. caller must hold 'mutex' */
+void ft_cond::wait(ft_mutex & mutex)
+{
+#ifdef FT_HAVE_PTHREAD_H
+    pthread_cond_wait(& impl, & mutex.impl);
+#else
+    (void) mutex;
+#endif
+}
+
+/** wake up one thread waiting on this condition variable */
+void ft_cond::signal()
+{
+#ifdef FT_HAVE_PTHREAD_H
+    pthread_cond_signal(& impl);
+#endif
+}
+
+/** wake up all threads waiting on this condition variable */
+void ft_cond::broadcast()
+{
+#ifdef FT_HAVE_PTHREAD_H
+    pthread_cond_broadcast(& impl);
+#endif
+}
+
+
+
+/**
+ * return the number of online CPUs, or 1 if cannot be determined
+ */
+ft_size ff_thread_cpu_count()
+{
+#if defined(FT_HAVE_SYSCONF) && defined(_SC_NPROCESSORS_ONLN)
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    if (n > 0 && n == (long)(ft_size) n)
+        return (ft_size) n;
+#endif
+    return 1;
+}
+
+
+
+/** argument passed to each thread started by ff_thread_run() */
+struct ft_thread_arg
+{
+    ft_thread_func func;
+    void * arg;
+    ft_size thread_i;
+    int err;
+#ifdef FT_HAVE_PTHREAD_H
+    pthread_t thread;
+    bool started;
+#endif
+};
+
+#ifdef FT_HAVE_PTHREAD_H
+extern "C" {
+/** pthread_create() entry point: unpack ft_thread_arg and call func(arg, thread_i) */
+static void * ff_thread_start(void * arg)
+{
+    ft_thread_arg * targ = (ft_thread_arg *) arg;
+    targ->err = targ->func(targ->arg, targ->thread_i);
+    return NULL;
+}
+}
+#endif /* FT_HAVE_PTHREAD_H */
+
+/**
+ * call func(arg, thread_i) for each thread_i in [0, thread_n) in parallel:
+ * func(arg, 0) is executed by the calling thread, the others by newly created threads.
+ * waits until all calls have finished.
+ *
+ * if threads are not supported or cannot be created, the remaining calls are executed serially
+ * by the calling thread, so func must not expect a particular degree of parallelism.
+ *
+ * return 0 if all calls returned 0, else the error returned by the call with the lowest thread_i
+ */
+int ff_thread_run(ft_size thread_n, ft_thread_func func, void * arg)
+{
+    if (thread_n == 0)
+        return 0;
+
+    std::vector<ft_thread_arg> targ(thread_n);
+    ft_size i;
+
+    for (i = 0; i < thread_n; i++) {
+        ft_thread_arg & t = targ[i];
+        t.func = func;
+        t.arg = arg;
+        t.thread_i = i;
+        t.err = 0;
+#ifdef FT_HAVE_PTHREAD_H
+        t.started = false;
+#endif
+    }
+
+#ifdef FT_HAVE_PTHREAD_H
+    for (i = 1; i < thread_n; i++) {
+        int err = pthread_create(& targ[i].thread, NULL, ff_thread_start, & targ[i]);
+        if (err != 0) {
+            ff_log(FC_DEBUG, err, "pthread_create() failed after starting %" FT_ULL " thread%s, continuing with fewer threads",
+                   (ft_ull) i, i == 1 ? "" : "s");
+            break;
+        }
+        targ[i].started = true;
+    }
+#endif
+
+    targ[0].err = func(arg, 0);
+
+    for (i = 1; i < thread_n; i++) {
+        ft_thread_arg & t = targ[i];
+#ifdef FT_HAVE_PTHREAD_H
+        if (t.started) {
+            pthread_join(t.thread, NULL);
+            continue;
+        }
+#endif
+        /* thread was not started: run its work serially */
+        t.err = func(arg, i);
+    }
+
+    for (i = 0; i < thread_n; i++)
+        if (targ[i].err != 0)
+            return targ[i].err;
+    return 0;
+}
+
+FT_NAMESPACE_END
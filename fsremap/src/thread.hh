@@ -0,0 +1,152 @@
+/*
+ * fstransform - transform a file-system to another file-system type,
+ *               preserving its contents and without the need for a backup
+ *
+ * Copyright (C) 2011-2012 Massimiliano Ghilardi
+ *
+ *     This program is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as published by
+ *     the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     This program is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public License
+ *     along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * thread.hh
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: max
+ */
+
+#ifndef FSTRANSFORM_THREAD_HH
+#define FSTRANSFORM_THREAD_HH
+
+#include "types.hh"      // for ft_size
+
+#ifdef FT_HAVE_PTHREAD_H
+# include <pthread.h>    // for pthread_mutex_t, pthread_cond_t
+#endif
+
+FT_NAMESPACE_BEGIN
+
+/**
+ * mutual exclusion lock.
+ * if threads are not supported, lock() and unlock() do nothing
+ */
+class ft_mutex
+{
+private:
+#ifdef FT_HAVE_PTHREAD_H
+    pthread_mutex_t impl;
+#endif
+
+    friend class ft_cond;
+
+    /** cannot copy mutexes */
+    ft_mutex(const ft_mutex &);
+
+    /** cannot copy mutexes */
+    const ft_mutex & operator=(const ft_mutex &);
+
+public:
+    /** default constructor */
+    ft_mutex();
+
+    /** destructor */
+    ~ft_mutex();
+
+    /** acquire this mutex, waiting until it is available */
+    void lock();
+
+    /** release this mutex */
+    void unlock();
+};
+
+
+/**
+ * scoped lock: acquires a ft_mutex in constructor and releases it in destructor
+ */
+class ft_mutex_guard
+{
+private:
+    ft_mutex & mutex;
+
+    /** cannot copy guards */
+    ft_mutex_guard(const ft_mutex_guard &);
+
+    /** cannot copy guards */
+    const ft_mutex_guard & operator=(const ft_mutex_guard &);
+
+public:
+    /** constructor. calls my_mutex.lock() */
+    explicit ft_mutex_guard(ft_mutex & my_mutex) : mutex(my_mutex) { mutex.lock(); }
+
+    /** destructor. calls mutex.unlock() */
+    ~ft_mutex_guard() { mutex.unlock(); }
+};
+
+
+/**
+ * condition variable, used together with a ft_mutex.
+ * if threads are not supported, wait() returns immediately
+ * and signal(), broadcast() do nothing
+ */
+class ft_cond
+{
+private:
+#ifdef FT_HAVE_PTHREAD_H
+    pthread_cond_t impl;
+#endif
+
+    /** cannot copy condition variables */
+    ft_cond(const ft_cond &);
+
+    /** cannot copy condition variables */
+    const ft_cond & operator=(const ft_cond &);
+
+public:
+    /** default constructor */
+    ft_cond();
+
+    /** destructor */
+    ~ft_cond();
+
+    /** atomically release 'mutex' and wait until signaled, then re-acquire 'mutex'. caller must hold 'mutex' */
+    void wait(ft_mutex & mutex);
+
+    /** wake up one thread waiting on this condition variable */
+    void signal();
+
+    /** wake up all threads waiting on this condition variable */
+    void broadcast();
+};
+
+
+/** type of functions executed by ff_thread_run() */
+typedef int (*ft_thread_func)(void * arg, ft_size thread_i);
+
+/**
+ * return the number of online CPUs, or 1 if cannot be determined
+ */
+ft_size ff_thread_cpu_count();
+
+/**
+ * call func(arg, thread_i) for each thread_i in [0, thread_n) in parallel:
+ * func(arg, 0) is executed by the calling thread, the others by newly created threads.
+ * waits until all calls have finished.
+ *
+ * if threads are not supported or cannot be created, the remaining calls are executed serially
+ * by the calling thread, so func must not expect a particular degree of parallelism.
+ *
+ * return 0 if all calls returned 0, else the error returned by the call with the lowest thread_i
+ */
+int ff_thread_run(ft_size thread_n, ft_thread_func func, void * arg);
+
+FT_NAMESPACE_END
+
+#endif /* FSTRANSFORM_THREAD_HH */
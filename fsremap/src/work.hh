@@ -90,8 +90,8 @@ private:
      * assumes that vectors are ordered by extent->logical, and modifies them
      * in place: vector contents will be UNDEFINED when this method returns.
      *
-     * implementation: to compute this->dev_map, performs in-place the union of specified
-     * loop_file_extents and free_space_extents, then sorts in-place and complements such union.
+     * implementation: to compute this->dev_map, sorts in-place specified
+     * loop_file_extents and free_space_extents, then complements their union (merged on the fly).
      */
     int analyze(fr_vector<ft_uoff> & loop_file_extents,
                 fr_vector<ft_uoff> & free_space_extents,
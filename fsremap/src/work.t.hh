@@ -268,8 +268,8 @@ T ff_extent_align(typename fr_map<T>::value_type & extent, T page_size_blocks_m_
  * assumes that vectors are ordered by extent->logical, and modifies them
  * in place: vector contents will be UNDEFINED when this method returns.
  *
- * basic implementation idea: to compute this->dev_map, performs in-place the union of specified
- * loop_file_extents and free_space_extents, then sorts in-place and complements such union.
+ * basic implementation idea: to compute this->dev_map, sorts in-place specified
+ * loop_file_extents and free_space_extents, then complements their union (merged on the fly).
  *
  * detailed implementation is quite complicated... see the comments and the documentation
  */
@@ -366,11 +366,20 @@ int fr_work<T>::analyze(fr_vector<ft_uoff> & loop_file_extents,
      * how: compute physical complement of all LOOP-FILE and FREE-SPACE extents
      * and assume they are used by DEVICE for its file-system
      */
-    /* compute in-place the union of LOOP-FILE extents and FREE-SPACE extents */
-    loop_file_extents.append_all(free_space_extents);
-    /* sort the union by physical: needed by dev_map.complement0_physical_shift() immediately below */
-    loop_file_extents.sort_by_physical();
-    dev_map.complement0_physical_shift(loop_file_extents, eff_block_size_log2, dev_length);
+    /*
+     * loop_file_extents is already sorted by physical, sort also free_space_extents:
+     * dev_map.complement0_physical_shift() immediately below merges them on the fly,
+     * avoiding to allocate and sort their union
+     */
+    free_space_extents.sort_by_physical();
+    {
+        const fr_vector<ft_uoff> * const used_extents[] = { & loop_file_extents, & free_space_extents };
+        dev_map.complement0_physical_shift(used_extents, 2, eff_block_size_log2, dev_length);
+    }
+    /* the extents vectors are no longer needed: release their memory before building the other maps */
+    fr_vector<ft_uoff>().swap(loop_file_extents);
+    fr_vector<ft_uoff>().swap(free_space_extents);
+    fr_vector<ft_uoff>().swap(to_zero_extents);
     /* show DEVICE extents sorted by physical */
     dev_map.show(label[FC_DEVICE], "", eff_block_size);
 
@@ -647,6 +656,7 @@ int fr_work<T>::create_storage()
 
     ft_size req_mem_buffer_size = io->job_storage_size(FC_MEM_BUFFER_SIZE);
     ft_size req_secondary_size = io->job_storage_size(FC_SECONDARY_STORAGE_SIZE);
+    const ft_size req_mem_budget = io->job_storage_size(FC_MEM_BUDGET_SIZE);
 
     ft_size tmp_primary_size_exact = 0, tmp_secondary_size_exact = 0;
     FT_IO_NS fr_persist & persist = io->persist();
@@ -680,6 +690,45 @@ int fr_work<T>::create_storage()
     if (free_ram_or_0 == 0)
         ff_log(FC_WARN, 0, "cannot detect free RAM amount");
 
+    /*
+     * if a memory budget was requested, divide it among maps, STORAGE and memory buffer.
+     * each relocation pass moves at most STORAGE bytes, so STORAGE gets the largest share:
+     * a larger memory buffer only reduces the number of I/O calls in DEVICE-to-DEVICE copies
+     */
+    ft_uoff budget_storage_len = 0, budget_buffer_len = 0;
+    if (req_mem_budget != 0) {
+        /* maps will need roughly three times their current nodes: dev_* and storage_* free and transpose maps */
+        const ft_uoff map_node_len = sizeof(map_value_type) + 4 * sizeof(void *);
+        const ft_uoff maps_len = 3 * map_node_len * ((ft_uoff) dev_map.size() + storage_map.size());
+        const ft_uoff work_bytes = (ft_uoff) dev_map.used_count() << eff_block_size_log2;
+
+        double budget_pretty_len = 0.0, maps_pretty_len = 0.0;
+        const char * budget_pretty_unit = ff_pretty_size(req_mem_budget, & budget_pretty_len);
+        const char * maps_pretty_unit = ff_pretty_size(maps_len, & maps_pretty_len);
+
+        if (maps_len >= (ft_uoff) req_mem_budget) {
+            ff_log(FC_ERROR, 0, "requested memory budget %.2f %sbytes is too small, maps alone need about %.2f %sbytes",
+                   budget_pretty_len, budget_pretty_unit, maps_pretty_len, maps_pretty_unit);
+            /* mark error as reported */
+            return -ENOMEM;
+        }
+        if (free_ram_or_0 != 0 && (ft_uoff) req_mem_budget > free_ram_or_0) {
+            ff_log(FC_WARN, 0, "using %.2f %sbytes as requested for memory budget, but only %.2f %sbytes RAM are free",
+                    budget_pretty_len, budget_pretty_unit, free_pretty_len, free_pretty_unit);
+            ff_log(FC_WARN, 0, "honoring the request, but expect troubles (memory exhaustion)");
+        }
+        const ft_uoff avail_len = (ft_uoff) req_mem_budget - maps_len;
+        const ft_uoff buffer_len = req_mem_buffer_size != 0 ? ff_min2<ft_uoff>(req_mem_buffer_size, avail_len)
+            : ff_min2(avail_len / 8, work_bytes);
+
+        budget_storage_len = ff_min2(avail_len - buffer_len, work_bytes);
+        /* memory buffer can use whatever STORAGE does not need */
+        budget_buffer_len = ff_min2(avail_len - budget_storage_len, work_bytes);
+
+        ff_log(FC_DEBUG, 0, "memory budget %.2f %sbytes: about %.2f %sbytes reserved for maps",
+               budget_pretty_len, budget_pretty_unit, maps_pretty_len, maps_pretty_unit);
+    }
+
     if (req_total_size_exact != 0 || req_secondary_size != 0) {
         /* honor requested storage size, but warn if it may exhaust free RAM */
 
@@ -706,16 +755,17 @@ int fr_work<T>::create_storage()
          *   50% of free RAM (if free RAM cannot be determined, use 16 MB on 32bit platforms, and 256MB on 64bit+ platforms)
          *   12.5% of bytes to relocate
          */
-        if (req_secondary_size == 0 && free_ram_or_0 == 0) {
+        if (req_secondary_size == 0 && req_mem_budget == 0 && free_ram_or_0 == 0) {
             ff_log(FC_WARN, 0, "assuming at least %.2f %sbytes RAM are free", free_pretty_len, free_pretty_unit);
             ff_log(FC_WARN, 0, "expect troubles (memory exhaustion) if not true");
         }
         T work_count = dev_map.used_count();
         ft_uoff work_length_8 = (((ft_uoff) work_count << eff_block_size_log2) + 7) / 8;
-        ft_uoff total_len = ff_min2(free_ram_or_min / 2, work_length_8);
+        ft_uoff total_len = req_mem_budget != 0 ? budget_storage_len : ff_min2(free_ram_or_min / 2, work_length_8);
 
-        /* round up to multiples of 1M */
-        total_len = ff_round_up<ft_uoff>(total_len, _1M_minus_1);
+        /* round up to multiples of 1M, unless it would exceed the requested memory budget */
+        if (req_mem_budget == 0)
+            total_len = ff_round_up<ft_uoff>(total_len, _1M_minus_1);
         /* truncate to ft_size */
         auto_total_size = (ft_size) ff_min2<ft_uoff>(total_len, (ft_uoff)(ft_size)-1);
     }
@@ -744,7 +794,8 @@ int fr_work<T>::create_storage()
          * (and truncated to fit addressable RAM)
          */
         ft_uoff work_bytes = (ft_uoff)dev_map.used_count() << eff_block_size_log2;
-        mem_buffer_size = (ft_size) ff_min2((ft_uoff)(ft_size)-1, ff_min2(free_ram_or_min / 4, work_bytes));
+        ft_uoff buffer_len = req_mem_budget != 0 ? budget_buffer_len : ff_min2(free_ram_or_min / 4, work_bytes);
+        mem_buffer_size = (ft_size) ff_min2((ft_uoff)(ft_size)-1, buffer_len);
     }
 
     bool flag;
@@ -0,0 +1,172 @@
+/*
+ * fstransform - transform a file-system to another file-system type,
+ *               preserving its contents and without the need for a backup
+ *
+ * Copyright (C) 2011-2012 Massimiliano Ghilardi
+ *
+ *     This program is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as published by
+ *     the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     This program is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public License
+ *     along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * zero.cc
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: max
+ */
+
+#include "first.hh"
+
+#if defined(FT_HAVE_STRING_H)
+# include <string.h>       // for memcpy()
+#elif defined(FT_HAVE_CSTRING)
+# include <cstring>        // for memcpy()
+#endif
+
+/*
+ * SSE2 and AVX2 kernels need GCC >= 4.9 or clang, which accept intrinsics
+ * inside functions compiled with __attribute__((target(...)))
+ * and provide __builtin_cpu_supports() for runtime dispatch
+ */
+#if defined(FT_HAVE_IMMINTRIN_H) && (defined(__x86_64__) || defined(__i386__)) \
+    && (defined(__clang__) || (defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))))
+# define FT_ZERO_X86
+# include <immintrin.h>    // for _mm_*(), _mm256_*()
+#endif
+
+#include "zero.hh"         // for ff_zero_length()
+
+FT_NAMESPACE_BEGIN
+
+/** reference kernel: compare one byte at a time */
+static ft_size ff_zero_length_byte(const char * mem, ft_size mem_len)
+{
+    ft_size i = 0;
+    for (; i < mem_len; i++)
+        if (mem[i] != '\0')
+            break;
+    return i;
+}
+
+/** portable kernel: compare four machine words at a time, then find the first non-zero byte */
+static ft_size ff_zero_length_word(const char * mem, ft_size mem_len)
+{
+    typedef unsigned long ft_word;
+    enum { FC_WORD = sizeof(ft_word) };
+
+    ft_word w[4];
+    ft_size i = 0;
+    for (; i + 4 * FC_WORD <= mem_len; i += 4 * FC_WORD) {
+        /* memcpy() avoids alignment and aliasing issues, compilers turn it into plain loads */
+        memcpy(w, mem + i, sizeof(w));
+        if ((w[0] | w[1] | w[2] | w[3]) != 0)
+            break;
+    }
+    return i + ff_zero_length_byte(mem + i, mem_len - i);
+}
+
+#ifdef FT_ZERO_X86
+
+/** SSE2 kernel: compare 64 bytes at a time */
+__attribute__((target("sse2")))
+static ft_size ff_zero_length_sse2(const char * mem, ft_size mem_len)
+{
+    const __m128i zero = _mm_setzero_si128();
+    ft_size i = 0;
+    for (; i + 64 <= mem_len; i += 64) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(mem + i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(mem + i + 16));
+        __m128i c = _mm_loadu_si128((const __m128i *)(mem + i + 32));
+        __m128i d = _mm_loadu_si128((const __m128i *)(mem + i + 48));
+        __m128i x = _mm_or_si128(_mm_or_si128(a, b), _mm_or_si128(c, d));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(x, zero)) != 0xFFFF)
+            break;
+    }
+    return i + ff_zero_length_word(mem + i, mem_len - i);
+}
+
+/** AVX2 kernel: compare 128 bytes at a time */
+__attribute__((target("avx2")))
+static ft_size ff_zero_length_avx2(const char * mem, ft_size mem_len)
+{
+    ft_size i = 0;
+    for (; i + 128 <= mem_len; i += 128) {
+        __m256i a = _mm256_loadu_si256((const __m256i *)(mem + i));
+        __m256i b = _mm256_loadu_si256((const __m256i *)(mem + i + 32));
+        __m256i c = _mm256_loadu_si256((const __m256i *)(mem + i + 64));
+        __m256i d = _mm256_loadu_si256((const __m256i *)(mem + i + 96));
+        __m256i x = _mm256_or_si256(_mm256_or_si256(a, b), _mm256_or_si256(c, d));
+        if (!_mm256_testz_si256(x, x))
+            break;
+    }
+    return i + ff_zero_length_word(mem + i, mem_len - i);
+}
+
+#endif /* FT_ZERO_X86 */
+
+
+/** return the function implementing 'kernel', or NULL if not supported by this CPU or compiler */
+ft_zero_length_func ff_zero_kernel_func(ft_zero_kernel kernel)
+{
+    switch (kernel) {
+    case FC_ZERO_BYTE:
+        return ff_zero_length_byte;
+    case FC_ZERO_WORD:
+        return ff_zero_length_word;
+#ifdef FT_ZERO_X86
+    case FC_ZERO_SSE2:
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("sse2") ? ff_zero_length_sse2 : NULL;
+    case FC_ZERO_AVX2:
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2") ? ff_zero_length_avx2 : NULL;
+#endif
+    default:
+        return NULL;
+    }
+}
+
+/** return the name of 'kernel' */
+const char * ff_zero_kernel_name(ft_zero_kernel kernel)
+{
+    static const char * const name[FC_ZERO_KERNEL_N] = { "byte", "word", "sse2", "avx2" };
+    return kernel >= 0 && kernel < FC_ZERO_KERNEL_N ? name[kernel] : "unknown";
+}
+
+/** return the kernel used by ff_zero_length() */
+ft_zero_kernel ff_zero_kernel_best()
+{
+    ft_zero_kernel kernel = FC_ZERO_AVX2;
+    while (kernel > FC_ZERO_WORD && ff_zero_kernel_func(kernel) == NULL)
+        kernel = (ft_zero_kernel)(kernel - 1);
+    return kernel;
+}
+
+/** chosen once during static initialization, so that threads never race on it */
+static const ft_zero_length_func ff_zero_length_best = ff_zero_kernel_func(ff_zero_kernel_best());
+
+/**
+ * return the number of leading zero bytes in mem[0, mem_len),
+ * i.e. the offset of the first non-zero byte, or mem_len if all bytes are zero.
+ * uses the fastest kernel supported by the CPU, chosen at program start
+ */
+ft_size ff_zero_length(const char * mem, ft_size mem_len)
+{
+    return ff_zero_length_best(mem, mem_len);
+}
+
+/** return true if mem[0, mem_len) contains only zeroes */
+bool ff_mem_is_zero(const char * mem, ft_size mem_len)
+{
+    return ff_zero_length_best(mem, mem_len) == mem_len;
+}
+
+FT_NAMESPACE_END
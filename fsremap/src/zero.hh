@@ -0,0 +1,62 @@
+/*
+ * fstransform - transform a file-system to another file-system type,
+ *               preserving its contents and without the need for a backup
+ *
+ * Copyright (C) 2011-2012 Massimiliano Ghilardi
+ *
+ *     This program is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as published by
+ *     the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     This program is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public License
+ *     along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * zero.hh
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: max
+ */
+
+#ifndef FSTRANSFORM_ZERO_HH
+#define FSTRANSFORM_ZERO_HH
+
+#include "types.hh"    // for ft_size
+
+FT_NAMESPACE_BEGIN
+
+/** kernels available to scan memory for zeroes */
+enum ft_zero_kernel {
+    FC_ZERO_BYTE, FC_ZERO_WORD, FC_ZERO_SSE2, FC_ZERO_AVX2, FC_ZERO_KERNEL_N
+};
+
+/** type of functions returning the number of leading zero bytes in mem[0, mem_len) */
+typedef ft_size (*ft_zero_length_func)(const char * mem, ft_size mem_len);
+
+/**
+ * return the number of leading zero bytes in mem[0, mem_len),
+ * i.e. the offset of the first non-zero byte, or mem_len if all bytes are zero.
+ * uses the fastest kernel supported by the CPU, chosen at program start
+ */
+ft_size ff_zero_length(const char * mem, ft_size mem_len);
+
+/** return true if mem[0, mem_len) contains only zeroes */
+bool ff_mem_is_zero(const char * mem, ft_size mem_len);
+
+/** return the function implementing 'kernel', or NULL if not supported by this CPU or compiler */
+ft_zero_length_func ff_zero_kernel_func(ft_zero_kernel kernel);
+
+/** return the name of 'kernel' */
+const char * ff_zero_kernel_name(ft_zero_kernel kernel);
+
+/** return the kernel used by ff_zero_length() */
+ft_zero_kernel ff_zero_kernel_best();
+
+FT_NAMESPACE_END
+
+#endif /* FSTRANSFORM_ZERO_HH */
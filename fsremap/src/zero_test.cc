@@ -0,0 +1,114 @@
+/*
+ * fstransform - transform a file-system to another file-system type,
+ *               preserving its contents and without the need for a backup
+ *
+ * Copyright (C) 2011-2012 Massimiliano Ghilardi
+ *
+ *     This program is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as published by
+ *     the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     This program is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public License
+ *     along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * zero_test.cc
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: max
+ */
+
+#include "first.hh"
+
+#if defined(FT_HAVE_CERRNO)
+# include <cerrno>         // for EINVAL, EIO
+#elif defined(FT_HAVE_ERRNO_H)
+# include <errno.h>
+#endif
+
+#include <vector>          // for std::vector<T>
+
+#include "log.hh"          // for ff_log()
+#include "misc.hh"         // for ff_str2un_scaled(), ff_now(), ff_random(), ff_pretty_size()
+#include "zero.hh"         // for ff_zero_kernel_func()
+#include "zero_test.hh"
+
+FT_NAMESPACE_BEGIN
+
+/** check that 'func' agrees with the byte-at-a-time kernel on buffers with a single non-zero byte */
+static int ff_zero_test_check(ft_zero_kernel kernel, ft_zero_length_func func, char * buf, ft_size buf_len)
+{
+    ft_zero_length_func ref = ff_zero_kernel_func(FC_ZERO_BYTE);
+    for (ft_size i = 0; i < 1000; i++) {
+        /* random offset and length exercise unaligned heads and tails */
+        ft_size start = (ft_size) ff_random(ff_min2<ft_size>(buf_len, 64) - 1);
+        ft_size len = (ft_size) ff_random(buf_len - start);
+        ft_size pos = (ft_size) ff_random(len);
+        if (pos < len)
+            buf[start + pos] = (char) (1 + ff_random(254));
+
+        ft_size expected = ref(buf + start, len), got = func(buf + start, len);
+        if (pos < len)
+            buf[start + pos] = '\0';
+
+        if (got != expected)
+            return ff_log(FC_ERROR, EIO, "zero-scan kernel `%s' returned %" FT_ULL " instead of %" FT_ULL
+                          " on a buffer of %" FT_ULL " bytes", ff_zero_kernel_name(kernel),
+                          (ft_ull) got, (ft_ull) expected, (ft_ull) len);
+    }
+    return 0;
+}
+
+/**
+ * check and benchmark the zero-scan kernels in zero.hh.
+ * argv[1] = optional buffer size, default 64k
+ * argv[2] = optional total bytes to scan per kernel, default 1G
+ */
+int ff_zero_test(int argc, char ** argv)
+{
+    ft_size buf_len = (ft_size) 1 << 16;
+    ft_uoff total_len = (ft_uoff) 1 << 30;
+    int err = 0;
+
+    if ((argc > 1 && (err = ff_str2un_scaled(argv[1], & buf_len)) != 0)
+        || (argc > 2 && (err = ff_str2un_scaled(argv[2], & total_len)) != 0) || buf_len == 0)
+        return ff_log(FC_ERROR, EINVAL, "Usage: %s [BUFFER_SIZE [TOTAL_SIZE]]", argv[0]);
+
+    /* all zeroes except the last byte, to defeat any early exit */
+    std::vector<char> buf(buf_len);
+    ft_size loops = (ft_size) ((total_len + buf_len - 1) / buf_len);
+
+    ff_log(FC_INFO, 0, "best zero-scan kernel on this CPU: %s", ff_zero_kernel_name(ff_zero_kernel_best()));
+
+    for (int k = 0; err == 0 && k < FC_ZERO_KERNEL_N; k++) {
+        ft_zero_kernel kernel = (ft_zero_kernel) k;
+        ft_zero_length_func func = ff_zero_kernel_func(kernel);
+        if (func == NULL) {
+            ff_log(FC_INFO, 0, "%-5s not supported", ff_zero_kernel_name(kernel));
+            continue;
+        }
+        if ((err = ff_zero_test_check(kernel, func, & buf[0], buf_len)) != 0)
+            break;
+
+        buf[buf_len - 1] = 1;
+        double start = 0.0, end = 0.0;
+        ft_size sum = 0;
+        (void) ff_now(start);
+        for (ft_size i = 0; i < loops; i++)
+            sum += func(& buf[0], buf_len);
+        (void) ff_now(end);
+        buf[buf_len - 1] = 0;
+
+        double elapsed = end - start, pretty_speed = 0.0;
+        const char * pretty_label = ff_pretty_size((ft_uoff) (elapsed > 0.0 ? (double) sum / elapsed : 0.0), & pretty_speed);
+        ff_log(FC_INFO, 0, "%-5s %8.3f seconds, %8.2f %sbytes/s", ff_zero_kernel_name(kernel), elapsed, pretty_speed, pretty_label);
+    }
+    return err;
+}
+
+FT_NAMESPACE_END
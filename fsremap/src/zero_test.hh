@@ -0,0 +1,40 @@
+/*
+ * fstransform - transform a file-system to another file-system type,
+ *               preserving its contents and without the need for a backup
+ *
+ * Copyright (C) 2011-2012 Massimiliano Ghilardi
+ *
+ *     This program is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as published by
+ *     the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     This program is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public License
+ *     along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * zero_test.hh
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: max
+ */
+
+#ifndef FSTRANSFORM_ZERO_TEST_HH
+#define FSTRANSFORM_ZERO_TEST_HH
+
+FT_NAMESPACE_BEGIN
+
+/**
+ * check and benchmark the zero-scan kernels in zero.hh.
+ * argv[1] = optional buffer size, default 64k
+ * argv[2] = optional total bytes to scan per kernel, default 1G
+ */
+int ff_zero_test(int argc, char ** argv);
+
+FT_NAMESPACE_END
+
+#endif /* FSTRANSFORM_ZERO_TEST_HH */